@@ -0,0 +1,146 @@
+/**
+*@file archive.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Packed document roots.
+*
+* Archives are checked once when they are opened, every offset in them included, so that the lookups done per
+* request can trust them.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+/** 64-bit FNV-1a hash of a path, by which pack places the entries and the server finds them. */
+uint64_t archive_hash(const char *path, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)path[i]) * 1099511628211ull;
+    }
+    return hash;
+    }
+
+static bool in_range(size_t size, uint64_t offset, uint64_t length) {
+    return offset <= size && length <= size - offset;
+    }
+
+/**
+ * Validation function.
+ * @brief Checks that the index of a mapped archive only points into the archive, and that every probe sequence
+ * ends at an empty slot.
+ */
+static bool archive_valid(const struct archive *archive, const struct archive_header *header) {
+    if (header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0 ||
+        header->entryCount >= header->slotCount || header->slotsOffset % sizeof(uint32_t) != 0 ||
+        header->entriesOffset % sizeof(uint64_t) != 0 ||
+        !in_range(archive->size, header->slotsOffset, (uint64_t)header->slotCount * sizeof(uint32_t)) ||
+        !in_range(archive->size, header->entriesOffset, (uint64_t)header->entryCount * sizeof(struct archive_entry))) {
+        return false;
+    }
+    //slots may repeat a value in a crafted file, so fewer records than slots do not ensure an empty one
+    bool empty = false;
+    for (uint32_t i = 0; i < archive->slotCount; i++) {
+        if (archive->slots[i] > archive->entryCount) {
+            return false;
+        }
+        empty |= archive->slots[i] == 0;
+    }
+    if (!empty) {
+        return false;
+    }
+    for (uint32_t i = 0; i < archive->entryCount; i++) {
+        const struct archive_entry *entry = &archive->entries[i];
+        if (!in_range(archive->size, entry->pathOffset, entry->pathLength) ||
+            !in_range(archive->size, entry->headersOffset, entry->headersLength) ||
+            !in_range(archive->size, entry->bodyOffset, entry->bodyLength) ||
+            entry->notModifiedLength > entry->headersLength) {
+            return false;
+        }
+        if (entry->gzipLength > 0 && (!in_range(archive->size, entry->gzipHeadersOffset, entry->gzipHeadersLength) ||
+                                      !in_range(archive->size, entry->gzipOffset, entry->gzipLength) ||
+                                      entry->notModifiedLength > entry->gzipHeadersLength)) {
+            return false;
+        }
+    }
+    return true;
+    }
+
+/**
+ * Opening function.
+ * @brief Maps an archive made by pack into memory, read-only, and checks it.
+ * @return Returns 0, or -1 after printing why the archive cannot be served.
+ */
+int archive_open(struct archive *archive, const char *path) {
+    memset(archive, 0, sizeof(struct archive));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open() failed");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(struct archive_header)) {
+        fprintf(stderr, "%s is not an archive\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap() failed");
+        return -1;
+    }
+    archive->map = map;
+    archive->size = st.st_size;
+
+    const struct archive_header *header = map;
+    if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic)) != 0 || header->size != archive->size) {
+        fprintf(stderr, "%s is not an archive\n", path);
+        archive_close(archive);
+        return -1;
+    }
+    archive->slots = (const uint32_t *)(archive->map + header->slotsOffset);
+    archive->slotCount = header->slotCount;
+    archive->entries = (const struct archive_entry *)(archive->map + header->entriesOffset);
+    archive->entryCount = header->entryCount;
+    if (!archive_valid(archive, header)) {
+        fprintf(stderr, "%s is a damaged archive\n", path);
+        archive_close(archive);
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Lookup function.
+ * @brief Finds the entry of a path, which has to be given exactly as it was packed, starting with '/'.
+ * @return Returns the entry, or NULL if the archive has no such file.
+ */
+const struct archive_entry *archive_find(const struct archive *archive, const char *path, size_t length) {
+    uint64_t hash = archive_hash(path, length);
+    for (uint32_t slot = hash & (archive->slotCount - 1); archive->slots[slot] != 0;
+         slot = (slot + 1) & (archive->slotCount - 1)) {
+        const struct archive_entry *entry = &archive->entries[archive->slots[slot] - 1];
+        if (entry->hash == hash && entry->pathLength == length &&
+            memcmp(archive->map + entry->pathOffset, path, length) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+    }
+
+void archive_close(struct archive *archive) {
+    if (archive->map != NULL) {
+        munmap((void *)archive->map, archive->size);
+    }
+    memset(archive, 0, sizeof(struct archive));
+    }
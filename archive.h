@@ -0,0 +1,71 @@
+/**
+*@file archive.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Packed document roots.
+*
+* An archive made by pack holds every file of a document root with the header lines it is served with, and a
+* gzip variant of it if that is smaller. The server maps the archive into memory and answers from the mapping,
+* without looking at the file system again. The format is in host byte order, for the machine it is served on.
+*
+* Layout: the header in the first page, the bodies, each starting on a page of its own, then the slot table, the
+* entries and the strings of the index, which the header points to.
+**/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARCHIVE_MAGIC "HTPACK01"
+#define ARCHIVE_ALIGNMENT 4096
+
+struct archive_header {
+    char magic[8];
+    uint64_t size;
+    uint64_t slotsOffset;
+    uint64_t entriesOffset;
+    uint32_t slotCount;
+    uint32_t entryCount;
+};
+
+/**
+ * A file of the archive. Its header lines start with ETag and, if there is a gzip variant, Vary, which are the
+ * first 'notModifiedLength' bytes and all a 304 response needs. Without a gzip variant 'gzipLength' is 0.
+ */
+struct archive_entry {
+    uint64_t hash;
+    uint64_t pathOffset;
+    uint64_t headersOffset;
+    uint64_t gzipHeadersOffset;
+    uint64_t bodyOffset;
+    uint64_t bodyLength;
+    uint64_t gzipOffset;
+    uint64_t gzipLength;
+    uint32_t pathLength;
+    uint32_t headersLength;
+    uint32_t gzipHeadersLength;
+    uint32_t notModifiedLength;
+};
+
+/**
+ * A mapped archive. 'slots' is an open addressing table of 'slotCount' slots, a power of two, probed linearly
+ * from the path hash. Each slot holds the index of an entry plus one, or 0 if it is empty.
+ */
+struct archive {
+    const char *map;
+    size_t size;
+    const uint32_t *slots;
+    uint32_t slotCount;
+    const struct archive_entry *entries;
+    uint32_t entryCount;
+};
+
+uint64_t archive_hash(const char *path, size_t length);
+int archive_open(struct archive *archive, const char *path);
+const struct archive_entry *archive_find(const struct archive *archive, const char *path, size_t length);
+void archive_close(struct archive *archive);
+
+#endif
@@ -0,0 +1,149 @@
+/**
+*@file arena.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Hugepage arena for cache bodies.
+*
+* The arena is mapped with MAP_HUGETLB if enough huge pages are reserved for it, otherwise as ordinary anonymous
+* memory with MADV_HUGEPAGE, which the kernel backs with transparent huge pages as it can. Regions are only handed
+* out again once every body in them is freed, so a region pinned by one long-lived body is lost to the others
+* until then; allocations that find no room return NULL and are left to malloc() by the caller.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+#define NO_REGION ((size_t)-1)
+
+/**
+ * Arena initialisation function.
+ * @brief Maps an arena of at least 'size' bytes, rounded up to whole regions.
+ * @return Returns 0, or -1 if no memory could be mapped, in which case the arena is empty and allocates nothing.
+ */
+int arena_init(struct arena *arena, size_t size) {
+    memset(arena, 0, sizeof(struct arena));
+    arena->current = NO_REGION;
+    pthread_mutex_init(&arena->lock, NULL);
+
+    size_t regionCount = (size + ARENA_REGION_SIZE - 1) / ARENA_REGION_SIZE;
+    if (regionCount == 0) {
+        regionCount = 1;
+    }
+    size_t length = regionCount * ARENA_REGION_SIZE;
+    uint32_t *live = calloc(regionCount, sizeof(uint32_t));
+    if (live == NULL) {
+        return -1;
+    }
+
+    bool huge = true;
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base == MAP_FAILED) {
+        huge = false;
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    if (base == MAP_FAILED) {
+        perror("mmap() failed");
+        free(live);
+        return -1;
+    }
+    //without transparent huge pages the arena still packs the bodies, on small pages
+    if (!huge) {
+        madvise(base, length, MADV_HUGEPAGE);
+    }
+    arena->base = base;
+    arena->size = length;
+    arena->regionCount = regionCount;
+    arena->live = live;
+    arena->huge = huge;
+    return 0;
+    }
+
+/** Unmaps the arena. Called once nothing allocated from it is used anymore. */
+void arena_destroy(struct arena *arena) {
+    if (arena->base != NULL) {
+        munmap(arena->base, arena->size);
+    }
+    free(arena->live);
+    pthread_mutex_destroy(&arena->lock);
+    memset(arena, 0, sizeof(struct arena));
+    }
+
+/** Finds 'count' consecutive free regions, other than the current one. Called with the lock held. */
+static size_t find_regions(const struct arena *arena, size_t count) {
+    size_t run = 0;
+    for (size_t region = 0; region < arena->regionCount; region++) {
+        run = arena->live[region] == 0 && region != arena->current ? run + 1 : 0;
+        if (run == count) {
+            return region + 1 - count;
+        }
+    }
+    return NO_REGION;
+    }
+
+/**
+ * Allocation function.
+ * @brief Allocates 'length' bytes, aligned to a cache line. Bodies up to a region share regions, larger ones get
+ * regions of their own.
+ * @return Returns the memory, or NULL if the arena has no room for it or 'length' is zero.
+ */
+void *arena_alloc(struct arena *arena, size_t length) {
+    if (arena->base == NULL || length == 0 || length > arena->size) {
+        return NULL;
+    }
+    length = (length + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    char *pointer = NULL;
+
+    pthread_mutex_lock(&arena->lock);
+    if (length <= ARENA_REGION_SIZE) {
+        if (arena->current == NO_REGION || arena->offset + length > ARENA_REGION_SIZE) {
+            size_t region = find_regions(arena, 1);
+            if (region != NO_REGION) {
+                arena->current = region;
+                arena->offset = 0;
+            }
+        }
+        if (arena->current != NO_REGION && arena->offset + length <= ARENA_REGION_SIZE) {
+            pointer = arena->base + arena->current * ARENA_REGION_SIZE + arena->offset;
+            arena->offset += length;
+            arena->live[arena->current]++;
+        }
+    }
+    else {
+        size_t count = (length + ARENA_REGION_SIZE - 1) / ARENA_REGION_SIZE;
+        size_t region = find_regions(arena, count);
+        if (region != NO_REGION) {
+            for (size_t i = 0; i < count; i++) {
+                arena->live[region + i] = 1;
+            }
+            pointer = arena->base + region * ARENA_REGION_SIZE;
+        }
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return pointer;
+    }
+
+/** Frees memory of 'length' bytes, as it was allocated, returning its regions once nothing else is in them. */
+void arena_free(struct arena *arena, void *pointer, size_t length) {
+    length = (length + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    size_t region = ((char *)pointer - arena->base) / ARENA_REGION_SIZE;
+
+    pthread_mutex_lock(&arena->lock);
+    if (length <= ARENA_REGION_SIZE) {
+        //the current region starts over once it is empty, other regions wait to be found free
+        if (--arena->live[region] == 0 && region == arena->current) {
+            arena->offset = 0;
+        }
+    }
+    else {
+        size_t count = (length + ARENA_REGION_SIZE - 1) / ARENA_REGION_SIZE;
+        for (size_t i = 0; i < count; i++) {
+            arena->live[region + i] = 0;
+        }
+    }
+    pthread_mutex_unlock(&arena->lock);
+    }
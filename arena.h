@@ -0,0 +1,51 @@
+/**
+*@file arena.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Hugepage arena for cache bodies.
+*
+* Reserves the memory of a cache up front, backed by huge pages where the system has them, and packs the bodies
+* stored in it into regions of one huge page each, so that serving from a large cache costs few TLB entries.
+**/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ARENA_REGION_SIZE ((size_t)2 << 20)
+#define ARENA_ALIGNMENT 64
+
+/**
+ * An arena of 'regionCount' regions at 'base', which is NULL if it could not be mapped. Small allocations are
+ * bumped through the 'current' region at 'offset'; larger ones take runs of whole regions. 'live' counts the
+ * allocations in each region, which is free again once it drops to zero. 'huge' tells whether the arena is on
+ * hugetlbfs pages, otherwise transparent huge pages were asked for.
+ */
+struct arena {
+    pthread_mutex_t lock;
+    char *base;
+    size_t size;
+    size_t regionCount;
+    uint32_t *live;
+    size_t current;
+    size_t offset;
+    bool huge;
+};
+
+int arena_init(struct arena *arena, size_t size);
+void arena_destroy(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t length);
+void arena_free(struct arena *arena, void *pointer, size_t length);
+
+/** Tells whether 'pointer' was allocated from the arena rather than by malloc(). */
+static inline bool arena_contains(const struct arena *arena, const void *pointer) {
+    return arena->base != NULL && (const char *)pointer >= arena->base &&
+           (const char *)pointer < arena->base + arena->size;
+    }
+
+#endif
@@ -0,0 +1,180 @@
+/**
+*@file arenabench.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Benchmark of the cache arena.
+*
+* Fills the same amount of memory with bodies of cache-like sizes twice, once from the heap and once from an
+* arena, and reads from random bodies of each. Reports the reads per second and, where perf events are
+* available, the data TLB misses per thousand reads.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "arena.h"
+
+#define DEFAULT_MEGABYTES 1024
+#define DEFAULT_READS 20000000
+#define MIN_BODY 512
+#define MAX_BODY 65536
+
+static char *MYPROG;
+
+struct body {
+    char *data;
+    size_t length;
+};
+
+static void usage(char* message) {
+    fprintf(stderr,"Usage Error! \tProper input: %s [-m MEGABYTES] [-n READS]\n%s\n", MYPROG, message);
+    exit(1);}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+    }
+
+/** Opens a counter of data TLB read misses of this thread, or returns -1 if perf events are not available. */
+static int open_tlb_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+/**
+ * Measuring function.
+ * @brief Reads a word at a random place of a random body 'reads' times and prints how fast that was.
+ */
+static void measure(const char *name, const struct body *bodies, size_t count, long reads) {
+    int counter = open_tlb_counter();
+    uint64_t state = 88172645463325252ull;
+    uint64_t sum = 0;
+    struct timespec start, end;
+
+    if (counter >= 0) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < reads; i++) {
+        uint64_t random = next_random(&state);
+        const struct body *body = &bodies[random % count];
+        size_t offset = (random >> 32) % (body->length / sizeof(uint64_t));
+        uint64_t word;
+        memcpy(&word, body->data + offset * sizeof(uint64_t), sizeof(word));
+        sum += word;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-24s %8.2f Mreads/s", name, reads / seconds / 1e6);
+    long long misses;
+    if (counter >= 0 && ioctl(counter, PERF_EVENT_IOC_DISABLE, 0) == 0 &&
+        read(counter, &misses, sizeof(misses)) == (ssize_t)sizeof(misses)) {
+        printf("  %8.2f dTLB misses per 1000 reads", misses * 1000.0 / reads);
+    }
+    else {
+        printf("  dTLB misses unavailable");
+    }
+    printf("  (checksum %llu)\n", (unsigned long long)(sum & 0xff));
+    if (counter >= 0) {
+        close(counter);
+    }
+    }
+
+/**
+ * Program entry point.
+ * @brief Compares reads from bodies on the heap with reads from bodies in a cache arena.
+ * @details -m sets how many megabytes of bodies are allocated for each run, -n how many reads are measured.
+ * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char *argv[]) {
+    MYPROG = argv[0];
+    long megabytes = DEFAULT_MEGABYTES;
+    long reads = DEFAULT_READS;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:n:")) != -1) {
+        char *end;
+        switch (opt) {
+            case 'm':
+                megabytes = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || megabytes < 1) {
+                    usage("Invalid argument to the option 'm'\n");
+                }
+                break;
+            case 'n':
+                reads = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || reads < 1) {
+                    usage("Invalid argument to the option 'n'\n");
+                }
+                break;
+            default:
+                usage("Unknown Option!");
+        }
+    }
+    if (optind != argc) {
+        usage("Too many input arguments");
+    }
+
+    size_t total = (size_t)megabytes << 20;
+    size_t capacity = total / MIN_BODY + 1;
+    struct body *bodies = malloc(capacity * sizeof(struct body));
+    if (bodies == NULL) {
+        perror("malloc() failed");
+        return EXIT_FAILURE;
+    }
+    uint64_t state = 2463534242ull;
+    size_t count = 0;
+    for (size_t used = 0; used < total; used += bodies[count++].length) {
+        bodies[count].length = MIN_BODY + next_random(&state) % (MAX_BODY - MIN_BODY);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        bodies[i].data = malloc(bodies[i].length);
+        if (bodies[i].data == NULL) {
+            perror("malloc() failed");
+            return EXIT_FAILURE;
+        }
+        memset(bodies[i].data, (int)i, bodies[i].length);
+    }
+    printf("%zu bodies, %ld MB\n", count, megabytes);
+    measure("heap", bodies, count, reads);
+    for (size_t i = 0; i < count; i++) {
+        free(bodies[i].data);
+    }
+
+    struct arena arena;
+    if (arena_init(&arena, total + total / 8) != 0) {
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bodies[i].data = arena_alloc(&arena, bodies[i].length);
+        if (bodies[i].data == NULL) {
+            fprintf(stderr, "The arena is full\n");
+            return EXIT_FAILURE;
+        }
+        memset(bodies[i].data, (int)i, bodies[i].length);
+    }
+    measure(arena.huge ? "arena (hugetlbfs)" : "arena (transparent)", bodies, count, reads);
+    arena_destroy(&arena);
+    free(bodies);
+    return EXIT_SUCCESS;
+    }
@@ -0,0 +1,1400 @@
+/**
+*@file cache.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Response cache.
+*
+* Responses are stored if they carry an explicit freshness lifetime (s-maxage, max-age or Expires) and nothing that
+* forbids shared caching, and are served until that lifetime is used up; stale entries are never revalidated, only
+* fetched again. Responses with a Vary field are stored per variant.
+*
+* Concurrent misses for the same key are coalesced: the first request fetches the response while the others wait
+* for it, so an expiring hot object costs the upstream one request instead of a stampede.
+*
+* Entries pushed out of memory by the budget can be spilled to a directory, from which a later miss reads them back
+* before going upstream. The disk tier has a budget of its own and drops its oldest files first.
+*
+* The same cache also holds the files of a site, which stay valid for as long as the file is unchanged.
+*
+* Bodies are allocated from an arena on huge pages, sized after the budget, and from the heap once it is full.
+*
+* On shutdown the fresh entries can be saved to a snapshot, which the next process maps and adopts entries from as
+* they are asked for: their bodies stay in the mapping, so a restarted server is warm without reading the files
+* again. Adopted file entries are checked against the file like any other, proxied ones expire as before.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <limits.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+
+#include "cache.h"
+#include "metrics.h"
+
+#define MAX_VARIANT_LENGTH 1024
+#define MAX_VARY_LENGTH 256
+#define DISK_MAGIC 0x31434348u
+#define NEVER ((time_t)INT64_MAX)
+#define SNAPSHOT_MAGIC "HTSNAP01"
+#define SNAPSHOT_ALIGNMENT 8
+
+/** The fixed part of a response spilled to disk, followed by key, Vary, variant, headers and body. */
+struct disk_header {
+    uint32_t magic;
+    int32_t status;
+    int64_t base;
+    int64_t expires;
+    char reason[64];
+    uint32_t keyLength;
+    uint32_t varyLength;
+    uint32_t variantLength;
+    uint32_t headersLength;
+    uint64_t bodyLength;
+};
+
+/** The start of a snapshot, locating the slot table and the records at its end. */
+struct snapshot_header {
+    char magic[8];
+    uint64_t size;
+    uint64_t slotsOffset;
+    uint64_t recordsOffset;
+    uint32_t slotCount;
+    uint32_t recordCount;
+};
+
+/**
+ * An entry in a snapshot. Its strings are key, Vary and variant, each terminated, then the headers and, for file
+ * entries, the terminated content type.
+ */
+struct snapshot_record {
+    uint64_t hash;
+    uint64_t stringsOffset;
+    uint64_t bodyOffset;
+    uint64_t bodyLength;
+    int64_t base;
+    int64_t expires;
+    uint64_t device;
+    uint64_t inode;
+    int64_t fileSize;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    uint32_t keyLength;
+    uint32_t varyLength;
+    uint32_t variantLength;
+    uint32_t headersLength;
+    uint32_t contentTypeLength;
+    int32_t status;
+    char reason[64];
+};
+
+static uint64_t hash_key(const char *key) {
+    uint64_t hash = 14695981039346656037u;
+    for (; *key != '\0'; key++) {
+        hash = (hash ^ (unsigned char)*key) * 1099511628211u;
+    }
+    return hash;
+    }
+
+/**
+ * Field iteration function.
+ * @brief Finds the next header line named 'name' in 'lines', starting at '*pos', and advances '*pos' past it.
+ * @return Returns its trimmed value, or NULL if there is no further such line.
+ */
+static const char *next_field(const char *lines, size_t length, const char **pos, const char *name, size_t *valueLength) {
+    size_t nameLength = strlen(name);
+    const char *end = lines + length;
+
+    while (*pos < end) {
+        const char *line = *pos;
+        const char *lineEnd = memchr(line, '\r', end - line);
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+        *pos = lineEnd + 2;
+        if ((size_t)(lineEnd - line) > nameLength && line[nameLength] == ':' && strncasecmp(line, name, nameLength) == 0) {
+            const char *value = line + nameLength + 1;
+            while (value < lineEnd && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            const char *valueEnd = lineEnd;
+            while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+                valueEnd--;
+            }
+            *valueLength = valueEnd - value;
+            return value;
+        }
+    }
+    return NULL;
+    }
+
+/**
+ * Field lookup function.
+ * @brief Finds the first header line named 'name' among "Name: value" lines separated by CRLF.
+ * @return Returns its trimmed value, which is not terminated, or NULL if there is no such line.
+ */
+const char *cache_field(const char *lines, size_t length, const char *name, size_t *valueLength) {
+    const char *pos = lines;
+    return next_field(lines, length, &pos, name, valueLength);
+    }
+
+/**
+ * Directive function.
+ * @brief Looks for a directive in all 'field' lines, which hold comma-separated lists like Cache-Control does.
+ * @details If 'number' is given it receives the numeric argument of the directive, or -1 if it has none.
+ * @return Returns true if the directive is present.
+ */
+static bool has_directive(const char *lines, size_t length, const char *field, const char *directive, long *number) {
+    size_t directiveLength = strlen(directive);
+    const char *pos = lines;
+    const char *value;
+    size_t valueLength;
+
+    while ((value = next_field(lines, length, &pos, field, &valueLength)) != NULL) {
+        const char *end = value + valueLength;
+        while (value < end) {
+            while (value < end && (*value == ' ' || *value == ',')) {
+                value++;
+            }
+            const char *tokenEnd = memchr(value, ',', end - value);
+            if (tokenEnd == NULL) {
+                tokenEnd = end;
+            }
+            if ((size_t)(tokenEnd - value) >= directiveLength && strncasecmp(value, directive, directiveLength) == 0 &&
+                (value + directiveLength == tokenEnd || value[directiveLength] == '=' || value[directiveLength] == ' ')) {
+                if (number != NULL) {
+                    const char *argument = value + directiveLength;
+                    *number = -1;
+                    if (argument < tokenEnd && *argument == '=') {
+                        argument++;
+                        if (argument < tokenEnd && *argument == '"') {
+                            argument++;
+                        }
+                        char *numberEnd;
+                        long n = strtol(argument, &numberEnd, 10);
+                        if (numberEnd > argument && n >= 0) {
+                            *number = n;
+                        }
+                    }
+                }
+                return true;
+            }
+            value = tokenEnd;
+        }
+    }
+    return false;
+    }
+
+/** Parses an HTTP date in the preferred IMF-fixdate format. */
+static bool parse_date(const char *value, size_t length, time_t *out) {
+    char text[64];
+    if (length >= sizeof(text)) {
+        return false;
+    }
+    memcpy(text, value, length);
+    text[length] = '\0';
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    char *end = strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0') {
+        return false;
+    }
+    *out = timegm(&tm);
+    return true;
+    }
+
+/**
+ * Request policy function.
+ * @brief Tells whether a request may be answered from the cache and its response stored.
+ * @details Only GET and HEAD qualify. Requests with credentials, or asking for no-store or no-cache, bypass the
+ * cache altogether.
+ */
+bool cache_request_allowed(const char *method, const char *headers, size_t headersLength) {
+    size_t length;
+    return (strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0) &&
+           cache_field(headers, headersLength, "Authorization", &length) == NULL &&
+           !has_directive(headers, headersLength, "Cache-Control", "no-store", NULL) &&
+           !has_directive(headers, headersLength, "Cache-Control", "no-cache", NULL) &&
+           !has_directive(headers, headersLength, "Pragma", "no-cache", NULL);
+    }
+
+/**
+ * Freshness function.
+ * @brief Decides whether a response may be stored by a shared cache, and for how long it stays fresh.
+ * @details Only statuses that are cacheable by default are stored, and only with an explicit lifetime; there is no
+ * heuristic freshness. '*age' is how old the response already was when it was received.
+ * @return Returns true if the response is storable and still fresh.
+ */
+static bool fresh_lifetime(int status, const char *headers, size_t length, time_t now, time_t *lifetime, time_t *age) {
+    static const int cacheable[] = { 200, 203, 204, 300, 301, 308, 404, 405, 410, 414, 501 };
+    bool known = false;
+    for (size_t i = 0; i < sizeof(cacheable) / sizeof(cacheable[0]); i++) {
+        known = known || status == cacheable[i];
+    }
+    size_t valueLength;
+    const char *vary = cache_field(headers, length, "Vary", &valueLength);
+    if (!known || (vary != NULL && memchr(vary, '*', valueLength) != NULL) ||
+        cache_field(headers, length, "Set-Cookie", &valueLength) != NULL ||
+        has_directive(headers, length, "Cache-Control", "no-store", NULL) ||
+        has_directive(headers, length, "Cache-Control", "no-cache", NULL) ||
+        has_directive(headers, length, "Cache-Control", "private", NULL)) {
+        return false;
+    }
+
+    time_t date = now;
+    const char *value = cache_field(headers, length, "Date", &valueLength);
+    if (value == NULL || !parse_date(value, valueLength, &date)) {
+        date = now;
+    }
+
+    long seconds;
+    if (has_directive(headers, length, "Cache-Control", "s-maxage", &seconds) && seconds >= 0) {
+        *lifetime = seconds;
+    }
+    else if (has_directive(headers, length, "Cache-Control", "max-age", &seconds) && seconds >= 0) {
+        *lifetime = seconds;
+    }
+    else if ((value = cache_field(headers, length, "Expires", &valueLength)) != NULL) {
+        time_t expires;
+        if (!parse_date(value, valueLength, &expires)) {
+            return false;
+        }
+        *lifetime = expires - date;
+    }
+    else {
+        return false;
+    }
+
+    *age = now > date ? now - date : 0;
+    value = cache_field(headers, length, "Age", &valueLength);
+    if (value != NULL) {
+        long ageValue = strtol(value, NULL, 10);
+        if (ageValue > *age) {
+            *age = ageValue;
+        }
+    }
+    return *lifetime > *age;
+    }
+
+/**
+ * Variant function.
+ * @brief Collects the values a request has for the fields named by a Vary field, each followed by a newline.
+ * @return Returns the length of the variant, or -1 if it does not fit into 'out'.
+ */
+static int make_variant(const char *varyNames, const char *headers, size_t headersLength, char *out, size_t size) {
+    size_t length = 0;
+    const char *name = varyNames;
+
+    while (*name != '\0') {
+        while (*name == ' ' || *name == ',') {
+            name++;
+        }
+        size_t nameLength = strcspn(name, " ,");
+        if (nameLength == 0) {
+            break;
+        }
+        char field[64];
+        if (nameLength >= sizeof(field)) {
+            return -1;
+        }
+        memcpy(field, name, nameLength);
+        field[nameLength] = '\0';
+        name += nameLength;
+
+        size_t valueLength = 0;
+        const char *value = cache_field(headers, headersLength, field, &valueLength);
+        if (length + valueLength + 1 >= size) {
+            return -1;
+        }
+        if (value != NULL) {
+            memcpy(out + length, value, valueLength);
+            length += valueLength;
+        }
+        out[length++] = '\n';
+    }
+    out[length] = '\0';
+    return length;
+    }
+
+static bool variant_matches(const struct cache_entry *entry, const char *headers, size_t headersLength) {
+    if (entry->varyNames[0] == '\0') {
+        return true;
+    }
+    char variant[MAX_VARIANT_LENGTH];
+    return make_variant(entry->varyNames, headers, headersLength, variant, sizeof(variant)) >= 0 &&
+           strcmp(variant, entry->variant) == 0;
+    }
+
+/**
+ * Entry allocation function.
+ * @brief Allocates an entry with room for its strings and a body of 'bodyLength' bytes. The strings are copied
+ * from the given sources if they are not NULL.
+ * @return Returns the entry, holding one reference, or NULL if memory is short.
+ */
+static struct cache_entry *new_entry(struct cache *cache, const char *key, size_t keyLength, const char *varyNames,
+                                     size_t varyLength, const char *variant, size_t variantLength, size_t headersLength,
+                                     size_t bodyLength) {
+    size_t stringsLength = keyLength + 1 + varyLength + 1 + variantLength + 1 + headersLength;
+    struct cache_entry *entry = malloc(sizeof(struct cache_entry) + stringsLength);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->body = arena_alloc(&cache->arena, bodyLength);
+    if (entry->body == NULL) {
+        if (bodyLength > 0 && cache->arena.base != NULL) {
+            METRICS_ADD(cacheArenaFallbacks, 1);
+        }
+        entry->body = malloc(bodyLength > 0 ? bodyLength : 1);
+    }
+    if (entry->body == NULL) {
+        free(entry);
+        return NULL;
+    }
+
+    entry->cache = cache;
+    entry->next = NULL;
+    entry->lruPrev = NULL;
+    entry->lruNext = NULL;
+    entry->size = sizeof(struct cache_entry) + stringsLength + bodyLength;
+    entry->refs = 1;
+    entry->linked = false;
+
+    entry->key = (char *)(entry + 1);
+    entry->varyNames = entry->key + keyLength + 1;
+    entry->variant = entry->varyNames + varyLength + 1;
+    entry->headers = entry->variant + variantLength + 1;
+    entry->key[keyLength] = '\0';
+    entry->varyNames[varyLength] = '\0';
+    entry->variant[variantLength] = '\0';
+    if (key != NULL) {
+        memcpy(entry->key, key, keyLength);
+    }
+    if (varyNames != NULL) {
+        memcpy(entry->varyNames, varyNames, varyLength);
+    }
+    if (variant != NULL) {
+        memcpy(entry->variant, variant, variantLength);
+    }
+    entry->headersLength = headersLength;
+    entry->bodyLength = bodyLength;
+    entry->hash = key != NULL ? hash_key(entry->key) : 0;
+    entry->device = 0;
+    entry->inode = 0;
+    entry->fileSize = 0;
+    entry->contentType = NULL;
+    entry->mapped = false;
+    entry->modified.tv_sec = 0;
+    entry->modified.tv_nsec = 0;
+    return entry;
+    }
+
+/** Frees the body of an entry, which is in the arena, on the heap or, if the entry is mapped, in a snapshot. */
+static void free_body(struct cache_entry *entry) {
+    if (entry->mapped) {
+        return;
+    }
+    if (arena_contains(&entry->cache->arena, entry->body)) {
+        arena_free(&entry->cache->arena, entry->body, entry->bodyLength);
+    }
+    else {
+        free(entry->body);
+    }
+    }
+
+static void free_entry(struct cache_entry *entry) {
+    free_body(entry);
+    free(entry);
+    }
+
+static void lru_remove(struct cache *cache, struct cache_entry *entry) {
+    if (entry->lruPrev != NULL) {
+        entry->lruPrev->lruNext = entry->lruNext;
+    }
+    else {
+        cache->lruHead = entry->lruNext;
+    }
+    if (entry->lruNext != NULL) {
+        entry->lruNext->lruPrev = entry->lruPrev;
+    }
+    else {
+        cache->lruTail = entry->lruPrev;
+    }
+    entry->lruPrev = NULL;
+    entry->lruNext = NULL;
+    }
+
+static void lru_push(struct cache *cache, struct cache_entry *entry) {
+    entry->lruNext = cache->lruHead;
+    if (cache->lruHead != NULL) {
+        cache->lruHead->lruPrev = entry;
+    }
+    else {
+        cache->lruTail = entry;
+    }
+    cache->lruHead = entry;
+    }
+
+/** Takes an entry out of the table. It is freed right away unless it is still referenced. */
+static void unlink_entry(struct cache *cache, struct cache_entry *entry, bool keep) {
+    struct cache_entry **link = &cache->buckets[entry->hash % CACHE_BUCKETS];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    entry->next = NULL;
+    lru_remove(cache, entry);
+    cache->used -= entry->size;
+    entry->linked = false;
+    if (!keep && entry->refs == 0) {
+        free_entry(entry);
+    }
+    }
+
+/**
+ * Entry search function.
+ * @brief Finds a fresh entry for 'key' whose variant matches the request, dropping expired entries on the way.
+ * @return Returns the entry with a reference for the caller, or NULL.
+ */
+static struct cache_entry *find_entry(struct cache *cache, uint64_t hash, const char *key, const char *headers,
+                                      size_t headersLength) {
+    time_t now = time(NULL);
+    struct cache_entry *entry = cache->buckets[hash % CACHE_BUCKETS];
+    while (entry != NULL) {
+        struct cache_entry *next = entry->next;
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            if (entry->expires <= now) {
+                unlink_entry(cache, entry, false);
+            }
+            else if (variant_matches(entry, headers, headersLength)) {
+                lru_remove(cache, entry);
+                lru_push(cache, entry);
+                entry->refs++;
+                return entry;
+            }
+        }
+        entry = next;
+    }
+    return NULL;
+    }
+
+static void disk_path(const struct cache *cache, uint64_t hash, char *out, size_t size) {
+    snprintf(out, size, "%s/%016llx.cache", cache->diskDir, (unsigned long long)hash);
+    }
+
+static struct disk_record *find_record(struct cache *cache, uint64_t hash) {
+    struct disk_record *record = cache->diskBuckets[hash % CACHE_BUCKETS];
+    while (record != NULL && record->hash != hash) {
+        record = record->next;
+    }
+    return record;
+    }
+
+/** Forgets a file of the disk tier and, if 'remove' is set, deletes it. Called with the lock held. */
+static void drop_record(struct cache *cache, struct disk_record *record, bool remove) {
+    struct disk_record **link = &cache->diskBuckets[record->hash % CACHE_BUCKETS];
+    while (*link != record) {
+        link = &(*link)->next;
+    }
+    *link = record->next;
+    if (record->older != NULL) {
+        record->older->newer = record->newer;
+    }
+    else {
+        cache->diskOldest = record->newer;
+    }
+    if (record->newer != NULL) {
+        record->newer->older = record->older;
+    }
+    else {
+        cache->diskNewest = record->older;
+    }
+    cache->diskUsed -= record->size;
+
+    if (remove) {
+        char path[CACHE_MAX_DIR + 32];
+        disk_path(cache, record->hash, path, sizeof(path));
+        unlink(path);
+    }
+    free(record);
+    }
+
+static int write_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+    }
+
+/**
+ * Spill function.
+ * @brief Writes an entry that was pushed out of memory to the disk tier, replacing an older file of the same key.
+ * @details The file is written under a temporary name and renamed, so a concurrent reader never sees half of it.
+ * The oldest files are deleted while the tier is over its budget.
+ */
+static void spill_entry(struct cache *cache, const struct cache_entry *entry) {
+    if (entry->expires <= time(NULL) || entry->size > cache->diskBudget) {
+        return;
+    }
+    char path[CACHE_MAX_DIR + 32];
+    char temporary[CACHE_MAX_DIR + 32];
+    snprintf(temporary, sizeof(temporary), "%s/spill.XXXXXX", cache->diskDir);
+    int fd = mkstemp(temporary);
+    if (fd < 0) {
+        perror("mkstemp() failed");
+        return;
+    }
+
+    struct disk_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DISK_MAGIC;
+    header.status = entry->status;
+    header.base = entry->base;
+    header.expires = entry->expires;
+    memcpy(header.reason, entry->reason, sizeof(header.reason));
+    header.keyLength = strlen(entry->key);
+    header.varyLength = strlen(entry->varyNames);
+    header.variantLength = strlen(entry->variant);
+    header.headersLength = entry->headersLength;
+    header.bodyLength = entry->bodyLength;
+
+    struct iovec iov[6] = {
+        { &header, sizeof(header) },
+        { entry->key, header.keyLength },
+        { entry->varyNames, header.varyLength },
+        { entry->variant, header.variantLength },
+        { entry->headers, entry->headersLength },
+        { entry->body, entry->bodyLength },
+    };
+    disk_path(cache, entry->hash, path, sizeof(path));
+    if (write_all(fd, iov, 6) != 0 || close(fd) != 0 || rename(temporary, path) != 0) {
+        perror("Spilling a cache entry failed");
+        close(fd);
+        unlink(temporary);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    struct disk_record *record = find_record(cache, entry->hash);
+    if (record != NULL) {
+        drop_record(cache, record, false);
+    }
+    record = malloc(sizeof(struct disk_record));
+    if (record == NULL) {
+        unlink(path);
+    }
+    else {
+        record->hash = entry->hash;
+        record->size = entry->size;
+        record->next = cache->diskBuckets[entry->hash % CACHE_BUCKETS];
+        cache->diskBuckets[entry->hash % CACHE_BUCKETS] = record;
+        record->older = cache->diskNewest;
+        record->newer = NULL;
+        if (cache->diskNewest != NULL) {
+            cache->diskNewest->newer = record;
+        }
+        else {
+            cache->diskOldest = record;
+        }
+        cache->diskNewest = record;
+        cache->diskUsed += record->size;
+    }
+    while (cache->diskUsed > cache->diskBudget && cache->diskOldest != NULL) {
+        drop_record(cache, cache->diskOldest, true);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    }
+
+static int read_all(int fd, void *buf, size_t len) {
+    char *pos = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, pos, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        pos += n;
+        len -= n;
+    }
+    return 0;
+    }
+
+/**
+ * Disk lookup function.
+ * @brief Reads the entry for 'key' back from the disk tier if it is there, still fresh and of the right variant.
+ * @return Returns the entry, not yet inserted, or NULL.
+ */
+static struct cache_entry *load_entry(struct cache *cache, uint64_t hash, const char *key, const char *headers,
+                                      size_t headersLength) {
+    pthread_mutex_lock(&cache->lock);
+    bool known = find_record(cache, hash) != NULL;
+    pthread_mutex_unlock(&cache->lock);
+    if (!known) {
+        return NULL;
+    }
+
+    char path[CACHE_MAX_DIR + 32];
+    disk_path(cache, hash, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct disk_header header;
+    struct cache_entry *entry = NULL;
+    if (read_all(fd, &header, sizeof(header)) == 0 && header.magic == DISK_MAGIC && header.keyLength == strlen(key) &&
+        header.varyLength < MAX_VARY_LENGTH && header.variantLength < MAX_VARIANT_LENGTH &&
+        header.headersLength <= cache->budget && header.bodyLength <= cache->budget) {
+        entry = new_entry(cache, NULL, header.keyLength, NULL, header.varyLength, NULL, header.variantLength,
+                          header.headersLength, header.bodyLength);
+    }
+    if (entry != NULL) {
+        struct iovec parts[5] = {
+            { entry->key, header.keyLength },
+            { entry->varyNames, header.varyLength },
+            { entry->variant, header.variantLength },
+            { entry->headers, header.headersLength },
+            { entry->body, header.bodyLength },
+        };
+        bool complete = true;
+        for (int i = 0; i < 5 && complete; i++) {
+            complete = read_all(fd, parts[i].iov_base, parts[i].iov_len) == 0;
+        }
+        entry->hash = hash;
+        entry->status = header.status;
+        memcpy(entry->reason, header.reason, sizeof(entry->reason));
+        entry->reason[sizeof(entry->reason) - 1] = '\0';
+        entry->base = header.base;
+        entry->expires = header.expires;
+        if (!complete || strcmp(entry->key, key) != 0 || entry->expires <= time(NULL) ||
+            !variant_matches(entry, headers, headersLength)) {
+            free_entry(entry);
+            entry = NULL;
+        }
+    }
+    close(fd);
+    return entry;
+    }
+
+/**
+ * Snapshot lookup function.
+ * @brief Adopts the entry for 'key' from the snapshot if it has one that is still fresh and of the right variant.
+ * @details Key, variant and headers are copied, the body stays in the mapping. Files are not looked at here, the
+ * caller checks the entry against the file as it does for every file entry.
+ * @return Returns the entry, not yet inserted, or NULL.
+ */
+static struct cache_entry *adopt_entry(struct cache *cache, uint64_t hash, const char *key, const char *headers,
+                                       size_t headersLength) {
+    time_t now = time(NULL);
+    size_t keyLength = strlen(key);
+    for (uint32_t slot = hash & (cache->snapshotSlotCount - 1); cache->snapshotSlots[slot] != 0;
+         slot = (slot + 1) & (cache->snapshotSlotCount - 1)) {
+        const struct snapshot_record *record = &cache->snapshotRecords[cache->snapshotSlots[slot] - 1];
+        const char *recordKey = cache->snapshot + record->stringsOffset;
+        if (record->hash != hash || record->keyLength != keyLength || memcmp(recordKey, key, keyLength) != 0 ||
+            record->expires <= now || record->bodyLength > cache->budget / CACHE_OBJECT_SHARE) {
+            continue;
+        }
+        const char *varyNames = recordKey + record->keyLength + 1;
+        const char *variant = varyNames + record->varyLength + 1;
+        const char *recordHeaders = variant + record->variantLength + 1;
+        struct cache_entry *entry = new_entry(cache, key, keyLength, varyNames, record->varyLength, variant,
+                                              record->variantLength, record->headersLength, 0);
+        if (entry == NULL) {
+            return NULL;
+        }
+        memcpy(entry->headers, recordHeaders, record->headersLength);
+        if (!variant_matches(entry, headers, headersLength)) {
+            free_entry(entry);
+            continue;
+        }
+        free_body(entry);
+        entry->body = (char *)cache->snapshot + record->bodyOffset;
+        entry->bodyLength = record->bodyLength;
+        entry->size += record->bodyLength;
+        entry->mapped = true;
+        entry->status = record->status;
+        memcpy(entry->reason, record->reason, sizeof(entry->reason));
+        entry->base = record->base;
+        entry->expires = record->expires;
+        entry->device = record->device;
+        entry->inode = record->inode;
+        entry->fileSize = record->fileSize;
+        entry->modified.tv_sec = record->modifiedSeconds;
+        entry->modified.tv_nsec = record->modifiedNanoseconds;
+        if (record->contentTypeLength > 0) {
+            entry->contentType = recordHeaders + record->headersLength;
+        }
+        return entry;
+    }
+    return NULL;
+    }
+
+static struct cache_fill *find_fill(struct cache *cache, uint64_t hash, const char *key) {
+    struct cache_fill *fill = cache->fills;
+    while (fill != NULL && (fill->hash != hash || strcmp(fill->key, key) != 0)) {
+        fill = fill->next;
+    }
+    return fill;
+    }
+
+/**
+ * Lookup function.
+ * @brief Finds a fresh response for 'key' that matches the request with the header lines 'headers'.
+ * @details On a miss with 'fill' set, the caller either becomes the one to fetch the response, which is signalled
+ * with '*leader' and has to be ended with cache_fill_done(), or waits for the request already fetching it. A
+ * waiting request gets the stored response, or NULL if it turned out not to be storable, and then fetches it
+ * itself without storing. Misses in memory are looked up in the disk tier and in the snapshot before anything is
+ * fetched.
+ * @return Returns the entry, with a reference to be given back with cache_release(), or NULL on a miss.
+ */
+struct cache_entry *cache_lookup(struct cache *cache, const char *key, const char *headers, size_t headersLength,
+                                 bool fill, bool *leader) {
+    uint64_t hash = hash_key(key);
+    struct cache_entry *entry = NULL;
+    bool waited = false;
+    *leader = false;
+
+    pthread_mutex_lock(&cache->lock);
+    for (;;) {
+        entry = find_entry(cache, hash, key, headers, headersLength);
+        if (entry != NULL || !fill) {
+            break;
+        }
+        struct cache_fill *pending = find_fill(cache, hash, key);
+        if (pending == NULL) {
+            pending = malloc(sizeof(struct cache_fill));
+            char *copy = pending != NULL ? strdup(key) : NULL;
+            if (copy != NULL) {
+                pending->key = copy;
+                pending->hash = hash;
+                pending->waiters = 0;
+                pending->done = false;
+                pending->stored = false;
+                pending->next = cache->fills;
+                cache->fills = pending;
+                *leader = true;
+            }
+            else {
+                free(pending);
+            }
+            break;
+        }
+
+        if (!waited) {
+            METRICS_ADD(cacheCoalesced, 1);
+        }
+        waited = true;
+        pending->waiters++;
+        while (!pending->done) {
+            pthread_cond_wait(&cache->filled, &cache->lock);
+        }
+        bool stored = pending->stored;
+        if (--pending->waiters == 0) {
+            free(pending->key);
+            free(pending);
+        }
+        if (!stored) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (entry == NULL && *leader && cache->diskDir[0] != '\0') {
+        entry = load_entry(cache, hash, key, headers, headersLength);
+        if (entry != NULL) {
+            cache_insert(entry);
+            cache_fill_done(cache, key, true);
+            *leader = false;
+            METRICS_ADD(cacheDiskHits, 1);
+            return entry;
+        }
+    }
+    if (entry == NULL && (*leader || !fill) && cache->snapshot != NULL) {
+        entry = adopt_entry(cache, hash, key, headers, headersLength);
+        if (entry != NULL) {
+            cache_insert(entry);
+            if (*leader) {
+                cache_fill_done(cache, key, true);
+                *leader = false;
+            }
+            METRICS_ADD(cacheSnapshotHits, 1);
+            return entry;
+        }
+    }
+    if (entry != NULL) {
+        METRICS_ADD(cacheHits, 1);
+    }
+    else {
+        METRICS_ADD(cacheMisses, 1);
+    }
+    return entry;
+    }
+
+/**
+ * Fill end function.
+ * @brief Ends the fetch a lookup made the caller responsible for and wakes up the requests waiting for it.
+ * @param stored Whether the response was inserted, otherwise the waiting requests fetch it on their own.
+ */
+void cache_fill_done(struct cache *cache, const char *key, bool stored) {
+    uint64_t hash = hash_key(key);
+    pthread_mutex_lock(&cache->lock);
+    struct cache_fill **link = &cache->fills;
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0)) {
+        link = &(*link)->next;
+    }
+    struct cache_fill *pending = *link;
+    if (pending != NULL) {
+        *link = pending->next;
+        pending->done = true;
+        pending->stored = stored;
+        if (pending->waiters == 0) {
+            free(pending->key);
+            free(pending);
+        }
+        else {
+            pthread_cond_broadcast(&cache->filled);
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    }
+
+/**
+ * Entry preparation function.
+ * @brief Creates an entry for an upstream response if it may be stored, leaving the body to be read into it.
+ * @details 'headers' are the end-to-end header lines of the response, 'requestHeaders' those of the request, from
+ * which the variant is taken. Bodies larger than an eighth of the budget are not stored.
+ * @return Returns the entry, to be inserted with cache_insert() or dropped with cache_release(), or NULL.
+ */
+struct cache_entry *cache_prepare(struct cache *cache, const char *key, int status, const char *reason,
+                                  const char *headers, size_t headersLength, const char *requestHeaders,
+                                  size_t requestHeadersLength, off_t bodyLength) {
+    time_t now = time(NULL);
+    time_t lifetime, age;
+    if (bodyLength < 0 || (size_t)bodyLength > cache->budget / CACHE_OBJECT_SHARE ||
+        !fresh_lifetime(status, headers, headersLength, now, &lifetime, &age)) {
+        return NULL;
+    }
+
+    char varyNames[MAX_VARY_LENGTH] = "";
+    char variant[MAX_VARIANT_LENGTH] = "";
+    int variantLength = 0;
+    size_t varyLength = 0;
+    const char *vary = cache_field(headers, headersLength, "Vary", &varyLength);
+    if (vary != NULL) {
+        if (varyLength >= sizeof(varyNames)) {
+            return NULL;
+        }
+        memcpy(varyNames, vary, varyLength);
+        varyNames[varyLength] = '\0';
+        variantLength = make_variant(varyNames, requestHeaders, requestHeadersLength, variant, sizeof(variant));
+        if (variantLength < 0) {
+            return NULL;
+        }
+    }
+
+    struct cache_entry *entry = new_entry(cache, key, strlen(key), varyNames, varyLength, variant, variantLength,
+                                          headersLength, bodyLength);
+    if (entry == NULL) {
+        return NULL;
+    }
+    //Age is recomputed whenever the entry is served
+    size_t length = 0;
+    const char *line = headers;
+    const char *end = headers + headersLength;
+    while (line < end) {
+        const char *lineEnd = memchr(line, '\n', end - line);
+        lineEnd = lineEnd != NULL ? lineEnd + 1 : end;
+        if (strncasecmp(line, "Age:", 4) != 0) {
+            memcpy(entry->headers + length, line, lineEnd - line);
+            length += lineEnd - line;
+        }
+        line = lineEnd;
+    }
+    entry->headersLength = length;
+    entry->status = status;
+    snprintf(entry->reason, sizeof(entry->reason), "%s", reason);
+    entry->base = now - age;
+    entry->expires = entry->base + lifetime;
+    return entry;
+    }
+
+/**
+ * File entry function.
+ * @brief Creates an entry for the file described by 'st', leaving its contents to be read into the body.
+ * @details Files larger than an eighth of the budget are not stored. 'contentType' has to outlive the entry.
+ * @return Returns the entry, to be inserted with cache_insert() or dropped with cache_release(), or NULL.
+ */
+struct cache_entry *cache_prepare_file(struct cache *cache, const char *key, const struct stat *st,
+                                       const char *contentType) {
+    if ((size_t)st->st_size > cache->budget / CACHE_OBJECT_SHARE) {
+        return NULL;
+    }
+    struct cache_entry *entry = new_entry(cache, key, strlen(key), NULL, 0, NULL, 0, 0, st->st_size);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->status = 200;
+    strcpy(entry->reason, "OK");
+    entry->base = time(NULL);
+    entry->expires = NEVER;
+    entry->device = st->st_dev;
+    entry->inode = st->st_ino;
+    entry->fileSize = st->st_size;
+    entry->modified = st->st_mtim;
+    entry->contentType = contentType;
+    return entry;
+    }
+
+/**
+ * File loading function.
+ * @brief Reads the file open as 'fd' and described by 'st' into a new entry, and inserts it.
+ * @return Returns the entry, holding a reference for the caller, or NULL if the file is too large for the cache or
+ * could not be read.
+ */
+struct cache_entry *cache_load_file(struct cache *cache, const char *key, int fd, const struct stat *st,
+                                    const char *contentType) {
+    struct cache_entry *entry = cache_prepare_file(cache, key, st, contentType);
+    if (entry == NULL) {
+        return NULL;
+    }
+    size_t received = 0;
+    while (received < entry->bodyLength) {
+        ssize_t n = pread(fd, entry->body + received, entry->bodyLength - received, received);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    if (received < entry->bodyLength) {
+        cache_release(entry);
+        return NULL;
+    }
+    cache_insert(entry);
+    return entry;
+    }
+
+/** Tells whether a file entry still holds the file described by 'st'. */
+bool cache_entry_current(const struct cache_entry *entry, const struct stat *st) {
+    return entry->device == st->st_dev && entry->inode == st->st_ino && entry->fileSize == st->st_size &&
+           entry->modified.tv_sec == st->st_mtim.tv_sec && entry->modified.tv_nsec == st->st_mtim.tv_nsec;
+    }
+
+/**
+ * Insertion function.
+ * @brief Adds a prepared entry to the cache, replacing the entry of the same key and variant, and evicts the least
+ * recently used entries while the cache is over its budget. The caller keeps its reference.
+ * @details Evicted entries are spilled to the disk tier, if there is one, after the lock is released.
+ */
+void cache_insert(struct cache_entry *entry) {
+    struct cache *cache = entry->cache;
+    struct cache_entry *evicted = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+    struct cache_entry *other = cache->buckets[entry->hash % CACHE_BUCKETS];
+    while (other != NULL) {
+        struct cache_entry *next = other->next;
+        if (other->hash == entry->hash && strcmp(other->key, entry->key) == 0 &&
+            strcmp(other->varyNames, entry->varyNames) == 0 && strcmp(other->variant, entry->variant) == 0) {
+            unlink_entry(cache, other, false);
+        }
+        other = next;
+    }
+    entry->next = cache->buckets[entry->hash % CACHE_BUCKETS];
+    cache->buckets[entry->hash % CACHE_BUCKETS] = entry;
+    lru_push(cache, entry);
+    cache->used += entry->size;
+    entry->linked = true;
+    METRICS_ADD(cacheStores, 1);
+
+    while (cache->used > cache->budget && cache->lruTail != NULL && cache->lruTail != entry) {
+        struct cache_entry *victim = cache->lruTail;
+        unlink_entry(cache, victim, cache->diskDir[0] != '\0');
+        METRICS_ADD(cacheEvictions, 1);
+        if (cache->diskDir[0] != '\0') {
+            victim->refs++;
+            victim->next = evicted;
+            evicted = victim;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    while (evicted != NULL) {
+        struct cache_entry *victim = evicted;
+        evicted = victim->next;
+        spill_entry(cache, victim);
+        cache_release(victim);
+    }
+    }
+
+/** Gives back a reference, freeing the entry if it is no longer in the cache and nobody else uses it. */
+void cache_release(struct cache_entry *entry) {
+    struct cache *cache = entry->cache;
+    pthread_mutex_lock(&cache->lock);
+    bool unused = --entry->refs == 0 && !entry->linked;
+    pthread_mutex_unlock(&cache->lock);
+    if (unused) {
+        free_entry(entry);
+    }
+    }
+
+/** Returns the value of the Age field to send with an entry, in seconds. */
+long cache_entry_age(const struct cache_entry *entry) {
+    time_t now = time(NULL);
+    return now > entry->base ? (long)(now - entry->base) : 0;
+    }
+
+/**
+ * Disk tier cleaning function.
+ * @brief Deletes the files a previous run left in the disk tier, they are not known to this one.
+ */
+static void clean_disk(const char *dir) {
+    DIR *handle = opendir(dir);
+    if (handle == NULL) {
+        return;
+    }
+    struct dirent *file;
+    while ((file = readdir(handle)) != NULL) {
+        size_t length = strlen(file->d_name);
+        if ((length > 6 && strcmp(file->d_name + length - 6, ".cache") == 0) || strncmp(file->d_name, "spill.", 6) == 0) {
+            unlinkat(dirfd(handle), file->d_name, 0);
+        }
+    }
+    closedir(handle);
+    }
+
+/**
+ * Cache initialisation function.
+ * @brief Sets up an empty cache of 'budget' bytes. With 'diskDir', an existing directory, entries evicted from
+ * memory are kept there up to 'diskBudget' bytes.
+ * @return Returns 0, or -1 if the disk directory is not usable.
+ */
+int cache_init(struct cache *cache, size_t budget, const char *diskDir, size_t diskBudget) {
+    memset(cache, 0, sizeof(struct cache));
+    cache->budget = budget;
+    if (diskDir != NULL) {
+        DIR *dir = opendir(diskDir);
+        if (dir == NULL || strlen(diskDir) >= sizeof(cache->diskDir)) {
+            if (dir != NULL) {
+                closedir(dir);
+            }
+            return -1;
+        }
+        closedir(dir);
+        strcpy(cache->diskDir, diskDir);
+        cache->diskBudget = diskBudget;
+        clean_disk(diskDir);
+    }
+    //an eighth more leaves room for regions held by a few remaining bodies; without an arena the heap is used
+    arena_init(&cache->arena, budget + budget / CACHE_OBJECT_SHARE);
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->filled, NULL);
+    return 0;
+    }
+
+/** Frees all entries. Called once no request uses the cache anymore; the disk tier is left for inspection. */
+void cache_destroy(struct cache *cache) {
+    for (size_t i = 0; i < CACHE_BUCKETS; i++) {
+        while (cache->buckets[i] != NULL) {
+            struct cache_entry *entry = cache->buckets[i];
+            cache->buckets[i] = entry->next;
+            free_entry(entry);
+        }
+        while (cache->diskBuckets[i] != NULL) {
+            struct disk_record *record = cache->diskBuckets[i];
+            cache->diskBuckets[i] = record->next;
+            free(record);
+        }
+    }
+    if (cache->snapshot != NULL) {
+        munmap((void *)cache->snapshot, cache->snapshotSize);
+    }
+    arena_destroy(&cache->arena);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->filled);
+    }
+
+/** Writes zeros up to the next multiple of SNAPSHOT_ALIGNMENT, keeping '*offset' up to date. */
+static int write_padding(int fd, uint64_t *offset) {
+    static const char zeros[SNAPSHOT_ALIGNMENT];
+    size_t padding = (SNAPSHOT_ALIGNMENT - *offset % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT;
+    struct iovec iov = { (void *)zeros, padding };
+    if (padding > 0 && write_all(fd, &iov, 1) != 0) {
+        return -1;
+    }
+    *offset += padding;
+    return 0;
+    }
+
+/** Writes 'length' bytes, which may be none, keeping '*offset' up to date. */
+static int write_part(int fd, const void *data, size_t length, uint64_t *offset) {
+    struct iovec iov = { (void *)data, length };
+    if (length > 0 && write_all(fd, &iov, 1) != 0) {
+        return -1;
+    }
+    *offset += length;
+    return 0;
+    }
+
+static size_t snapshot_strings_length(const struct cache_entry *entry) {
+    return strlen(entry->key) + 1 + strlen(entry->varyNames) + 1 + strlen(entry->variant) + 1 + entry->headersLength +
+           (entry->contentType != NULL ? strlen(entry->contentType) + 1 : 0);
+    }
+
+/**
+ * Snapshot saving function.
+ * @brief Writes the fresh entries of the cache to a snapshot at 'path', most recently used first.
+ * @details The bodies follow the header, then come the strings, the records and the slot table, which the header
+ * points to once everything else is written. The snapshot is written under a temporary name and renamed, so a
+ * crash leaves the previous one in place. Called once no request uses the cache anymore.
+ * @return Returns 0, or -1 if the snapshot could not be written.
+ */
+int cache_save_snapshot(struct cache *cache, const char *path) {
+    char temporary[PATH_MAX];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("open() failed");
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    time_t now = time(NULL);
+    size_t count = 0;
+    size_t stringsLength = 0;
+    for (struct cache_entry *entry = cache->lruHead; entry != NULL; entry = entry->lruNext) {
+        if (entry->expires > now) {
+            count++;
+            stringsLength += snapshot_strings_length(entry);
+        }
+    }
+    uint32_t slotCount = 1;
+    while (slotCount <= count * 2) {
+        slotCount <<= 1;
+    }
+    struct snapshot_record *records = calloc(count > 0 ? count : 1, sizeof(struct snapshot_record));
+    char *strings = malloc(stringsLength > 0 ? stringsLength : 1);
+    uint32_t *slots = calloc(slotCount, sizeof(uint32_t));
+
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    uint64_t offset = 0;
+    bool failed = records == NULL || strings == NULL || slots == NULL ||
+                  write_part(fd, &header, sizeof(header), &offset) != 0;
+    size_t recordCount = 0;
+    size_t stringsUsed = 0;
+    for (struct cache_entry *entry = cache->lruHead; entry != NULL && !failed; entry = entry->lruNext) {
+        if (entry->expires <= now) {
+            continue;
+        }
+        struct snapshot_record *record = &records[recordCount];
+        failed = write_padding(fd, &offset) != 0;
+        record->bodyOffset = offset;
+        record->bodyLength = entry->bodyLength;
+        failed = failed || write_part(fd, entry->body, entry->bodyLength, &offset) != 0;
+
+        record->hash = entry->hash;
+        record->stringsOffset = stringsUsed;
+        record->keyLength = strlen(entry->key);
+        record->varyLength = strlen(entry->varyNames);
+        record->variantLength = strlen(entry->variant);
+        record->headersLength = entry->headersLength;
+        record->contentTypeLength = entry->contentType != NULL ? strlen(entry->contentType) : 0;
+        memcpy(strings + stringsUsed, entry->key, record->keyLength + 1);
+        stringsUsed += record->keyLength + 1;
+        memcpy(strings + stringsUsed, entry->varyNames, record->varyLength + 1);
+        stringsUsed += record->varyLength + 1;
+        memcpy(strings + stringsUsed, entry->variant, record->variantLength + 1);
+        stringsUsed += record->variantLength + 1;
+        memcpy(strings + stringsUsed, entry->headers, entry->headersLength);
+        stringsUsed += entry->headersLength;
+        if (entry->contentType != NULL) {
+            memcpy(strings + stringsUsed, entry->contentType, record->contentTypeLength + 1);
+            stringsUsed += record->contentTypeLength + 1;
+        }
+
+        record->status = entry->status;
+        memcpy(record->reason, entry->reason, sizeof(record->reason));
+        record->base = entry->base;
+        record->expires = entry->expires;
+        record->device = entry->device;
+        record->inode = entry->inode;
+        record->fileSize = entry->fileSize;
+        record->modifiedSeconds = entry->modified.tv_sec;
+        record->modifiedNanoseconds = entry->modified.tv_nsec;
+
+        uint32_t slot = entry->hash & (slotCount - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = ++recordCount;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    uint64_t stringsOffset = 0;
+    if (!failed) {
+        failed = write_padding(fd, &offset) != 0;
+        stringsOffset = offset;
+        failed = failed || write_part(fd, strings, stringsUsed, &offset) != 0 || write_padding(fd, &offset) != 0;
+    }
+    if (!failed) {
+        for (size_t i = 0; i < recordCount; i++) {
+            records[i].stringsOffset += stringsOffset;
+        }
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.recordsOffset = offset;
+        header.recordCount = recordCount;
+        failed = write_part(fd, records, recordCount * sizeof(struct snapshot_record), &offset) != 0;
+        header.slotsOffset = offset;
+        header.slotCount = slotCount;
+        failed = failed || write_part(fd, slots, slotCount * sizeof(uint32_t), &offset) != 0;
+        header.size = offset;
+    }
+    failed = failed || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || fsync(fd) != 0;
+    free(records);
+    free(strings);
+    free(slots);
+    if (failed || close(fd) != 0 || rename(temporary, path) != 0) {
+        perror("Saving a cache snapshot failed");
+        if (failed) {
+            close(fd);
+        }
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+    }
+
+static bool in_snapshot(size_t size, uint64_t offset, uint64_t length) {
+    return offset <= size && length <= size - offset;
+    }
+
+/**
+ * Snapshot validation function.
+ * @brief Checks that every record of a mapped snapshot only points into it, with its strings terminated where they
+ * are used as such, and that every probe sequence ends at an empty slot.
+ */
+static bool snapshot_valid(const struct cache *cache, const struct snapshot_header *header) {
+    if (header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0 ||
+        header->recordCount >= header->slotCount || header->slotsOffset % sizeof(uint32_t) != 0 ||
+        header->recordsOffset % SNAPSHOT_ALIGNMENT != 0 ||
+        !in_snapshot(cache->snapshotSize, header->slotsOffset, (uint64_t)header->slotCount * sizeof(uint32_t)) ||
+        !in_snapshot(cache->snapshotSize, header->recordsOffset,
+                     (uint64_t)header->recordCount * sizeof(struct snapshot_record))) {
+        return false;
+    }
+    //slots may repeat a value in a crafted file, so fewer records than slots do not ensure an empty one
+    bool empty = false;
+    for (uint32_t i = 0; i < header->slotCount; i++) {
+        if (cache->snapshotSlots[i] > header->recordCount) {
+            return false;
+        }
+        empty |= cache->snapshotSlots[i] == 0;
+    }
+    if (!empty) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->recordCount; i++) {
+        const struct snapshot_record *record = &cache->snapshotRecords[i];
+        uint64_t stringsLength = (uint64_t)record->keyLength + 1 + record->varyLength + 1 + record->variantLength + 1 +
+                                 record->headersLength + (record->contentTypeLength > 0 ? record->contentTypeLength + 1 : 0);
+        if (!in_snapshot(cache->snapshotSize, record->stringsOffset, stringsLength) ||
+            !in_snapshot(cache->snapshotSize, record->bodyOffset, record->bodyLength) ||
+            record->varyLength >= MAX_VARY_LENGTH || record->variantLength >= MAX_VARIANT_LENGTH ||
+            memchr(record->reason, '\0', sizeof(record->reason)) == NULL ||
+            (record->contentTypeLength > 0 && cache->snapshot[record->stringsOffset + stringsLength - 1] != '\0')) {
+            return false;
+        }
+    }
+    return true;
+    }
+
+/**
+ * Snapshot opening function.
+ * @brief Maps the snapshot a previous process saved at 'path', from which lookups then adopt entries.
+ * @details Called before the cache is used. The mapping stays until the cache is destroyed.
+ * @return Returns 0, also if there is no snapshot yet, or -1 after printing why it cannot be used.
+ */
+int cache_open_snapshot(struct cache *cache, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror("open() failed");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+        fprintf(stderr, "%s is not a cache snapshot\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap() failed");
+        return -1;
+    }
+
+    const struct snapshot_header *header = map;
+    cache->snapshot = map;
+    cache->snapshotSize = st.st_size;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->size != cache->snapshotSize) {
+        fprintf(stderr, "%s is not a cache snapshot\n", path);
+    }
+    else {
+        cache->snapshotSlots = (const uint32_t *)(cache->snapshot + header->slotsOffset);
+        cache->snapshotSlotCount = header->slotCount;
+        cache->snapshotRecords = (const struct snapshot_record *)(cache->snapshot + header->recordsOffset);
+        cache->snapshotRecordCount = header->recordCount;
+        if (snapshot_valid(cache, header)) {
+            return 0;
+        }
+        fprintf(stderr, "%s is a damaged cache snapshot\n", path);
+    }
+    munmap(map, st.st_size);
+    cache->snapshot = NULL;
+    cache->snapshotSize = 0;
+    cache->snapshotSlots = NULL;
+    cache->snapshotSlotCount = 0;
+    cache->snapshotRecords = NULL;
+    cache->snapshotRecordCount = 0;
+    return -1;
+    }
@@ -0,0 +1,141 @@
+/**
+*@file cache.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Response cache.
+*
+* Keeps complete responses in memory, up to a byte budget, and optionally spills entries pushed out of memory to a
+* directory on disk. Freshness follows the HTTP caching rules of the stored response.
+**/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+
+#define CACHE_BUCKETS 4096
+#define CACHE_MAX_KEY 1536
+#define CACHE_MAX_DIR 256
+#define CACHE_OBJECT_SHARE 8
+
+struct cache;
+struct snapshot_record;
+
+/**
+ * A stored response. 'headers' holds its end-to-end header lines, without Age. 'varyNames' is the Vary field of
+ * the response and 'variant' the values the request had for those fields, each followed by a newline. Entries
+ * are immutable once inserted and stay valid while referenced, even after they left the cache. Entries holding a
+ * file remember its inode, size and modification time, and never expire by time. They keep the 'contentType' of
+ * the file, which proxied entries have among their 'headers'. Entries adopted from a snapshot are 'mapped': their
+ * body and content type are in the mapping of the snapshot.
+ */
+struct cache_entry {
+    struct cache *cache;
+    struct cache_entry *next;
+    struct cache_entry *lruPrev;
+    struct cache_entry *lruNext;
+    uint64_t hash;
+    size_t size;
+    int refs;
+    bool linked;
+
+    char *key;
+    char *varyNames;
+    char *variant;
+    int status;
+    char reason[64];
+    char *headers;
+    size_t headersLength;
+    char *body;
+    size_t bodyLength;
+
+    time_t base;
+    time_t expires;
+
+    dev_t device;
+    ino_t inode;
+    off_t fileSize;
+    struct timespec modified;
+    const char *contentType;
+    bool mapped;
+};
+
+/** A response being fetched by one request while others for the same key wait for it. */
+struct cache_fill {
+    struct cache_fill *next;
+    uint64_t hash;
+    char *key;
+    int waiters;
+    bool done;
+    bool stored;
+};
+
+/** Where a response spilled to disk is, so that the disk tier can be kept within its budget. */
+struct disk_record {
+    struct disk_record *next;
+    struct disk_record *older;
+    struct disk_record *newer;
+    uint64_t hash;
+    size_t size;
+};
+
+struct cache {
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    struct cache_entry *buckets[CACHE_BUCKETS];
+    struct cache_entry *lruHead;
+    struct cache_entry *lruTail;
+    size_t used;
+    size_t budget;
+    struct cache_fill *fills;
+    struct arena arena;
+
+    char diskDir[CACHE_MAX_DIR];
+    struct disk_record *diskBuckets[CACHE_BUCKETS];
+    struct disk_record *diskOldest;
+    struct disk_record *diskNewest;
+    size_t diskUsed;
+    size_t diskBudget;
+
+    const char *snapshot;
+    size_t snapshotSize;
+    const uint32_t *snapshotSlots;
+    uint32_t snapshotSlotCount;
+    const struct snapshot_record *snapshotRecords;
+    uint32_t snapshotRecordCount;
+};
+
+int cache_init(struct cache *cache, size_t budget, const char *diskDir, size_t diskBudget);
+void cache_destroy(struct cache *cache);
+int cache_save_snapshot(struct cache *cache, const char *path);
+int cache_open_snapshot(struct cache *cache, const char *path);
+
+const char *cache_field(const char *lines, size_t length, const char *name, size_t *valueLength);
+bool cache_request_allowed(const char *method, const char *headers, size_t headersLength);
+
+struct cache_entry *cache_lookup(struct cache *cache, const char *key, const char *headers, size_t headersLength,
+                                 bool fill, bool *leader);
+void cache_fill_done(struct cache *cache, const char *key, bool stored);
+
+struct cache_entry *cache_prepare(struct cache *cache, const char *key, int status, const char *reason,
+                                  const char *headers, size_t headersLength, const char *requestHeaders,
+                                  size_t requestHeadersLength, off_t bodyLength);
+struct cache_entry *cache_prepare_file(struct cache *cache, const char *key, const struct stat *st,
+                                       const char *contentType);
+struct cache_entry *cache_load_file(struct cache *cache, const char *key, int fd, const struct stat *st,
+                                    const char *contentType);
+bool cache_entry_current(const struct cache_entry *entry, const struct stat *st);
+void cache_insert(struct cache_entry *entry);
+void cache_release(struct cache_entry *entry);
+long cache_entry_age(const struct cache_entry *entry);
+
+#endif
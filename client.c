@@ -1,4 +1,4 @@
-/**     
+/**
 *@file client.c
 *@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
 *@date 03.01.2022
@@ -6,6 +6,9 @@
 *@brief Client program
 *
 * This client program implements HTTP 1.1 and connects to a server to obtain a file using sockets.
+* With -2 it speaks HTTP/2 instead and fetches all given URLs as concurrent streams of one connection.
+* 'https://' URLs are fetched over TLS, resuming the sessions of servers contacted before. 'unix:' URLs name a
+* Unix domain socket of a server on the same host.
 **/
 
 #include <stdio.h>
@@ -16,176 +19,196 @@
 #include <dirent.h>
 #include <errno.h>
 #include <string.h>
+#include <getopt.h>
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <netdb.h>
 
+#include "client.h"
+
 static char *MYPROG;
+static uint64_t receiveRate;
 
 /**
  * Usage function.
  * @brief This function writes helpful usage information to stderr about how program should be called.
  */
 static void usage(char* message) {
-    fprintf(stderr,"Usage Error! \tProper input: %s [-p PORT] [ -o FILE | -d DIR ] URL\n%s\n", MYPROG, message);
+    fprintf(stderr,"Usage Error! \tProper input: %s [-p PORT] [-2] [-C CA_FILE] [-s SESSION_FILE] [-l RATE|--limit-rate RATE] [ -o FILE | -d DIR ] URL...\n\tURL: http[s]://HOST[:PORT][/PATH] or unix:/SOCKET[:/PATH]\n%s\n", MYPROG, message);
     exit(1);
     }
 
 /**
- * Dynamic resource management function.
- * @brief This function frees some certain resources when it determines to be necessary according to certain conditions.
- * @details Specifically written for purposes of main(). If D is true, both resources are freed. If O, only 'oO' is freed.
- * @param D A boolean.
- * @param O A boolean.
- * @param oD A dynamic char array.
- * @param oO A dynamic char array.
-*/
-static void freeResources(bool D, bool O, char* oD, char* oO) {
-    if (D) {
-        free(oD);
-        free(oO);
-    }
-    else if (O) {
-        free(oO);
-        }
+ * Rate parsing function.
+ * @brief Parses a rate in bytes per second, optionally followed by 'k', 'm' or 'g' for multiples of 1024.
+ * @return Returns the rate, or 0 if it is invalid.
+ */
+static uint64_t parse_rate(const char *text) {
+    char *end;
+    errno = 0;
+    unsigned long long rate = strtoull(text, &end, 10);
+    if (end == text || text[0] == '-' || errno != 0) {
+        return 0;
+    }
+    int shift = 0;
+    switch (*end) {
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+    }
+    if (shift > 0) {
+        end++;
+    }
+    if (*end != '\0' || rate > UINT64_MAX >> 30) {
+        return 0;
+    }
+    return (uint64_t)rate << shift;
     }
 
 /**
- * Program entry point.
- * @brief The program starts here, and takes an URL from the user, which it will access and obtain the data file located there to transmit it to the user.
- * @details The program generates a request message to transmit to the relevant server by examining the URL and then creates relevant socket connection to send 
- * the request. After receiving the relevant file from server's end, 'client' saves the obtained data to a file with given name, if -o option is used. If -d is used,
- * the data is saved to the given directory. If neither are used, data is written to 'stdout'. There is also -p option, which runs the program with given port
- * number.
- * @param argc The argument counter.
- * @param argv The argument vector.
- * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ * URL parsing function.
+ * @brief Splits an 'http://' or 'https://' URL into the host name, the port if one is given, and the requested path.
+ * @details The host ends at the first of ";/:@=&", a URL without a path requests "/". A 'unix:/SOCKET[:/PATH]'
+ * URL requests PATH from the server listening on the Unix domain socket SOCKET, as host 'localhost'.
+ * @return Returns 0, or -1 if the URL is invalid.
  */
-int main(int argc, char *argv[]) {
-
-    MYPROG = argv[0];
-    char port[7] = "80";
-
-    char* outputFileName;
-    char* outputDirectory;
-    char* url;
-
-    bool O_isUsed = false;
-    bool D_isUsed = false;
-
-    int opt;
-    while((opt = getopt(argc, argv, "p:o:d:")) != -1) 
-    { 
-        switch(opt) 
-        { 
-            case 'p':
-                if (optarg == NULL) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Missing argument to the option 'p'\n");
-                }
-
-                char* endPointer;
-                strtol(optarg, &endPointer, 10);
-                if (endPointer == optarg || strlen(optarg) > 6) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Invalid argument to the option 'p'\n");
-                }
-                strcpy(port, optarg);
-                break; 
-            case 'o': 
-                if (D_isUsed) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Options 'o' and 'd' can't be used together");
-                }
-                else if (optarg == NULL) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Missing argument to the option 'o'\n");
-                }
-                outputFileName = malloc(sizeof(optarg));
-                strcpy(outputFileName, optarg);
-                O_isUsed = true;
-                break;
-            case 'd': 
-                if (O_isUsed) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Options 'o' and 'd' can't be used together");
-                }
-                else if (optarg == NULL) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Missing argument to the option 'o'");
-                }
-
-                url = argv[argc - 1];
-                if (url == NULL) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Missing URL");
-                }
-
-                outputDirectory = malloc(sizeof(optarg));
-                strcpy(outputDirectory, optarg);
-
-                DIR* dir = opendir(outputDirectory);
-                if (ENOENT == errno) {
-                    freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                    usage("Invalid directory");
-                    }
-                closedir(dir);
-                
-                int index;
-                for (int i = 0; i < strlen(url); i++){
-                    if (url[i] == '/') {index = i;}
-                }
-                
-                if (index == strlen(url) - 1) {
-                    outputFileName = malloc(sizeof(char) * 11);
-                    strcpy(outputFileName, "index.html");
-                }
-                else {
-                    outputFileName = malloc(sizeof(char) * (strlen(url) - index + 2));
-                    strcpy(outputFileName, &url[index + 1]);
-                }
-                
-                D_isUsed = true;
-                break;     
-            case '?':
-                freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-                usage("Unknown Option!");
-                break; 
-            default:
-                assert(0);
-                break;
-        } 
+static int parse_url(const char *url, struct fetch *fetch) {
+    const char *authority;
+    fetch->socketPath[0] = '\0';
+    if (strncmp(url, "unix:/", 6) == 0) {
+        const char *socketPath = url + 5;
+        const char *target = strstr(socketPath, ":/");
+        size_t socketPathLength = target != NULL ? (size_t)(target - socketPath) : strlen(socketPath);
+        if (socketPathLength >= sizeof(fetch->socketPath) || (target != NULL && strlen(target + 1) >= sizeof(fetch->path))) {
+            return -1;
+        }
+        memcpy(fetch->socketPath, socketPath, socketPathLength);
+        fetch->socketPath[socketPathLength] = '\0';
+        strcpy(fetch->path, target != NULL ? target + 1 : "/");
+        strcpy(fetch->host, "localhost");
+        fetch->port[0] = '\0';
+        fetch->tls = false;
+        fetch->url = url;
+        return 0;
     }
-  
-
-    url = argv[optind];
-    if (url == NULL || strlen(url) < 8) {
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        usage("Invalid URL");
+    if (strncmp(url, "http://", 7) == 0) {
+        fetch->tls = false;
+        authority = url + 7;
     }
-
-    if (argc > 6 || argc < 2) {
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        usage("Too many or lacking input arguments");
+    else if (strncmp(url, "https://", 8) == 0) {
+        fetch->tls = true;
+        authority = url + 8;
+    }
+    else {
+        return -1;
     }
-
 
     char* checkList = ";/:@=&";
-    char* tempCheck = strpbrk(&url[7], checkList);
+    size_t hostLength = strcspn(authority, checkList);
+    if (hostLength == 0 || hostLength >= sizeof(fetch->host)) {
+        return -1;
+    }
+    strncpy(fetch->host, authority, hostLength);
+    fetch->host[hostLength] = '\0';
+
+    fetch->port[0] = '\0';
+    if (authority[hostLength] == ':') {
+        const char *port = authority + hostLength + 1;
+        size_t portLength = strspn(port, "0123456789");
+        if (portLength == 0 || portLength >= sizeof(fetch->port) || (port[portLength] != '/' && port[portLength] != '\0')) {
+            return -1;
+        }
+        memcpy(fetch->port, port, portLength);
+        fetch->port[portLength] = '\0';
+    }
 
-    int hostLength = strlen(url) - strlen(tempCheck) - 7;
-    char hostName[hostLength + 1];
-    strncpy(hostName, &url[7], hostLength);
-    hostName[hostLength] = '\0';
+    char* requestedFileName = strchr(authority, '/');
+    if (requestedFileName == NULL) {
+        requestedFileName = "/";
+    }
+    if (strlen(requestedFileName) >= sizeof(fetch->path)) {
+        return -1;
+    }
+    strcpy(fetch->path, requestedFileName);
+    fetch->url = url;
+    return 0;
+    }
 
+/**
+ * Output naming function.
+ * @brief Determines the file a body is saved to when -d is used: the last path segment, or 'index.html' for a
+ * URL ending in '/'.
+ * @return Returns a newly allocated path, or NULL.
+ */
+static char *output_path(const char *outputDirectory, const char *url) {
+    const char *outputFileName = strrchr(url, '/') + 1;
+    if (*outputFileName == '\0') {
+        outputFileName = "index.html";
+    }
 
+    char *pathFile = malloc(strlen(outputDirectory) + strlen(outputFileName) + 3);
+    if (pathFile == NULL) {
+        return NULL;
+    }
+    if (outputDirectory[strlen(outputDirectory) - 1] == '/') {
+        sprintf(pathFile, "%s%s", outputDirectory, outputFileName);
+    }
+    else {
+        sprintf(pathFile, "%s/%s", outputDirectory, outputFileName);
+    }
+    return pathFile;
+    }
 
-    char* requestedFileName = strchr(&url[7], '/');
-    char requestMessage[39 + strlen(requestedFileName) + strlen(hostName)];
-    sprintf(requestMessage, "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", requestedFileName, hostName);
+/**
+ * Output opening function.
+ * @brief Opens the destination of a body once its response turned out to be successful.
+ * @return Returns 0, or -1 if the file could not be opened.
+ */
+int open_output(struct fetch *fetch) {
+    if (fetch->outputPath == NULL) {
+        fetch->out = stdout;
+        return 0;
+    }
+    fetch->out = fopen(fetch->outputPath, "w");
+    if (fetch->out == NULL) {
+        perror("fopen() failed");
+        return -1;
+    }
+    return 0;
+    }
 
+int finish_output(struct fetch *fetch) {
+    if (fetch->out == NULL) {
+        return 0;
+    }
+    int res;
+    if (fetch->out == stdout) {
+        res = fprintf(stdout, "\n") < 0 ? -1 : 0;
+    }
+    else {
+        res = fclose(fetch->out);
+    }
+    fetch->out = NULL;
+    return res;
+    }
 
+/**
+ * Connection function.
+ * @brief Resolves the host and connects to the first address that accepts.
+ * @return Returns the connected socket, or -1.
+ */
+static int connect_to(const char *hostName, const char *port) {
     //socket struct setup
     struct addrinfo hints, *ai, *results;
     memset(&hints, 0, sizeof(hints));
@@ -196,9 +219,7 @@ int main(int argc, char *argv[]) {
     int res = getaddrinfo(hostName, port, &hints, &results);
     if (res != 0) {
         fprintf(stderr, "getaddrinfo() failed");
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        freeaddrinfo(results);
-        exit(EXIT_FAILURE);
+        return -1;
     }
     fprintf(stdout, "Connecting to the host...\n\n");
     int sockfd;
@@ -207,7 +228,7 @@ int main(int argc, char *argv[]) {
         if (sockfd == -1) {
             continue;
         }
-        
+
         if (connect(sockfd, ai->ai_addr, ai->ai_addrlen) != -1) {
             break;
         }
@@ -216,33 +237,97 @@ int main(int argc, char *argv[]) {
     freeaddrinfo(results);
 
     if (ai == NULL) {
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
         perror("socket() or connect() failed");
-        exit(EXIT_FAILURE);
+        return -1;
     }
-    
-    if (send(sockfd, requestMessage, strlen(requestMessage), 0) < 0) {
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        perror("send() failed");
-        exit(EXIT_FAILURE);
+    return sockfd;
     }
-    
-    char buffer[1512] = {0};
-    if (recv(sockfd, buffer, sizeof(buffer), MSG_WAITALL) < 0) {
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        perror("recv() failed");
-        exit(EXIT_FAILURE);
+
+/**
+ * Unix domain connecting function.
+ * @brief Connects to the server listening on the Unix domain socket at 'path'.
+ * @return Returns the connected socket, or -1.
+ */
+static int connect_unix(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    fprintf(stdout, "Connecting to the host...\n\n");
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0 || connect(sockfd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("socket() or connect() failed");
+        if (sockfd >= 0) {
+            close(sockfd);
+        }
+        return -1;
+    }
+    return sockfd;
+    }
+
+/**
+ * Connection opening function.
+ * @brief Connects to the host of 'fetch' and completes the TLS handshake for 'https://' URLs.
+ * @return Returns 0, or -1 if no connection could be established.
+ */
+static int open_connection(struct connection *conn, SSL_CTX *tls, const struct fetch *fetch) {
+    int sockfd = fetch->socketPath[0] != '\0' ? connect_unix(fetch->socketPath) : connect_to(fetch->host, fetch->port);
+    if (sockfd < 0) {
+        return -1;
+    }
+    conn_init(conn, sockfd);
+    if (fetch->tls && tls_connect(conn, tls, fetch->host, fetch->port) != 0) {
+        conn_close(conn);
+        return -1;
+    }
+    if (receiveRate > 0) {
+        conn_set_receive_rate(conn, receiveRate);
+    }
+    return 0;
+    }
+
+/**
+ * HTTP/1.1 fetch function.
+ * @brief Requests one URL over its own connection and streams the body to the output as it arrives.
+ * @return Returns 0, 1 on a connection failure, 2 on a protocol error or 3 if the server did not answer with 200.
+ */
+static int fetch_http1(SSL_CTX *tls, struct fetch *fetch) {
+    struct connection conn;
+    if (open_connection(&conn, tls, fetch) != 0) {
+        return 1;
     }
-    close(sockfd);
 
-    char buff1[1512];
-    strcpy(buff1, buffer);
+    char requestMessage[39 + strlen(fetch->path) + strlen(fetch->host)];
+    sprintf(requestMessage, "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", fetch->path, fetch->host);
 
-    char buff2[1512];
-    strcpy(buff2, buffer);
+    if (conn_send_all(&conn, requestMessage, strlen(requestMessage), 0) != 0) {
+        perror("send() failed");
+        conn_close(&conn);
+        return 1;
+    }
 
-    char buff3[1512];
-    strcpy(buff3, buffer);
+    //the status line and headers are read first, whatever follows them belongs to the body
+    char buffer[8192];
+    size_t received = 0;
+    char *headerEnd = NULL;
+    while (headerEnd == NULL && received < sizeof(buffer) - 1) {
+        ssize_t n = conn_recv(&conn, buffer + received, sizeof(buffer) - 1 - received);
+        if (n < 0) {
+            perror("recv() failed");
+            conn_close(&conn);
+            return 1;
+        }
+        if (n == 0) {
+            break;
+        }
+        received += n;
+        buffer[received] = '\0';
+        headerEnd = strstr(buffer, "\r\n\r\n");
+    }
+
+    char buff1[sizeof(buffer)];
+    memcpy(buff1, buffer, received + 1);
 
     char* token;
     token = strtok(buff1, " ");
@@ -251,51 +336,250 @@ int main(int argc, char *argv[]) {
     token = strtok(NULL, " ");
     char* secondWord = token;
 
-    char* endPointer2;
-    int responseStatus = strtol(secondWord, &endPointer2, 10);
+    char* endPointer2 = secondWord;
+    int responseStatus = secondWord != NULL ? strtol(secondWord, &endPointer2, 10) : 0;
 
-    if (strcmp(endPointer2, secondWord) == 0 || strcmp(firstWord, "HTTP/1.1") != 0) {
+    if (headerEnd == NULL || firstWord == NULL || endPointer2 == secondWord || strcmp(firstWord, "HTTP/1.1") != 0) {
         fprintf(stderr, "Protocol error!");
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        exit(2);
+        conn_close(&conn);
+        return 2;
     }
     if (responseStatus != 200) {
-        token = strtok(buff2, "\n");
-        char* status = strchr(&token[1], ' ');
-        fprintf(stderr, status);
-        freeResources(D_isUsed, O_isUsed, outputDirectory, outputFileName);
-        exit(3);
+        char* line = strtok(buffer, "\n");
+        char* status = strchr(&line[1], ' ');
+        fprintf(stderr, "%s", status);
+        conn_close(&conn);
+        return 3;
     }
-    char *tempPtr = strstr(buffer, "\r\n\r\n");
 
-    if (D_isUsed) {
-        char pathFile[strlen(outputDirectory) + strlen(outputFileName) + 3];
+    if (open_output(fetch) != 0) {
+        conn_close(&conn);
+        return 1;
+    }
 
-        if (outputDirectory[strlen(outputDirectory) - 1] == '/') {
-            sprintf(pathFile, "%s%s", outputDirectory, outputFileName);
+    char *body = headerEnd + 4;
+    size_t length = received - (body - buffer);
+    int res = 0;
+    for (;;) {
+        if (length > 0 && fwrite(body, 1, length, fetch->out) != length) {
+            perror("fwrite() failed");
+            res = 1;
+            break;
+        }
+        ssize_t n = conn_recv(&conn, buffer, sizeof(buffer));
+        if (n < 0) {
+            perror("recv() failed");
+            res = 1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        body = buffer;
+        length = n;
+    }
+    conn_close(&conn);
+
+    if (finish_output(fetch) != 0 && res == 0) {
+        perror("fclose() failed");
+        res = 1;
+    }
+    return res;
+    }
+
+/**
+ * Program entry point.
+ * @brief The program starts here, and takes URLs from the user, which it will access and obtain the data files located
+ * there to transmit them to the user.
+ * @details The program generates a request message to transmit to the relevant server by examining each URL and then
+ * creates relevant socket connection to send the request. After receiving the relevant file from server's end, 'client'
+ * saves the obtained data to a file with given name, if -o option is used. If -d is used, the data is saved to the
+ * given directory. If neither are used, data is written to 'stdout'. There is also -p option, which runs the program
+ * with given port number unless a URL names its own. With -2 all URLs, which must name the same host, are fetched as
+ * concurrent HTTP/2 streams of a single connection. 'https://' servers are verified against the trust store, or the
+ * certificates in the file given with -C. With -s, TLS sessions are loaded from and saved to the given file, so that
+ * later runs resume them instead of doing full handshakes. With -l or --limit-rate, every connection receives at most
+ * RATE bytes per second, for downloads that should leave the network to others.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char *argv[]) {
+
+    MYPROG = argv[0];
+    char* port = NULL;
+    char* caFile = NULL;
+    char* sessionFile = NULL;
+
+    char* outputFileName = NULL;
+    char* outputDirectory = NULL;
+    bool useHttp2 = false;
+
+    static const struct option longOptions[] = {
+        { "limit-rate", required_argument, NULL, 'l' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+    while((opt = getopt_long(argc, argv, "p:o:d:2C:s:l:", longOptions, NULL)) != -1)
+    {
+        switch(opt)
+        {
+            case 'p':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'p'\n");
+                }
+
+                char* endPointer;
+                strtol(optarg, &endPointer, 10);
+                if (endPointer == optarg || strlen(optarg) >= MAX_PORT_LENGTH) {
+                    usage("Invalid argument to the option 'p'\n");
+                }
+                port = optarg;
+                break;
+            case 'o':
+                if (outputDirectory != NULL) {
+                    usage("Options 'o' and 'd' can't be used together");
+                }
+                else if (optarg == NULL) {
+                    usage("Missing argument to the option 'o'\n");
+                }
+                outputFileName = optarg;
+                break;
+            case 'd':
+                if (outputFileName != NULL) {
+                    usage("Options 'o' and 'd' can't be used together");
+                }
+                else if (optarg == NULL) {
+                    usage("Missing argument to the option 'o'");
+                }
+
+                DIR* dir = opendir(optarg);
+                if (dir == NULL) {
+                    usage("Invalid directory");
+                    }
+                closedir(dir);
+                outputDirectory = optarg;
+                break;
+            case '2':
+                useHttp2 = true;
+                break;
+            case 'C':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'C'\n");
+                }
+                caFile = optarg;
+                break;
+            case 's':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 's'\n");
+                }
+                sessionFile = optarg;
+                break;
+            case 'l':
+                receiveRate = parse_rate(optarg);
+                if (receiveRate == 0) {
+                    usage("Invalid argument to the option 'l'\n");
+                }
+                break;
+            case '?':
+                usage("Unknown Option!");
+                break;
+            default:
+                assert(0);
+                break;
+        }
+    }
+
+    size_t count = argc - optind;
+    if (count < 1) {
+        usage("Invalid URL");
+    }
+    if (count > 1 && outputDirectory == NULL) {
+        usage("Several URLs can only be saved with -d");
+    }
+
+    struct fetch* fetches = calloc(count, sizeof(struct fetch));
+    if (fetches == NULL) {
+        perror("calloc() failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (parse_url(argv[optind + i], &fetches[i]) != 0) {
+            usage("Invalid URL");
+        }
+        if (fetches[i].port[0] == '\0') {
+            strcpy(fetches[i].port, port != NULL ? port : fetches[i].tls ? "443" : "80");
+        }
+        if (useHttp2 && (strcmp(fetches[i].host, fetches[0].host) != 0 || strcmp(fetches[i].port, fetches[0].port) != 0 ||
+                         fetches[i].tls != fetches[0].tls || strcmp(fetches[i].socketPath, fetches[0].socketPath) != 0)) {
+            usage("All URLs have to name the same host with -2");
+        }
+        if (outputDirectory != NULL) {
+            fetches[i].outputPath = output_path(outputDirectory, fetches[i].url);
         }
         else {
-            sprintf(pathFile, "%s/%s", outputDirectory, outputFileName);
+            fetches[i].outputPath = outputFileName;
         }
+    }
 
-        FILE *outputFile = fopen(pathFile, "w");
-        fputs(&tempPtr[4], outputFile);
-        fclose(outputFile);
+    SSL_CTX *tls = NULL;
+    for (size_t i = 0; i < count && tls == NULL; i++) {
+        if (fetches[i].tls) {
+            tls = tls_client_context(caFile, useHttp2);
+            if (tls == NULL) {
+                exit(EXIT_FAILURE);
+            }
+            if (sessionFile != NULL) {
+                tls_load_sessions(sessionFile);
+            }
+        }
+    }
 
-        free(outputDirectory);
-        free(outputFileName);
+    int status = 0;
+    if (useHttp2) {
+        struct connection conn;
+        if (open_connection(&conn, tls, &fetches[0]) != 0) {
+            status = 1;
+        }
+        else if (conn.ssl != NULL && !tls_alpn_is_h2(&conn)) {
+            fprintf(stderr, "The server does not speak HTTP/2\n");
+            conn_close(&conn);
+            status = 2;
+        }
+        else {
+            status = h2_fetch_all(&conn, fetches, count);
+            conn_close(&conn);
+        }
     }
     else {
-        if (O_isUsed) {
-            FILE *outputFile = fopen(outputFileName, "w");
-            fputs(&tempPtr[4], outputFile);
-            fclose(outputFile);
-            
-            free(outputFileName);
+        for (size_t i = 0; i < count; i++) {
+            int res = fetch_http1(tls, &fetches[i]);
+            if (status == 0) {
+                status = res;
+            }
         }
-        else {
-            fprintf(stdout, "%s\n", &tempPtr[4]);
+    }
+
+    if (outputDirectory != NULL) {
+        for (size_t i = 0; i < count; i++) {
+            free(fetches[i].outputPath);
         }
     }
+    free(fetches);
+
+    if (tls != NULL) {
+        if (sessionFile != NULL && tls_save_sessions(sessionFile) != 0 && status == 0) {
+            status = 1;
+        }
+        tls_free_sessions();
+        SSL_CTX_free(tls);
+    }
+
+    if (status == 1) {
+        exit(EXIT_FAILURE);
+    }
+    if (status != 0) {
+        exit(status);
+    }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,54 @@
+/**
+*@file client.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Shared declarations of the client modules.
+**/
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "conn.h"
+
+#define MAX_HOST_LENGTH 256
+#define MAX_TARGET_LENGTH 1024
+#define MAX_PORT_LENGTH 7
+#define MAX_SOCKET_PATH_LENGTH 108
+
+/** One URL to be fetched, together with where its body goes. 'socketPath' is empty unless it names a Unix socket. */
+struct fetch {
+    const char *url;
+    bool tls;
+    char host[MAX_HOST_LENGTH];
+    char port[MAX_PORT_LENGTH];
+    char socketPath[MAX_SOCKET_PATH_LENGTH];
+    char path[MAX_TARGET_LENGTH];
+    char *outputPath;
+    FILE *out;
+
+    int status;
+    uint32_t streamId;
+    int64_t window;
+    uint32_t unacknowledged;
+    bool started;
+    bool done;
+    bool failed;
+};
+
+int open_output(struct fetch *fetch);
+int finish_output(struct fetch *fetch);
+
+SSL_CTX *tls_client_context(const char *caFile, bool http2);
+int tls_connect(struct connection *conn, SSL_CTX *ctx, const char *host, const char *port);
+void tls_load_sessions(const char *path);
+int tls_save_sessions(const char *path);
+void tls_free_sessions(void);
+
+int h2_fetch_all(struct connection *conn, struct fetch *fetches, size_t count);
+
+#endif
@@ -0,0 +1,789 @@
+/**
+*@file conn.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Connection I/O.
+*
+* Wraps a socket that is either plain or protected with TLS. The handshake is done by OpenSSL; when the kernel
+* supports it, record encryption is then offloaded to kernel TLS, so sendfile() keeps moving file bodies to the
+* socket without copying them through userspace.
+*
+* Returning clients resume their session with an abbreviated handshake, either from the server-side session cache,
+* which all workers share through the context, or from a session ticket. Ticket keys are rotated periodically.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include <sys/time.h>
+
+#include <openssl/core_names.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include "conn.h"
+
+#define HANDSHAKE_TIMEOUT 10
+#define TLS_CHUNK_SIZE 16384
+#define SESSION_CACHE_SIZE 20480
+#define TICKET_KEY_LIFETIME 3600
+
+/** A session ticket key, tickets carry its name so that the key that sealed them can be found again. */
+struct ticket_key {
+    unsigned char name[16];
+    unsigned char aesKey[32];
+    unsigned char hmacKey[32];
+};
+
+/**
+ * The ticket keys of the server. New tickets are sealed with 'current'; tickets sealed with 'previous' are still
+ * accepted for one more lifetime and renewed, so a rotation does not force full handshakes on recent clients.
+ */
+static struct {
+    pthread_mutex_t lock;
+    struct ticket_key current;
+    struct ticket_key previous;
+    bool hasCurrent;
+    bool hasPrevious;
+    time_t created;
+} ticketKeys = { PTHREAD_MUTEX_INITIALIZER };
+
+void conn_init(struct connection *conn, int fd) {
+    conn->fd = fd;
+    conn->ssl = NULL;
+    conn->ktlsSend = false;
+    conn->corked = 0;
+    conn->spinBudget = 0;
+    conn->zerocopy = 0;
+    conn->zerocopySent = 0;
+    conn->zerocopyDone = 0;
+    conn->paceRate = 0;
+    conn->pacedBytes = 0;
+    }
+
+/**
+ * Connection closing function.
+ * @brief Sends a TLS close_notify if the connection is protected, then closes the socket.
+ */
+void conn_close(struct connection *conn) {
+    if (conn->ssl != NULL) {
+        SSL_shutdown(conn->ssl);
+        SSL_free(conn->ssl);
+        conn->ssl = NULL;
+    }
+    close(conn->fd);
+    conn->fd = -1;
+    }
+
+/**
+ * ALPN function.
+ * @brief Picks h2 when the client offers it, http/1.1 otherwise.
+ */
+static int select_alpn(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in,
+                       unsigned int inlen, void *arg) {
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    (void)ssl;
+    (void)arg;
+
+    if (SSL_select_next_proto((unsigned char **)out, outlen, protocols, sizeof(protocols) - 1, in, inlen) !=
+        OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    return SSL_TLSEXT_ERR_OK;
+    }
+
+static time_t monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+    }
+
+static int new_ticket_key(struct ticket_key *key) {
+    return RAND_bytes((unsigned char *)key, sizeof(*key)) == 1 ? 0 : -1;
+    }
+
+/**
+ * Ticket key lookup function.
+ * @brief Copies the key to seal a new ticket with, or the key named by a received ticket, rotating the keys first
+ * if the current one has expired.
+ * @return Returns 1 for the current key, 2 for the previous one and 0 if no key is available.
+ */
+static int find_ticket_key(const unsigned char *name, struct ticket_key *key) {
+    int res = 0;
+    pthread_mutex_lock(&ticketKeys.lock);
+
+    time_t now = monotonic_seconds();
+    if (!ticketKeys.hasCurrent || now - ticketKeys.created >= TICKET_KEY_LIFETIME) {
+        struct ticket_key fresh;
+        if (new_ticket_key(&fresh) == 0) {
+            ticketKeys.previous = ticketKeys.current;
+            ticketKeys.hasPrevious = ticketKeys.hasCurrent;
+            ticketKeys.current = fresh;
+            ticketKeys.hasCurrent = true;
+            ticketKeys.created = now;
+        }
+    }
+
+    if (ticketKeys.hasCurrent && (name == NULL || memcmp(name, ticketKeys.current.name, 16) == 0)) {
+        *key = ticketKeys.current;
+        res = 1;
+    }
+    else if (ticketKeys.hasPrevious && memcmp(name, ticketKeys.previous.name, 16) == 0) {
+        *key = ticketKeys.previous;
+        res = 2;
+    }
+    pthread_mutex_unlock(&ticketKeys.lock);
+    return res;
+    }
+
+/**
+ * Ticket sealing function.
+ * @brief Sets up the cipher and the MAC with which OpenSSL seals ('enc' set) or opens a session ticket.
+ * @details TLS 1.3 clients use a ticket only once, so every resumption with TLS 1.3 is answered with a new ticket.
+ * @return Returns 1 to use the ticket, 2 to use it but issue a new one under the current key, 0 to reject it
+ * (a full handshake follows) or -1 on failure.
+ */
+static int seal_ticket(SSL *ssl, unsigned char *keyName, unsigned char *iv, EVP_CIPHER_CTX *cipher,
+                       EVP_MAC_CTX *mac, int enc) {
+    struct ticket_key key;
+
+    int res = find_ticket_key(enc ? NULL : keyName, &key);
+    if (res == 0) {
+        return enc ? -1 : 0;
+    }
+    if (!enc && SSL_version(ssl) == TLS1_3_VERSION) {
+        res = 2;
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey, sizeof(key.hmacKey)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_end()
+    };
+    if (enc) {
+        memcpy(keyName, key.name, sizeof(key.name));
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1 ||
+            EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1) {
+            res = -1;
+        }
+    }
+    else if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1) {
+        res = -1;
+    }
+    if (res > 0 && EVP_MAC_CTX_set_params(mac, params) != 1) {
+        res = -1;
+    }
+    OPENSSL_cleanse(&key, sizeof(key));
+    return res;
+    }
+
+/**
+ * Server context function.
+ * @brief Creates the TLS context of the server from a PEM certificate chain and private key.
+ * @details Kernel TLS is requested for every connection, OpenSSL falls back to userspace records when the kernel
+ * or the negotiated cipher does not support it. Sessions are cached for clients resuming by session ID and
+ * handed out as tickets sealed with rotating keys, both expiring with the ticket key lifetime.
+ * @return Returns the context, or NULL after printing the OpenSSL errors.
+ */
+SSL_CTX *tls_server_context(const char *certFile, const char *keyFile) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == NULL) {
+        ERR_print_errors_fp(stderr);
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, certFile) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, NULL);
+
+    static const unsigned char sessionContext[] = "server";
+    SSL_CTX_set_session_id_context(ctx, sessionContext, sizeof(sessionContext) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, TICKET_KEY_LIFETIME);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, seal_ticket);
+    return ctx;
+    }
+
+/**
+ * Handshake function.
+ * @brief Performs the server side of the TLS handshake on an accepted connection.
+ * @details A client that stalls the handshake gives up its worker after HANDSHAKE_TIMEOUT seconds.
+ * @return Returns 0, or -1 if the handshake failed.
+ */
+int tls_accept(struct connection *conn, SSL_CTX *ctx) {
+    struct timeval timeout = { HANDSHAKE_TIMEOUT, 0 };
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    conn->ssl = SSL_new(ctx);
+    if (conn->ssl == NULL || SSL_set_fd(conn->ssl, conn->fd) != 1 || SSL_accept(conn->ssl) != 1) {
+        ERR_clear_error();
+        SSL_free(conn->ssl);
+        conn->ssl = NULL;
+        return -1;
+    }
+
+    timeout.tv_sec = 0;
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    conn->ktlsSend = BIO_get_ktls_send(SSL_get_wbio(conn->ssl));
+    return 0;
+    }
+
+bool tls_alpn_is_h2(const struct connection *conn) {
+    const unsigned char *protocol;
+    unsigned int length;
+
+    if (conn->ssl == NULL) {
+        return false;
+    }
+    SSL_get0_alpn_selected(conn->ssl, &protocol, &length);
+    return length == 2 && memcmp(protocol, "h2", 2) == 0;
+    }
+
+bool tls_session_reused(const struct connection *conn) {
+    return conn->ssl != NULL && SSL_session_reused(conn->ssl);
+    }
+
+/**
+ * Busy polling function.
+ * @brief Polls without sleeping until one of 'fds' is ready or 'budget' nanoseconds have passed.
+ * @return Returns the number of ready descriptors like poll(), 0 once the budget is spent, or -1 on failure.
+ */
+int conn_busy_poll(struct pollfd *fds, nfds_t count, long budget) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        int ready = poll(fds, count, 0);
+        if (ready != 0 && !(ready < 0 && errno == EINTR)) {
+            return ready;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) >= budget) {
+            return 0;
+        }
+    }
+    }
+
+static ssize_t recv_some(struct connection *conn, void *buf, size_t len) {
+    if (conn->spinBudget > 0 && !conn_pending(conn)) {
+        struct pollfd pfd = { conn->fd, POLLIN, 0 };
+        conn_busy_poll(&pfd, 1, conn->spinBudget);
+    }
+    if (conn->ssl == NULL) {
+        ssize_t n;
+        do {
+            n = recv(conn->fd, buf, len, 0);
+        } while (n < 0 && errno == EINTR);
+        return n;
+    }
+
+    int n = SSL_read(conn->ssl, buf, len > INT32_MAX ? INT32_MAX : (int)len);
+    if (n > 0) {
+        return n;
+    }
+    int error = SSL_get_error(conn->ssl, n);
+    ERR_clear_error();
+    if (error == SSL_ERROR_ZERO_RETURN || (error == SSL_ERROR_SYSCALL && errno == 0)) {
+        return 0;
+    }
+    return -1;
+    }
+
+/**
+ * Pending data function.
+ * @brief Tells whether TLS has already decrypted data that poll() on the socket would not report.
+ */
+bool conn_pending(const struct connection *conn) {
+    return conn->ssl != NULL && SSL_pending(conn->ssl) > 0;
+    }
+
+static int send_plain(int fd, const void *buf, size_t len, int flags) {
+    const char *pos = buf;
+    while (len > 0) {
+        ssize_t sent = send(fd, pos, len, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        pos += sent;
+        len -= sent;
+    }
+    return 0;
+    }
+
+static int ssl_write_all(SSL *ssl, const void *buf, size_t len) {
+    const char *pos = buf;
+    while (len > 0) {
+        int chunk = len > INT32_MAX ? INT32_MAX : (int)len;
+        int written = SSL_write(ssl, pos, chunk);
+        if (written <= 0) {
+            ERR_clear_error();
+            return -1;
+        }
+        pos += written;
+        len -= written;
+    }
+    return 0;
+    }
+
+/**
+ * Pacing function.
+ * @brief Limits the rate the connection sends at to 'bytesPerSecond' from now on.
+ * @details The kernel paces with SO_MAX_PACING_RATE, spreading the packets of the socket out in time, with the fq
+ * queueing discipline or TCP's own pacing, at no cost per byte. For other sockets, like Unix domain sockets, and where
+ * the kernel refuses, conn_send_all(), conn_sendfile() and conn_send_zerocopy() pace in userspace instead, sending
+ * PACE_INTERVAL_MS worth of data at a time.
+ * @return Returns true if the kernel paces.
+ */
+bool conn_set_pacing(struct connection *conn, uint64_t bytesPerSecond) {
+    unsigned int rate = bytesPerSecond < UINT32_MAX ? (unsigned int)bytesPerSecond : UINT32_MAX - 1;
+    int domain;
+    socklen_t length = sizeof(domain);
+    //every socket takes the option, but only TCP and fq act on it
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) == 0 &&
+        (domain == AF_INET || domain == AF_INET6) &&
+        setsockopt(conn->fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0) {
+        return true;
+    }
+    conn->paceRate = rate;
+    conn->pacedBytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &conn->paceStart);
+    return false;
+    }
+
+/**
+ * Receive rate function.
+ * @brief Limits the rate the connection receives at to 'bytesPerSecond' from now on.
+ * @details conn_recv() paces the reads, and the receive buffer is shrunk to about PACE_RECEIVE_BUFFER_MS worth,
+ * so that the TCP window holds the peer back instead of letting it fill a large buffer at full speed. What the
+ * connection sends counts against the same rate.
+ */
+void conn_set_receive_rate(struct connection *conn, uint64_t bytesPerSecond) {
+    uint64_t buffer = bytesPerSecond * PACE_RECEIVE_BUFFER_MS / 1000;
+    int size = buffer < PACE_MIN_CHUNK ? PACE_MIN_CHUNK : buffer > INT32_MAX / 2 ? INT32_MAX / 2 : (int)buffer;
+    //the kernel doubles the size for its bookkeeping
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    conn->paceRate = bytesPerSecond;
+    conn->pacedBytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &conn->paceStart);
+    }
+
+/**
+ * Userspace pacing function.
+ * @brief Waits until the connection may send or receive on at its pacing rate.
+ * @details Time the connection was idle earns at most PACE_INTERVAL_MS worth of credit, so the bucket is one
+ * chunk deep and a pause is never made up for with a burst.
+ * @return Returns how many of the next 'length' bytes to pass now.
+ */
+static size_t pace(struct connection *conn, size_t length) {
+    uint64_t chunk = conn->paceRate * PACE_INTERVAL_MS / 1000;
+    if (chunk < PACE_MIN_CHUNK) {
+        chunk = PACE_MIN_CHUNK;
+    }
+    if (length > chunk) {
+        length = chunk;
+    }
+    //the bytes paced so far are due at this many nanoseconds after the start
+    uint64_t due = conn->pacedBytes / conn->paceRate * 1000000000 +
+                   conn->pacedBytes % conn->paceRate * 1000000000 / conn->paceRate;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t elapsed = (uint64_t)(now.tv_sec - conn->paceStart.tv_sec) * 1000000000 + now.tv_nsec -
+                       conn->paceStart.tv_nsec;
+    uint64_t credit = (uint64_t)PACE_INTERVAL_MS * 1000000;
+    if (elapsed > due + credit) {
+        //moving the start forward forgets the idle time beyond the credit
+        uint64_t nsec = conn->paceStart.tv_nsec + (elapsed - due - credit) % 1000000000;
+        conn->paceStart.tv_sec += (elapsed - due - credit) / 1000000000 + nsec / 1000000000;
+        conn->paceStart.tv_nsec = nsec % 1000000000;
+    }
+    if (due > elapsed) {
+        struct timespec pause = { (due - elapsed) / 1000000000, (due - elapsed) % 1000000000 };
+        while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+        }
+    }
+    conn->pacedBytes += length;
+    return length;
+    }
+
+/**
+ * Receive function.
+ * @brief Reads up to 'len' bytes like recv(). With a spin budget the socket is busy polled first.
+ * @details A connection with a receive rate reads no more than PACE_INTERVAL_MS worth at a time, waiting for its
+ * turn first, and only what arrived counts against the rate.
+ * @return Returns the number of bytes read, 0 when the peer closed the connection, or -1 on failure.
+ */
+ssize_t conn_recv(struct connection *conn, void *buf, size_t len) {
+    if (conn->paceRate == 0) {
+        return recv_some(conn, buf, len);
+    }
+    size_t allowed = pace(conn, len);
+    ssize_t n = recv_some(conn, buf, allowed);
+    conn->pacedBytes -= allowed - (n > 0 ? (size_t)n : 0);
+    return n;
+    }
+
+static int send_all(struct connection *conn, const void *buf, size_t len, int flags) {
+    if (conn->ssl == NULL || conn->ktlsSend) {
+        return send_plain(conn->fd, buf, len, flags);
+    }
+
+    if ((flags & MSG_MORE) && conn->corked + len <= CONN_CORK_SIZE) {
+        memcpy(conn->cork + conn->corked, buf, len);
+        conn->corked += len;
+        return 0;
+    }
+
+    struct iovec iov = { (void *)buf, len };
+    return conn_sendv(conn, &iov, 1);
+    }
+
+/**
+ * Send function.
+ * @brief Sends all of 'buf'.
+ * @details With MSG_MORE in 'flags' a plain or kernel TLS socket holds the data back until the next write. For
+ * userspace TLS, small writes are corked here instead, so a frame header and its payload end up in one record.
+ * A connection paced in userspace gets 'buf' in chunks at its pacing rate.
+ * @return Returns 0, or -1 on failure.
+ */
+int conn_send_all(struct connection *conn, const void *buf, size_t len, int flags) {
+    if (conn->paceRate > 0) {
+        const char *pos = buf;
+        while (len > 0) {
+            size_t chunk = pace(conn, len);
+            if (send_all(conn, pos, chunk, flags) != 0) {
+                return -1;
+            }
+            pos += chunk;
+            len -= chunk;
+        }
+        return 0;
+    }
+    return send_all(conn, buf, len, flags);
+    }
+
+/**
+ * Gathered send function.
+ * @brief Sends the given buffers in order, like sendmsg() but resuming after partial writes.
+ * @return Returns 0, or -1 on failure.
+ */
+int conn_sendv(struct connection *conn, struct iovec *iov, int count) {
+    if (conn->ssl == NULL || conn->ktlsSend) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        while (msg.msg_iovlen > 0) {
+            ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+                sent -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+            if (msg.msg_iovlen > 0) {
+                msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+                msg.msg_iov->iov_len -= sent;
+            }
+        }
+        return 0;
+    }
+
+    //userspace TLS: everything up to a full record goes out as one SSL_write
+    size_t total = conn->corked;
+    for (int i = 0; i < count; i++) {
+        total += iov[i].iov_len;
+    }
+    if (total <= TLS_CHUNK_SIZE + CONN_CORK_SIZE) {
+        unsigned char buffer[TLS_CHUNK_SIZE + CONN_CORK_SIZE];
+        size_t length = conn->corked;
+        memcpy(buffer, conn->cork, conn->corked);
+        for (int i = 0; i < count; i++) {
+            memcpy(buffer + length, iov[i].iov_base, iov[i].iov_len);
+            length += iov[i].iov_len;
+        }
+        conn->corked = 0;
+        return ssl_write_all(conn->ssl, buffer, length);
+    }
+
+    if (conn->corked > 0) {
+        size_t corked = conn->corked;
+        conn->corked = 0;
+        if (ssl_write_all(conn->ssl, conn->cork, corked) != 0) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (ssl_write_all(conn->ssl, iov[i].iov_base, iov[i].iov_len) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+    }
+
+/**
+ * Completion reading function.
+ * @brief Counts the zerocopy completions waiting on the error queue of the socket.
+ * @details Each notification covers a range of sends. If the kernel had to copy the data anyway, as it does on
+ * loopback, the connection stops using MSG_ZEROCOPY, which then only costs the notifications.
+ */
+static void read_completions(struct connection *conn) {
+    for (;;) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        //the error queue never blocks, it is empty once this fails
+        if (recvmsg(conn->fd, &msg, MSG_ERRQUEUE) < 0) {
+            return;
+        }
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                continue;
+            }
+            conn->zerocopyDone += err.ee_data - err.ee_info + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                conn->zerocopy = -1;
+            }
+        }
+    }
+    }
+
+/**
+ * Completion waiting function.
+ * @brief Waits until the kernel released the memory of every zerocopy send.
+ * @details A slow peer may take long, so the wait only gives up after 'timeout' milliseconds in which the send
+ * queue of the socket did not shrink.
+ * @return Returns 0, or -1 if some sends are still not completed.
+ */
+static int wait_completions(struct connection *conn, int timeout) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int queued = -1;
+    read_completions(conn);
+    while (conn->zerocopyDone != conn->zerocopySent) {
+        int left;
+        if (ioctl(conn->fd, SIOCOUTQ, &left) == 0 && (queued < 0 || left < queued)) {
+            queued = left;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed >= timeout) {
+            return -1;
+        }
+        //with no events requested, poll() only wakes up for the error queue or a closed connection
+        struct pollfd pfd = { conn->fd, 0, 0 };
+        if (poll(&pfd, 1, timeout - elapsed) < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (pfd.revents & POLLHUP) {
+            //completions follow the hangup shortly, but poll() no longer waits for them
+            struct timespec pause = { 0, 1000000 };
+            nanosleep(&pause, NULL);
+        }
+        read_completions(conn);
+    }
+    return 0;
+    }
+
+/**
+ * Zerocopy send function.
+ * @brief Sends all of 'buf' with MSG_ZEROCOPY and returns once the kernel no longer references it.
+ * @details The pages of 'buf' go to the network card instead of being copied into socket buffers, so 'buf' must stay
+ * valid and unchanged until this returns. Only plain sockets qualify; TLS connections, sockets without SO_ZEROCOPY, and
+ * connections on which the kernel copied anyway, send with conn_send_all(). If the peer stops acknowledging data for
+ * ZEROCOPY_TIMEOUT_MS before the completions arrive, the connection is reset, which drops the queued data and with it
+ * the references to 'buf'.
+ * @return Returns 0, -1 on failure, or -2 if even the reset did not complete the sends, so that the kernel may still
+ * reference 'buf', which must then never be freed or reused.
+ */
+int conn_send_zerocopy(struct connection *conn, const void *buf, size_t len) {
+    if (conn->ssl != NULL || conn->zerocopy < 0 || conn->paceRate > 0) {
+        return conn_send_all(conn, buf, len, 0);
+    }
+    if (conn->zerocopy == 0) {
+        int enable = 1;
+        conn->zerocopy = setsockopt(conn->fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0 ? 1 : -1;
+        if (conn->zerocopy < 0) {
+            return conn_send_all(conn, buf, len, 0);
+        }
+    }
+
+    const char *pos = buf;
+    int res = 0;
+    while (len > 0) {
+        ssize_t sent = send(conn->fd, pos, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            //the notifications are charged to the socket; once they run out, earlier sends have to complete
+            if (errno == ENOBUFS && conn->zerocopySent != conn->zerocopyDone) {
+                if (wait_completions(conn, ZEROCOPY_TIMEOUT_MS) == 0) {
+                    continue;
+                }
+            }
+            else if (errno == ENOBUFS) {
+                res = send_plain(conn->fd, pos, len, 0);
+                break;
+            }
+            res = -1;
+            break;
+        }
+        conn->zerocopySent++;
+        pos += sent;
+        len -= sent;
+    }
+
+    if (wait_completions(conn, ZEROCOPY_TIMEOUT_MS) != 0) {
+        //disconnecting purges the send queue, which completes what is left
+        struct sockaddr unspecified = { .sa_family = AF_UNSPEC };
+        connect(conn->fd, &unspecified, sizeof(unspecified));
+        if (wait_completions(conn, ZEROCOPY_TIMEOUT_MS) != 0) {
+            fprintf(stderr, "Zerocopy sends did not complete\n");
+            return -2;
+        }
+        return -1;
+    }
+    return res;
+    }
+
+static int sendfile_all(struct connection *conn, int fd, off_t offset, size_t count) {
+    if (conn->ssl == NULL) {
+        while (count > 0) {
+            ssize_t sent = sendfile(conn->fd, fd, &offset, count);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return -1;
+            }
+            count -= sent;
+        }
+        return 0;
+    }
+
+    if (conn->ktlsSend) {
+        while (count > 0) {
+            ossl_ssize_t sent = SSL_sendfile(conn->ssl, fd, offset, count, 0);
+            if (sent <= 0) {
+                ERR_clear_error();
+                return -1;
+            }
+            offset += sent;
+            count -= sent;
+        }
+        return 0;
+    }
+
+    unsigned char buffer[TLS_CHUNK_SIZE];
+    while (count > 0) {
+        size_t chunk = count < sizeof(buffer) ? count : sizeof(buffer);
+        ssize_t n = pread(fd, buffer, chunk, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        struct iovec iov = { buffer, (size_t)n };
+        if (conn_sendv(conn, &iov, 1) != 0) {
+            return -1;
+        }
+        offset += n;
+        count -= n;
+    }
+    return 0;
+    }
+
+/**
+ * File transmission function.
+ * @brief Sends 'count' bytes of 'fd' starting at 'offset'.
+ * @details Plain sockets and kernel TLS use sendfile(), so the body never enters userspace. Userspace TLS has to
+ * read the file in record-sized chunks and encrypt them. A connection paced in userspace gets the file in chunks at
+ * its pacing rate.
+ * @return Returns 0, or -1 on failure, including a file that turned out shorter than 'count'.
+ */
+int conn_sendfile(struct connection *conn, int fd, off_t offset, size_t count) {
+    while (conn->paceRate > 0 && count > 0) {
+        size_t chunk = pace(conn, count);
+        if (sendfile_all(conn, fd, offset, chunk) != 0) {
+            return -1;
+        }
+        offset += chunk;
+        count -= chunk;
+    }
+    return sendfile_all(conn, fd, offset, count);
+    }
+
+/**
+ * Splice capability function.
+ * @brief Tells whether the connection accepts data spliced from a pipe, which is the case for plain sockets and
+ * kernel TLS. Userspace TLS has to encrypt everything it sends itself.
+ */
+bool conn_can_splice(const struct connection *conn) {
+    return conn->ssl == NULL || conn->ktlsSend;
+    }
+
+/**
+ * Pipe transmission function.
+ * @brief Moves 'count' bytes that are waiting in the pipe 'pipeFd' to the socket with splice(), so they are never
+ * copied into userspace. 'flags' may hold SPLICE_F_MORE when more data follows right away.
+ * @return Returns 0, or -1 on failure or if the connection cannot take spliced data.
+ */
+int conn_splice(struct connection *conn, int pipeFd, size_t count, unsigned int flags) {
+    if (!conn_can_splice(conn)) {
+        return -1;
+    }
+    while (count > 0) {
+        ssize_t moved = splice(pipeFd, NULL, conn->fd, NULL, count, SPLICE_F_MOVE | flags);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            return -1;
+        }
+        count -= moved;
+    }
+    return 0;
+    }
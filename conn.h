@@ -0,0 +1,73 @@
+/**
+*@file conn.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Connection I/O.
+*
+* Reading and writing on a socket that is either plain or protected with TLS, shared by server and client.
+**/
+
+#ifndef CONN_H
+#define CONN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+#define CONN_CORK_SIZE 256
+#define ZEROCOPY_TIMEOUT_MS 10000
+#define PACE_INTERVAL_MS 20
+#define PACE_MIN_CHUNK 4096
+#define PACE_RECEIVE_BUFFER_MS 250
+
+/**
+ * A connection. Without TLS 'ssl' is NULL. With kernel TLS offload for sending, 'ktlsSend' is set and
+ * application data is written to the socket directly, the kernel producing the records. With a 'spinBudget' of
+ * nanoseconds, reads poll the socket without sleeping for that long before they block. 'zerocopy' is 1 once
+ * SO_ZEROCOPY is enabled and -1 if it is not to be used, and 'zerocopySent' and 'zerocopyDone' count the
+ * MSG_ZEROCOPY sends and their completions. With a 'paceRate' of bytes per second, the connection is paced in
+ * userspace, 'pacedBytes' bytes having been sent or received since 'paceStart'.
+ */
+struct connection {
+    int fd;
+    SSL *ssl;
+    bool ktlsSend;
+    unsigned char cork[CONN_CORK_SIZE];
+    size_t corked;
+    long spinBudget;
+    int zerocopy;
+    uint32_t zerocopySent;
+    uint32_t zerocopyDone;
+    uint64_t paceRate;
+    uint64_t pacedBytes;
+    struct timespec paceStart;
+};
+
+void conn_init(struct connection *conn, int fd);
+void conn_close(struct connection *conn);
+
+SSL_CTX *tls_server_context(const char *certFile, const char *keyFile);
+int tls_accept(struct connection *conn, SSL_CTX *ctx);
+bool tls_alpn_is_h2(const struct connection *conn);
+bool tls_session_reused(const struct connection *conn);
+
+bool conn_set_pacing(struct connection *conn, uint64_t bytesPerSecond);
+void conn_set_receive_rate(struct connection *conn, uint64_t bytesPerSecond);
+int conn_busy_poll(struct pollfd *fds, nfds_t count, long budget);
+ssize_t conn_recv(struct connection *conn, void *buf, size_t len);
+bool conn_pending(const struct connection *conn);
+int conn_send_all(struct connection *conn, const void *buf, size_t len, int flags);
+int conn_sendv(struct connection *conn, struct iovec *iov, int count);
+int conn_send_zerocopy(struct connection *conn, const void *buf, size_t len);
+int conn_sendfile(struct connection *conn, int fd, off_t offset, size_t count);
+bool conn_can_splice(const struct connection *conn);
+int conn_splice(struct connection *conn, int pipeFd, size_t count, unsigned int flags);
+
+#endif
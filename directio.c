@@ -0,0 +1,186 @@
+/**
+*@file directio.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Direct I/O for huge files.
+*
+* A transfer takes two buffers of the pool and double buffers with the native asynchronous I/O of Linux, which is
+* asynchronous for O_DIRECT reads: while one buffer is sent, the next chunk of the file is read into the other.
+* The system calls are made directly, so no AIO library is needed. Transfers that find the pool empty, or a file
+* system that refuses O_DIRECT, fall back to sendfile().
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#include "directio.h"
+#include "metrics.h"
+
+/**
+ * Pool initialisation function.
+ * @brief Maps 'bufferCount' buffers for transfers of files of at least 'threshold' bytes.
+ * @return Returns 0, or -1 on failure.
+ */
+int direct_pool_init(struct direct_pool *pool, size_t bufferCount, off_t threshold) {
+    memset(pool, 0, sizeof(struct direct_pool));
+    //mappings are page aligned, which satisfies the alignment O_DIRECT asks for
+    void *memory = mmap(NULL, bufferCount * DIRECT_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap() failed");
+        return -1;
+    }
+    pool->freeBuffers = malloc(bufferCount * sizeof(char *));
+    if (pool->freeBuffers == NULL) {
+        perror("malloc() failed");
+        munmap(memory, bufferCount * DIRECT_CHUNK);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->memory = memory;
+    pool->bufferCount = bufferCount;
+    for (size_t i = 0; i < bufferCount; i++) {
+        pool->freeBuffers[i] = pool->memory + i * DIRECT_CHUNK;
+    }
+    pool->freeCount = bufferCount;
+    pool->threshold = threshold;
+    return 0;
+    }
+
+/** Unmaps the buffers. Called once no transfer uses them anymore. */
+void direct_pool_destroy(struct direct_pool *pool) {
+    if (pool->memory != NULL) {
+        munmap(pool->memory, pool->bufferCount * DIRECT_CHUNK);
+        pthread_mutex_destroy(&pool->lock);
+    }
+    free(pool->freeBuffers);
+    memset(pool, 0, sizeof(struct direct_pool));
+    }
+
+static bool take_buffers(struct direct_pool *pool, char **buffers) {
+    bool taken = false;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->freeCount >= 2) {
+        buffers[0] = pool->freeBuffers[--pool->freeCount];
+        buffers[1] = pool->freeBuffers[--pool->freeCount];
+        taken = true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return taken;
+    }
+
+static void give_buffers(struct direct_pool *pool, char **buffers) {
+    pthread_mutex_lock(&pool->lock);
+    pool->freeBuffers[pool->freeCount++] = buffers[0];
+    pool->freeBuffers[pool->freeCount++] = buffers[1];
+    pthread_mutex_unlock(&pool->lock);
+    }
+
+/** Starts reading 'length' bytes of 'fd' at 'offset' into 'buffer', both rounded to whole blocks. */
+static int submit_read(aio_context_t context, struct iocb *request, int fd, char *buffer, off_t offset,
+                       size_t length) {
+    memset(request, 0, sizeof(struct iocb));
+    request->aio_lio_opcode = IOCB_CMD_PREAD;
+    request->aio_fildes = fd;
+    request->aio_buf = (uint64_t)(uintptr_t)buffer;
+    request->aio_nbytes = (length + DIRECT_ALIGNMENT - 1) & ~(size_t)(DIRECT_ALIGNMENT - 1);
+    request->aio_offset = offset;
+    struct iocb *requests[1] = { request };
+    return syscall(SYS_io_submit, context, 1, requests) == 1 ? 0 : -1;
+    }
+
+/** Waits for the read in flight and returns how many bytes it read, or a negative error number. */
+static long wait_read(aio_context_t context) {
+    struct io_event event;
+    long res;
+    while ((res = syscall(SYS_io_getevents, context, 1, 1, &event, NULL)) < 0 && errno == EINTR) {
+    }
+    return res == 1 ? (long)event.res : -errno;
+    }
+
+/**
+ * Double buffering function.
+ * @brief Sends 'count' bytes of 'fd' from 'offset' on, reading the next chunk while the last one is sent.
+ * @details 'refused' is set if the very first read failed with EINVAL, which is how file systems without direct
+ * I/O answer, so that nothing is sent yet and the caller can still fall back.
+ * @return Returns 0, or -1 on failure.
+ */
+static int transfer(aio_context_t context, struct connection *conn, int fd, off_t offset, size_t count,
+                    char **buffers, bool *refused) {
+    struct iocb requests[2];
+    size_t sent = 0;
+    int current = 0;
+    if (submit_read(context, &requests[0], fd, buffers[0], offset, count < DIRECT_CHUNK ? count : DIRECT_CHUNK) != 0) {
+        *refused = errno == EINVAL;
+        return -1;
+    }
+    while (sent < count) {
+        size_t length = count - sent < DIRECT_CHUNK ? count - sent : DIRECT_CHUNK;
+        long got = wait_read(context);
+        if (got < (long)length) {
+            //a short read means the file was truncated while it was sent
+            *refused = sent == 0 && got == -EINVAL;
+            errno = got < 0 ? -got : EIO;
+            return -1;
+        }
+        size_t next = sent + length;
+        if (next < count && submit_read(context, &requests[!current], fd, buffers[!current], offset + next,
+                                        count - next < DIRECT_CHUNK ? count - next : DIRECT_CHUNK) != 0) {
+            return -1;
+        }
+        if (conn_send_all(conn, buffers[current], length, 0) != 0) {
+            return -1;
+        }
+        sent = next;
+        current = !current;
+    }
+    return 0;
+    }
+
+/**
+ * Direct transmission function.
+ * @brief Sends 'count' bytes of 'fd' starting at 'offset' without going through the page cache.
+ * @details 'fd' is switched to O_DIRECT for good. An unaligned 'offset', an empty pool or a file system without
+ * direct I/O make this a plain conn_sendfile().
+ * @return Returns 0, or -1 on failure.
+ */
+int direct_send(struct direct_pool *pool, struct connection *conn, int fd, off_t offset, size_t count) {
+    char *buffers[2];
+    if (offset % DIRECT_ALIGNMENT != 0 || !take_buffers(pool, buffers)) {
+        METRICS_ADD(directFallbacks, 1);
+        return conn_sendfile(conn, fd, offset, count);
+    }
+    int flags = fcntl(fd, F_GETFL);
+    aio_context_t context = 0;
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_DIRECT) != 0 || syscall(SYS_io_setup, 2, &context) != 0) {
+        give_buffers(pool, buffers);
+        METRICS_ADD(directFallbacks, 1);
+        return conn_sendfile(conn, fd, offset, count);
+    }
+
+    bool refused = false;
+    int res = transfer(context, conn, fd, offset, count, buffers, &refused);
+    //destroying the context waits for a read still in flight, only then the buffers are free again
+    syscall(SYS_io_destroy, context);
+    give_buffers(pool, buffers);
+    if (refused) {
+        METRICS_ADD(directFallbacks, 1);
+        fcntl(fd, F_SETFL, flags);
+        return conn_sendfile(conn, fd, offset, count);
+    }
+    if (res == 0) {
+        METRICS_ADD(directSends, 1);
+    }
+    return res;
+    }
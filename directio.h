@@ -0,0 +1,41 @@
+/**
+*@file directio.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Direct I/O for huge files.
+*
+* Sends files past the page cache, reading them with O_DIRECT into buffers of a pool that is shared by all workers,
+* so that a bulk transfer of a cold file does not evict the files that are requested all the time.
+**/
+
+#ifndef DIRECTIO_H
+#define DIRECTIO_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "conn.h"
+
+#define DIRECT_CHUNK (1024 * 1024)
+#define DIRECT_ALIGNMENT 4096
+
+/**
+ * A pool of 'bufferCount' buffers of DIRECT_CHUNK bytes in one mapping, for files of at least 'threshold' bytes.
+ * 'freeBuffers' is a stack of the 'freeCount' buffers not in use.
+ */
+struct direct_pool {
+    pthread_mutex_t lock;
+    char *memory;
+    size_t bufferCount;
+    char **freeBuffers;
+    size_t freeCount;
+    off_t threshold;
+};
+
+int direct_pool_init(struct direct_pool *pool, size_t bufferCount, off_t threshold);
+void direct_pool_destroy(struct direct_pool *pool);
+int direct_send(struct direct_pool *pool, struct connection *conn, int fd, off_t offset, size_t count);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+*@file filehint.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Page cache hints for served files.
+*
+* Files from FILEHINT_SEQUENTIAL_SIZE on are announced as read sequentially, which doubles the readahead window,
+* and their first FILEHINT_WINDOW bytes are read ahead while the header goes out. Files from FILEHINT_ONESHOT_SIZE
+* on that were not requested within the last FILEHINT_REUSE_SECONDS are dropped from the page cache once sent, so
+* that a single download of a huge file does not evict the pages of the files that are requested all the time.
+* Requests are remembered in a table of FILEHINT_SLOTS slots indexed by device and inode, a file whose slot was
+* taken over by another one is treated as not requested before.
+**/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "filehint.h"
+#include "metrics.h"
+
+struct slot {
+    dev_t device;
+    ino_t inode;
+    time_t lastRequest;
+};
+
+static struct slot slots[FILEHINT_SLOTS];
+static pthread_mutex_t slotsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+    }
+
+/**
+ * Request recording function.
+ * @brief Notes that the file of 'st' is requested now.
+ * @return Returns true if it was requested before, within the last FILEHINT_REUSE_SECONDS.
+ */
+static bool record_request(const struct stat *st) {
+    uint64_t hash = ((uint64_t)st->st_dev * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)st->st_ino * 0xff51afd7ed558ccdull);
+    struct slot *slot = &slots[(hash >> 32) % FILEHINT_SLOTS];
+    time_t now = monotonic_seconds();
+
+    pthread_mutex_lock(&slotsLock);
+    //the monotonic clock starts near zero at boot, an unused slot has never seen a request
+    bool reused = slot->lastRequest != 0 && slot->device == st->st_dev && slot->inode == st->st_ino &&
+                  now - slot->lastRequest < FILEHINT_REUSE_SECONDS;
+    slot->device = st->st_dev;
+    slot->inode = st->st_ino;
+    slot->lastRequest = now != 0 ? now : 1;
+    pthread_mutex_unlock(&slotsLock);
+    return reused;
+    }
+
+/**
+ * Hinting function.
+ * @brief Gives the readahead hints for the file 'fd', which is about to be sent as a whole.
+ * @return Returns true if its pages should be dropped with filehint_after_send() once it is sent.
+ */
+bool filehint_before_send(int fd, const struct stat *st) {
+    if (st->st_size < FILEHINT_SEQUENTIAL_SIZE) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    //pages already cached are skipped, so a hot file costs only the lookup
+    posix_fadvise(fd, 0, st->st_size < FILEHINT_WINDOW ? st->st_size : FILEHINT_WINDOW, POSIX_FADV_WILLNEED);
+    if (st->st_size < FILEHINT_ONESHOT_SIZE) {
+        return false;
+    }
+    return !record_request(st);
+    }
+
+/** Drops the pages of 'length' bytes of 'fd' from 'offset' on from the page cache, as far as they are clean. */
+void filehint_after_send(int fd, off_t offset, off_t length) {
+    if (posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED) == 0) {
+        METRICS_ADD(filehintDrops, 1);
+    }
+    }
@@ -0,0 +1,28 @@
+/**
+*@file filehint.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Page cache hints for served files.
+*
+* Tells the kernel how a file is about to be read before it is sent, and whether its pages are worth keeping
+* afterwards, judged by its size and by how recently it was requested before.
+**/
+
+#ifndef FILEHINT_H
+#define FILEHINT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define FILEHINT_SEQUENTIAL_SIZE (256 * 1024)
+#define FILEHINT_WINDOW (4 * 1024 * 1024)
+#define FILEHINT_ONESHOT_SIZE (64 * 1024 * 1024)
+#define FILEHINT_REUSE_SECONDS 600
+#define FILEHINT_SLOTS 4096
+
+bool filehint_before_send(int fd, const struct stat *st);
+void filehint_after_send(int fd, off_t offset, off_t length);
+
+#endif
@@ -0,0 +1,148 @@
+/**
+*@file h2.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief HTTP/2 framing.
+*
+* Encoding and decoding of frame headers and the frames both endpoints send for connection management.
+**/
+
+#include <string.h>
+
+#include <sys/uio.h>
+
+#include "h2.h"
+
+void h2_settings_init(struct h2_settings *settings) {
+    settings->headerTableSize = 4096;
+    settings->enablePush = 1;
+    settings->maxConcurrentStreams = UINT32_MAX;
+    settings->initialWindowSize = H2_DEFAULT_WINDOW;
+    settings->maxFrameSize = H2_DEFAULT_FRAME_SIZE;
+    settings->maxHeaderListSize = UINT32_MAX;
+    }
+
+/**
+ * Settings function.
+ * @brief Applies the parameters of a SETTINGS payload, unknown identifiers are ignored.
+ * @return Returns H2_NO_ERROR, or the error code the connection has to be closed with.
+ */
+int h2_apply_settings(struct h2_settings *settings, const uint8_t *payload, size_t length) {
+    if (length % 6 != 0) {
+        return H2_FRAME_SIZE_ERROR;
+        }
+    for (size_t i = 0; i < length; i += 6) {
+        uint16_t id = (uint16_t)((payload[i] << 8) | payload[i + 1]);
+        uint32_t value = h2_read_u32(&payload[i + 2]);
+
+        switch (id) {
+            case H2_SETTINGS_HEADER_TABLE_SIZE:
+                settings->headerTableSize = value;
+                break;
+            case H2_SETTINGS_ENABLE_PUSH:
+                if (value > 1) {
+                    return H2_PROTOCOL_ERROR;
+                }
+                settings->enablePush = value;
+                break;
+            case H2_SETTINGS_MAX_CONCURRENT_STREAMS:
+                settings->maxConcurrentStreams = value;
+                break;
+            case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+                if (value > H2_MAX_WINDOW) {
+                    return H2_FLOW_CONTROL_ERROR;
+                }
+                settings->initialWindowSize = value;
+                break;
+            case H2_SETTINGS_MAX_FRAME_SIZE:
+                if (value < H2_DEFAULT_FRAME_SIZE || value > H2_MAX_FRAME_SIZE) {
+                    return H2_PROTOCOL_ERROR;
+                }
+                settings->maxFrameSize = value;
+                break;
+            case H2_SETTINGS_MAX_HEADER_LIST_SIZE:
+                settings->maxHeaderListSize = value;
+                break;
+            default:
+                break;
+        }
+        }
+    return H2_NO_ERROR;
+    }
+
+uint32_t h2_read_u32(const uint8_t *in) {
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+    }
+
+void h2_parse_frame_header(const uint8_t *in, struct h2_frame *frame) {
+    frame->length = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+    frame->type = in[3];
+    frame->flags = in[4];
+    frame->streamId = h2_read_u32(&in[5]) & 0x7fffffff;
+    frame->payload = in + H2_FRAME_HEADER_LENGTH;
+    }
+
+void h2_pack_frame_header(uint8_t *out, uint32_t length, uint8_t type, uint8_t flags, uint32_t streamId) {
+    out[0] = (uint8_t)(length >> 16);
+    out[1] = (uint8_t)(length >> 8);
+    out[2] = (uint8_t)length;
+    out[3] = type;
+    out[4] = flags;
+    out[5] = (uint8_t)((streamId >> 24) & 0x7f);
+    out[6] = (uint8_t)(streamId >> 16);
+    out[7] = (uint8_t)(streamId >> 8);
+    out[8] = (uint8_t)streamId;
+    }
+
+/**
+ * Padding function.
+ * @brief Removes the pad length octet and the padding of a PADDED DATA or HEADERS frame from its payload.
+ * @return Returns 0, or -1 if the padding is longer than the payload (a PROTOCOL_ERROR).
+ */
+int h2_strip_padding(struct h2_frame *frame) {
+    if ((frame->flags & H2_FLAG_PADDED) == 0) {
+        return 0;
+        }
+    if (frame->length < 1 || frame->payload[0] >= frame->length) {
+        return -1;
+        }
+    uint8_t padLength = frame->payload[0];
+    frame->payload++;
+    frame->length -= 1 + padLength;
+    return 0;
+    }
+
+/**
+ * Frame transmission function.
+ * @brief Sends a frame header and its payload with a single gathered write.
+ * @return Returns 0, or -1 if the connection failed.
+ */
+int h2_send_frame(struct connection *conn, uint8_t type, uint8_t flags, uint32_t streamId, const void *payload, size_t length) {
+    uint8_t header[H2_FRAME_HEADER_LENGTH];
+    h2_pack_frame_header(header, (uint32_t)length, type, flags, streamId);
+
+    struct iovec iov[2] = {
+        { header, sizeof(header) },
+        { (void *)payload, length }
+    };
+    return conn_sendv(conn, iov, length > 0 ? 2 : 1);
+    }
+
+int h2_send_window_update(struct connection *conn, uint32_t streamId, uint32_t increment) {
+    uint8_t payload[4] = { (uint8_t)((increment >> 24) & 0x7f), (uint8_t)(increment >> 16),
+                           (uint8_t)(increment >> 8), (uint8_t)increment };
+    return h2_send_frame(conn, H2_WINDOW_UPDATE, 0, streamId, payload, sizeof(payload));
+    }
+
+int h2_send_rst_stream(struct connection *conn, uint32_t streamId, uint32_t error) {
+    uint8_t payload[4] = { (uint8_t)(error >> 24), (uint8_t)(error >> 16), (uint8_t)(error >> 8), (uint8_t)error };
+    return h2_send_frame(conn, H2_RST_STREAM, 0, streamId, payload, sizeof(payload));
+    }
+
+int h2_send_goaway(struct connection *conn, uint32_t lastStreamId, uint32_t error) {
+    uint8_t payload[8] = { (uint8_t)((lastStreamId >> 24) & 0x7f), (uint8_t)(lastStreamId >> 16),
+                           (uint8_t)(lastStreamId >> 8), (uint8_t)lastStreamId,
+                           (uint8_t)(error >> 24), (uint8_t)(error >> 16), (uint8_t)(error >> 8), (uint8_t)error };
+    return h2_send_frame(conn, H2_GOAWAY, 0, 0, payload, sizeof(payload));
+    }
@@ -0,0 +1,105 @@
+/**
+*@file h2.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief HTTP/2 framing.
+*
+* Frame layout, settings and error codes of RFC 9113, shared by the server and the client.
+**/
+
+#ifndef H2_H
+#define H2_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "conn.h"
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LENGTH 24
+#define H2_FRAME_HEADER_LENGTH 9
+#define H2_DEFAULT_WINDOW 65535
+#define H2_DEFAULT_FRAME_SIZE 16384
+#define H2_MAX_FRAME_SIZE 16777215
+#define H2_MAX_WINDOW 0x7fffffff
+
+enum h2_frame_type {
+    H2_DATA = 0x0,
+    H2_HEADERS = 0x1,
+    H2_PRIORITY = 0x2,
+    H2_RST_STREAM = 0x3,
+    H2_SETTINGS = 0x4,
+    H2_PUSH_PROMISE = 0x5,
+    H2_PING = 0x6,
+    H2_GOAWAY = 0x7,
+    H2_WINDOW_UPDATE = 0x8,
+    H2_CONTINUATION = 0x9
+};
+
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+enum h2_setting {
+    H2_SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    H2_SETTINGS_ENABLE_PUSH = 0x2,
+    H2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    H2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    H2_SETTINGS_MAX_FRAME_SIZE = 0x5,
+    H2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+enum h2_error {
+    H2_NO_ERROR = 0x0,
+    H2_PROTOCOL_ERROR = 0x1,
+    H2_INTERNAL_ERROR = 0x2,
+    H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_SETTINGS_TIMEOUT = 0x4,
+    H2_STREAM_CLOSED = 0x5,
+    H2_FRAME_SIZE_ERROR = 0x6,
+    H2_REFUSED_STREAM = 0x7,
+    H2_CANCEL = 0x8,
+    H2_COMPRESSION_ERROR = 0x9,
+    H2_CONNECT_ERROR = 0xa,
+    H2_ENHANCE_YOUR_CALM = 0xb,
+    H2_INADEQUATE_SECURITY = 0xc,
+    H2_HTTP_1_1_REQUIRED = 0xd
+};
+
+/** A frame as parsed from the input buffer, 'payload' points into that buffer. */
+struct h2_frame {
+    uint32_t length;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t streamId;
+    const uint8_t *payload;
+};
+
+/** The parameters announced by one endpoint in its SETTINGS frames. */
+struct h2_settings {
+    uint32_t headerTableSize;
+    uint32_t enablePush;
+    uint32_t maxConcurrentStreams;
+    uint32_t initialWindowSize;
+    uint32_t maxFrameSize;
+    uint32_t maxHeaderListSize;
+};
+
+void h2_settings_init(struct h2_settings *settings);
+int h2_apply_settings(struct h2_settings *settings, const uint8_t *payload, size_t length);
+
+void h2_parse_frame_header(const uint8_t *in, struct h2_frame *frame);
+void h2_pack_frame_header(uint8_t *out, uint32_t length, uint8_t type, uint8_t flags, uint32_t streamId);
+int h2_strip_padding(struct h2_frame *frame);
+uint32_t h2_read_u32(const uint8_t *in);
+
+int h2_send_frame(struct connection *conn, uint8_t type, uint8_t flags, uint32_t streamId, const void *payload, size_t length);
+int h2_send_window_update(struct connection *conn, uint32_t streamId, uint32_t increment);
+int h2_send_rst_stream(struct connection *conn, uint32_t streamId, uint32_t error);
+int h2_send_goaway(struct connection *conn, uint32_t lastStreamId, uint32_t error);
+
+#endif
@@ -0,0 +1,438 @@
+/**
+*@file h2client.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief HTTP/2 connection handling of the client.
+*
+* Fetches many URLs of one host as concurrent streams over a single connection, negotiated with ALPN over TLS or
+* with prior knowledge over cleartext.
+* Every stream has its own receive window, which is opened again as its body is written out.
+**/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "client.h"
+#include "h2.h"
+#include "hpack.h"
+
+#define CLIENT_MAX_STREAMS 100
+#define STREAM_WINDOW (1 << 20)
+#define CONNECTION_WINDOW (1 << 24)
+#define INPUT_BUFFER_SIZE (2 * (H2_DEFAULT_FRAME_SIZE + H2_FRAME_HEADER_LENGTH))
+
+/** State of the client connection. */
+struct h2_client {
+    struct connection *conn;
+    struct fetch *fetches;
+    size_t count;
+    struct h2_settings peer;
+    struct hpack_encoder encoder;
+    struct hpack_decoder decoder;
+    uint32_t nextStreamId;
+    uint32_t activeStreams;
+    uint32_t unacknowledged;
+    int result;
+    bool goaway;
+
+    uint8_t input[INPUT_BUFFER_SIZE];
+    size_t inputLength;
+
+    uint8_t *headerBlock;
+    size_t headerBlockLength;
+    size_t headerBlockSize;
+    uint32_t headerStreamId;
+    bool headerEndStream;
+};
+
+static int collect_status(void *ctx, const char *name, size_t nameLength, const char *value, size_t valueLength) {
+    int *status = ctx;
+    if (nameLength == 7 && memcmp(name, ":status", 7) == 0 && valueLength == 3) {
+        *status = (value[0] - '0') * 100 + (value[1] - '0') * 10 + (value[2] - '0');
+    }
+    return 0;
+    }
+
+static struct fetch *find_fetch(struct h2_client *client, uint32_t id) {
+    for (size_t i = 0; i < client->count; i++) {
+        struct fetch *fetch = &client->fetches[i];
+        if (fetch->started && !fetch->done && fetch->streamId == id) {
+            return fetch;
+        }
+    }
+    return NULL;
+    }
+
+static void close_fetch(struct h2_client *client, struct fetch *fetch, int result) {
+    if (finish_output(fetch) != 0 && result == 0) {
+        perror("fclose() failed");
+        result = 1;
+    }
+    fetch->done = true;
+    fetch->failed = result != 0;
+    client->activeStreams--;
+    if (result != 0 && client->result == 0) {
+        client->result = result;
+    }
+    }
+
+/**
+ * Stream opening function.
+ * @brief Sends the HEADERS frame of the next URL that has not been requested yet.
+ * @return Returns 1 if a stream was opened, 0 if there is nothing left to request, or -1 if the connection failed.
+ */
+static int start_next(struct h2_client *client) {
+    struct fetch *fetch = NULL;
+    for (size_t i = 0; i < client->count && fetch == NULL; i++) {
+        if (!client->fetches[i].started && !client->fetches[i].done) {
+            fetch = &client->fetches[i];
+        }
+    }
+    if (fetch == NULL) {
+        return 0;
+    }
+
+    uint8_t block[MAX_TARGET_LENGTH + MAX_HOST_LENGTH + 64];
+    size_t length = 0;
+    length += hpack_encode(&client->encoder, block + length, sizeof(block) - length, ":method", "GET", true);
+    length += hpack_encode(&client->encoder, block + length, sizeof(block) - length, ":scheme", "http", true);
+    length += hpack_encode(&client->encoder, block + length, sizeof(block) - length, ":authority", fetch->host, true);
+    length += hpack_encode(&client->encoder, block + length, sizeof(block) - length, ":path", fetch->path, false);
+
+    fetch->streamId = client->nextStreamId;
+    fetch->window = STREAM_WINDOW;
+    fetch->unacknowledged = 0;
+    fetch->status = 0;
+    fetch->started = true;
+    client->nextStreamId += 2;
+    client->activeStreams++;
+
+    if (h2_send_frame(client->conn, H2_HEADERS, H2_FLAG_END_HEADERS | H2_FLAG_END_STREAM, fetch->streamId, block, length) != 0) {
+        return -1;
+    }
+    return 1;
+    }
+
+static int complete_headers(struct h2_client *client) {
+    int status = 0;
+    uint32_t id = client->headerStreamId;
+
+    client->headerStreamId = 0;
+    if (hpack_decode(&client->decoder, client->headerBlock, client->headerBlockLength, collect_status, &status) != 0) {
+        return H2_COMPRESSION_ERROR;
+    }
+
+    struct fetch *fetch = find_fetch(client, id);
+    if (fetch == NULL) {
+        return H2_NO_ERROR;
+    }
+    if (fetch->status == 0) {
+        //informational responses are followed by the final one
+        if (status >= 100 && status < 200) {
+            return H2_NO_ERROR;
+        }
+        fetch->status = status;
+        if (status != 200) {
+            fprintf(stderr, " %d %s\n", status, fetch->url);
+            close_fetch(client, fetch, 3);
+            return client->headerEndStream ? H2_NO_ERROR : h2_send_rst_stream(client->conn, id, H2_CANCEL);
+        }
+        if (open_output(fetch) != 0) {
+            close_fetch(client, fetch, 1);
+            return h2_send_rst_stream(client->conn, id, H2_CANCEL);
+        }
+    }
+    if (client->headerEndStream) {
+        close_fetch(client, fetch, 0);
+    }
+    return H2_NO_ERROR;
+    }
+
+static int append_header_block(struct h2_client *client, const uint8_t *data, size_t length) {
+    if (client->headerBlockLength + length > HPACK_MAX_HEADER_LIST) {
+        return -1;
+    }
+    if (client->headerBlockLength + length > client->headerBlockSize) {
+        size_t size = client->headerBlockLength + length;
+        uint8_t *tmp = realloc(client->headerBlock, size);
+        if (tmp == NULL) {
+            return -1;
+        }
+        client->headerBlock = tmp;
+        client->headerBlockSize = size;
+    }
+    memcpy(client->headerBlock + client->headerBlockLength, data, length);
+    client->headerBlockLength += length;
+    return 0;
+    }
+
+/**
+ * Body function.
+ * @brief Writes the payload of a DATA frame to the output of its stream.
+ * @details Credit is given back once half of a window has been consumed, per stream for the stream windows and
+ * separately for the connection window, so a slow output only throttles its own stream.
+ */
+static int handle_data(struct h2_client *client, struct h2_frame *frame) {
+    uint32_t flowLength = frame->length;
+
+    if (frame->streamId == 0 || h2_strip_padding(frame) != 0) {
+        return H2_PROTOCOL_ERROR;
+    }
+
+    client->unacknowledged += flowLength;
+    if (client->unacknowledged >= CONNECTION_WINDOW / 2) {
+        if (h2_send_window_update(client->conn, 0, client->unacknowledged) != 0) {
+            return -1;
+        }
+        client->unacknowledged = 0;
+    }
+
+    struct fetch *fetch = find_fetch(client, frame->streamId);
+    if (fetch == NULL) {
+        return H2_NO_ERROR;
+    }
+    if (fetch->out == NULL) {
+        return H2_PROTOCOL_ERROR;
+    }
+    fetch->window -= flowLength;
+    if (fetch->window < 0) {
+        return H2_FLOW_CONTROL_ERROR;
+    }
+
+    if (frame->length > 0 && fwrite(frame->payload, 1, frame->length, fetch->out) != frame->length) {
+        perror("fwrite() failed");
+        close_fetch(client, fetch, 1);
+        return h2_send_rst_stream(client->conn, frame->streamId, H2_CANCEL);
+    }
+
+    if (frame->flags & H2_FLAG_END_STREAM) {
+        close_fetch(client, fetch, 0);
+        return H2_NO_ERROR;
+    }
+    fetch->unacknowledged += flowLength;
+    if (fetch->unacknowledged >= STREAM_WINDOW / 2) {
+        fetch->window += fetch->unacknowledged;
+        if (h2_send_window_update(client->conn, fetch->streamId, fetch->unacknowledged) != 0) {
+            return -1;
+        }
+        fetch->unacknowledged = 0;
+    }
+    return H2_NO_ERROR;
+    }
+
+/**
+ * Frame dispatch function.
+ * @brief Processes one frame received from the server.
+ * @return Returns H2_NO_ERROR, an error code the connection has to be closed with, or -1 if it failed.
+ */
+static int handle_frame(struct h2_client *client, struct h2_frame *frame) {
+    if (client->headerStreamId != 0 &&
+        (frame->type != H2_CONTINUATION || frame->streamId != client->headerStreamId)) {
+        return H2_PROTOCOL_ERROR;
+    }
+
+    switch (frame->type) {
+        case H2_DATA:
+            return handle_data(client, frame);
+        case H2_HEADERS:
+            if (frame->streamId == 0 || h2_strip_padding(frame) != 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            if (frame->flags & H2_FLAG_PRIORITY) {
+                if (frame->length < 5) {
+                    return H2_FRAME_SIZE_ERROR;
+                }
+                frame->payload += 5;
+                frame->length -= 5;
+            }
+            client->headerBlockLength = 0;
+            client->headerEndStream = (frame->flags & H2_FLAG_END_STREAM) != 0;
+            client->headerStreamId = frame->streamId;
+            if (append_header_block(client, frame->payload, frame->length) != 0) {
+                return H2_ENHANCE_YOUR_CALM;
+            }
+            return (frame->flags & H2_FLAG_END_HEADERS) ? complete_headers(client) : H2_NO_ERROR;
+        case H2_CONTINUATION:
+            if (client->headerStreamId == 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            if (append_header_block(client, frame->payload, frame->length) != 0) {
+                return H2_ENHANCE_YOUR_CALM;
+            }
+            return (frame->flags & H2_FLAG_END_HEADERS) ? complete_headers(client) : H2_NO_ERROR;
+        case H2_RST_STREAM: {
+            if (frame->length != 4) {
+                return H2_FRAME_SIZE_ERROR;
+            }
+            struct fetch *fetch = find_fetch(client, frame->streamId);
+            if (fetch == NULL) {
+                return H2_NO_ERROR;
+            }
+            if (h2_read_u32(frame->payload) == H2_REFUSED_STREAM) {
+                //the server did not process the request, so it is sent again on a later stream
+                finish_output(fetch);
+                fetch->started = false;
+                client->activeStreams--;
+                return H2_NO_ERROR;
+            }
+            fprintf(stderr, "Stream reset by server: %s\n", fetch->url);
+            close_fetch(client, fetch, 1);
+            return H2_NO_ERROR;
+        }
+        case H2_SETTINGS: {
+            if (frame->streamId != 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            if (frame->flags & H2_FLAG_ACK) {
+                return H2_NO_ERROR;
+            }
+            int error = h2_apply_settings(&client->peer, frame->payload, frame->length);
+            if (error != H2_NO_ERROR) {
+                return error;
+            }
+            hpack_encoder_set_max_size(&client->encoder, client->peer.headerTableSize);
+            return h2_send_frame(client->conn, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+        }
+        case H2_PUSH_PROMISE:
+            return H2_PROTOCOL_ERROR;
+        case H2_PING:
+            if (frame->length != 8) {
+                return H2_FRAME_SIZE_ERROR;
+            }
+            if (frame->flags & H2_FLAG_ACK) {
+                return H2_NO_ERROR;
+            }
+            return h2_send_frame(client->conn, H2_PING, H2_FLAG_ACK, 0, frame->payload, 8);
+        case H2_GOAWAY: {
+            if (frame->length < 8) {
+                return H2_FRAME_SIZE_ERROR;
+            }
+            client->goaway = true;
+            uint32_t lastStreamId = h2_read_u32(frame->payload) & 0x7fffffff;
+            for (size_t i = 0; i < client->count; i++) {
+                struct fetch *fetch = &client->fetches[i];
+                if (fetch->started && !fetch->done && fetch->streamId > lastStreamId) {
+                    fprintf(stderr, "Connection closed by server: %s\n", fetch->url);
+                    close_fetch(client, fetch, 1);
+                }
+            }
+            return H2_NO_ERROR;
+        }
+        default:
+            return H2_NO_ERROR;
+    }
+    }
+
+/**
+ * HTTP/2 fetch function.
+ * @brief Fetches all URLs over one connection, keeping as many streams open as the server allows.
+ * @param conn The connection, on which nothing has been sent yet.
+ * @param fetches The URLs to fetch.
+ * @param count The number of URLs.
+ * @return Returns 0, 1 on a connection failure, 2 on a protocol error or 3 if any response was not 200.
+ */
+int h2_fetch_all(struct connection *conn, struct fetch *fetches, size_t count) {
+    struct h2_client *client = calloc(1, sizeof(struct h2_client));
+    if (client == NULL) {
+        perror("calloc() failed");
+        return 1;
+    }
+    client->conn = conn;
+    client->fetches = fetches;
+    client->count = count;
+    client->nextStreamId = 1;
+    h2_settings_init(&client->peer);
+    hpack_encoder_init(&client->encoder, HPACK_DEFAULT_TABLE_SIZE);
+    hpack_decoder_init(&client->decoder, HPACK_DEFAULT_TABLE_SIZE);
+
+    uint8_t settings[12] = { 0, H2_SETTINGS_ENABLE_PUSH, 0, 0, 0, 0,
+                             0, H2_SETTINGS_INITIAL_WINDOW_SIZE, (uint8_t)(STREAM_WINDOW >> 24),
+                             (uint8_t)(STREAM_WINDOW >> 16), (uint8_t)(STREAM_WINDOW >> 8), (uint8_t)STREAM_WINDOW };
+    int res = 0;
+    if (conn_send_all(conn, H2_PREFACE, H2_PREFACE_LENGTH, MSG_MORE) != 0 ||
+        h2_send_frame(conn, H2_SETTINGS, 0, 0, settings, sizeof(settings)) != 0 ||
+        h2_send_window_update(conn, 0, CONNECTION_WINDOW - H2_DEFAULT_WINDOW) != 0) {
+        res = -1;
+    }
+
+    int error = H2_NO_ERROR;
+    while (res == 0 && error == H2_NO_ERROR) {
+        uint32_t limit = client->peer.maxConcurrentStreams < CLIENT_MAX_STREAMS ?
+                         client->peer.maxConcurrentStreams : CLIENT_MAX_STREAMS;
+        while (!client->goaway && client->activeStreams < limit && res == 0) {
+            int started = start_next(client);
+            if (started <= 0) {
+                res = started;
+                break;
+            }
+        }
+        if (res != 0 || client->activeStreams == 0) {
+            break;
+        }
+
+        ssize_t n = conn_recv(conn, client->input + client->inputLength, INPUT_BUFFER_SIZE - client->inputLength);
+        if (n <= 0) {
+            res = -1;
+            break;
+        }
+        client->inputLength += n;
+
+        size_t pos = 0;
+        while (error == H2_NO_ERROR && client->inputLength - pos >= H2_FRAME_HEADER_LENGTH) {
+            struct h2_frame frame;
+            h2_parse_frame_header(client->input + pos, &frame);
+            if (frame.length > H2_DEFAULT_FRAME_SIZE) {
+                error = H2_FRAME_SIZE_ERROR;
+                break;
+            }
+            if (client->inputLength - pos < H2_FRAME_HEADER_LENGTH + frame.length) {
+                break;
+            }
+            //handling strips padding and priority fields off 'frame', the frame on the wire keeps its length
+            size_t frameLength = H2_FRAME_HEADER_LENGTH + frame.length;
+            error = handle_frame(client, &frame);
+            pos += frameLength;
+        }
+        memmove(client->input, client->input + pos, client->inputLength - pos);
+        client->inputLength -= pos;
+        if (error < 0) {
+            res = -1;
+        }
+    }
+
+    int result = client->result;
+    if (error > H2_NO_ERROR) {
+        h2_send_goaway(conn, 0, error);
+        fprintf(stderr, "Protocol error!");
+        result = 2;
+    }
+    else if (res != 0) {
+        fprintf(stderr, "Connection to the host failed\n");
+        result = 1;
+    }
+    else {
+        h2_send_goaway(conn, 0, H2_NO_ERROR);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!fetches[i].done) {
+            finish_output(&fetches[i]);
+            if (result == 0) {
+                result = 1;
+            }
+        }
+    }
+    hpack_encoder_free(&client->encoder);
+    hpack_decoder_free(&client->decoder);
+    free(client->headerBlock);
+    free(client);
+    return result;
+    }
@@ -0,0 +1,817 @@
+/**
+*@file h2server.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief HTTP/2 connection handling of the server.
+*
+* Serves many concurrent streams over one connection, cleartext or negotiated with ALPN over TLS. Responses are
+* resolved like HTTP/1.1 requests, their bodies are interleaved frame by frame and moved from the file to the socket
+* with sendfile(), which kernel TLS keeps zero-copy on encrypted connections.
+**/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "cache.h"
+#include "h2.h"
+#include "hpack.h"
+#include "proxy.h"
+#include "server.h"
+
+#define MAX_STREAMS 100
+#define INPUT_BUFFER_SIZE (2 * (H2_DEFAULT_FRAME_SIZE + H2_FRAME_HEADER_LENGTH))
+#define IDLE_TIMEOUT 30
+
+struct h2_stream {
+    uint32_t id;
+    bool active;
+    bool remoteClosed;
+    int64_t window;
+    struct response response;
+    off_t sent;
+};
+
+/** State of one HTTP/2 connection, owned by the worker serving it. */
+struct h2_session {
+    struct connection *conn;
+    const struct server_config *config;
+    struct h2_settings peer;
+    struct hpack_decoder decoder;
+    struct hpack_encoder encoder;
+    int64_t window;
+    uint32_t lastStreamId;
+    int activeStreams;
+    size_t nextStream;
+    struct h2_stream streams[MAX_STREAMS];
+
+    uint8_t input[INPUT_BUFFER_SIZE];
+    size_t inputLength;
+    bool prefaceReceived;
+
+    uint8_t *headerBlock;
+    size_t headerBlockLength;
+    size_t headerBlockSize;
+    uint32_t headerStreamId;
+    bool headerEndStream;
+
+    bool goawaySent;
+    bool goawayReceived;
+};
+
+/** Collects the fields of a request while its header block is decoded. */
+struct header_context {
+    struct request request;
+    bool hasMethod;
+    bool hasPath;
+    bool malformed;
+};
+
+static int collect_header(void *ctx, const char *name, size_t nameLength, const char *value, size_t valueLength) {
+    struct header_context *headers = ctx;
+
+    if (nameLength == 7 && memcmp(name, ":method", 7) == 0) {
+        if (headers->hasMethod || valueLength >= sizeof(headers->request.method)) {
+            headers->malformed = true;
+            return 0;
+        }
+        memcpy(headers->request.method, value, valueLength);
+        headers->request.method[valueLength] = '\0';
+        headers->hasMethod = true;
+    }
+    else if (nameLength == 5 && memcmp(name, ":path", 5) == 0) {
+        if (headers->hasPath || valueLength == 0 || value[0] != '/' || valueLength >= sizeof(headers->request.path)) {
+            headers->malformed = true;
+            return 0;
+        }
+        memcpy(headers->request.path, value, valueLength);
+        headers->request.path[valueLength] = '\0';
+        headers->hasPath = true;
+    }
+    else if (nameLength == 10 && memcmp(name, ":authority", 10) == 0) {
+        if (add_request_header(&headers->request, "Host", 4, value, valueLength) != 0) {
+            headers->malformed = true;
+        }
+    }
+    else if (nameLength > 0 && name[0] == ':') {
+        if (!(nameLength == 7 && memcmp(name, ":scheme", 7) == 0)) {
+            headers->malformed = true;
+        }
+    }
+    else if (add_request_header(&headers->request, name, nameLength, value, valueLength) != 0) {
+        headers->malformed = true;
+    }
+    return 0;
+    }
+
+/**
+ * Base64url decoding function.
+ * @brief Decodes the value of an HTTP2-Settings header into a SETTINGS payload.
+ * @return Returns the payload length, or -1 on invalid input.
+ */
+static long decode_settings_header(const char *in, uint8_t *out, size_t size) {
+    uint32_t acc = 0;
+    int bits = 0;
+    long length = 0;
+
+    for (; *in != '\0' && *in != '='; in++) {
+        int v;
+        if (*in >= 'A' && *in <= 'Z') v = *in - 'A';
+        else if (*in >= 'a' && *in <= 'z') v = *in - 'a' + 26;
+        else if (*in >= '0' && *in <= '9') v = *in - '0' + 52;
+        else if (*in == '-' || *in == '+') v = 62;
+        else if (*in == '_' || *in == '/') v = 63;
+        else return -1;
+
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if ((size_t)length >= size) {
+                return -1;
+            }
+            out[length++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return length;
+    }
+
+static struct h2_stream *find_stream(struct h2_session *session, uint32_t id) {
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (session->streams[i].active && session->streams[i].id == id) {
+            return &session->streams[i];
+        }
+    }
+    return NULL;
+    }
+
+/**
+ * Stream closing function.
+ * @brief Releases a stream once its response is complete or it was reset.
+ * @details If the client has not finished its request yet, the stream is reset with NO_ERROR so that the client
+ * stops sending (RFC 9113 section 8.1).
+ */
+static int finish_stream(struct h2_session *session, struct h2_stream *stream, bool reset) {
+    int res = 0;
+    if (reset && !stream->remoteClosed) {
+        res = h2_send_rst_stream(session->conn, stream->id, H2_NO_ERROR);
+    }
+    release_response(&stream->response);
+    stream->active = false;
+    session->activeStreams--;
+    return res;
+    }
+
+/**
+ * Stable field function.
+ * @brief Tells whether a response header field, given in lower case, tends to repeat its value across responses.
+ * Only those are worth a place in the dynamic table; values that change with every response, like date, etag or
+ * set-cookie, would just evict them.
+ */
+static bool is_stable_field(const char *name) {
+    static const char *fields[] = { "content-type", "content-encoding", "content-language", "server",
+                                    "cache-control", "vary", "accept-ranges" };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strcmp(name, fields[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+    }
+
+/**
+ * Forwarded header function.
+ * @brief Encodes the header lines of a proxied or cached response, with their names in lower case as HTTP/2 requires.
+ * @details Fields that do not fit into the remaining space of the header block are dropped. Only stable fields are
+ * indexed, the others are sent as literals.
+ * @return Returns the length of the encoded fields.
+ */
+static size_t encode_forwarded_headers(struct h2_session *session, const struct response *resp, uint8_t *out,
+                                       size_t size) {
+    size_t length = 0;
+    const char *line = resp->headers;
+    const char *headersEnd = resp->headers + resp->headersLength;
+
+    while (line < headersEnd) {
+        const char *end = memchr(line, '\r', headersEnd - line);
+        const char *colon = memchr(line, ':', end - line);
+        char name[256];
+        char value[MAX_HEADERS_LENGTH];
+        size_t nameLength = colon - line;
+        const char *valueStart = colon + 1;
+        while (valueStart < end && *valueStart == ' ') {
+            valueStart++;
+        }
+        if (nameLength < sizeof(name)) {
+            for (size_t i = 0; i < nameLength; i++) {
+                name[i] = (char)tolower((unsigned char)line[i]);
+            }
+            name[nameLength] = '\0';
+            memcpy(value, valueStart, end - valueStart);
+            value[end - valueStart] = '\0';
+            length += hpack_encode(&session->encoder, out + length, size - length, name, value,
+                                   is_stable_field(name));
+        }
+        line = end + 2;
+    }
+    return length;
+    }
+
+/**
+ * Response start function.
+ * @brief Resolves the request of a new stream and sends the HEADERS frame of its response.
+ * @details The body, if any, is sent later by send_data() as flow control permits.
+ * @return Returns 0, or -1 if the connection failed.
+ */
+static int start_response(struct h2_session *session, struct h2_stream *stream, const struct request *req) {
+    struct response *resp = &stream->response;
+    resolve_request(session->config, req, resp);
+
+    uint8_t block[MAX_HEADERS_LENGTH];
+    size_t length = 0;
+    char value[48];
+
+    sprintf(value, "%d", resp->status);
+    length += hpack_encode(&session->encoder, block + length, sizeof(block) - length, ":status", value, true);
+
+    if (resp->headers != NULL) {
+        length += encode_forwarded_headers(session, resp, block + length, sizeof(block) - length);
+        if (resp->cached != NULL) {
+            sprintf(value, "%ld", cache_entry_age(resp->cached));
+            length += hpack_encode(&session->encoder, block + length, sizeof(block) - length, "age", value, false);
+        }
+        else if (resp->archive != NULL) {
+            if (format_date(value, sizeof(value)) != 0) {
+                return -1;
+            }
+            length += hpack_encode(&session->encoder, block + length, sizeof(block) - length, "date", value, false);
+        }
+    }
+    else if (resp->status == 200) {
+        if (format_date(value, sizeof(value)) != 0) {
+            return -1;
+        }
+        length += hpack_encode(&session->encoder, block + length, sizeof(block) - length, "date", value, false);
+        if (resp->contentType != NULL) {
+            length += hpack_encode(&session->encoder, block + length, sizeof(block) - length, "content-type",
+                                   resp->contentType, true);
+        }
+        sprintf(value, "%lld", (long long)resp->length);
+        length += hpack_encode(&session->encoder, block + length, sizeof(block) - length, "content-length", value, false);
+    }
+
+    bool body = response_has_body(resp);
+    uint8_t flags = H2_FLAG_END_HEADERS | (body ? 0 : H2_FLAG_END_STREAM);
+    if (h2_send_frame(session->conn, H2_HEADERS, flags, stream->id, block, length) != 0) {
+        return -1;
+    }
+    if (!body) {
+        return finish_stream(session, stream, true);
+    }
+    return 0;
+    }
+
+static int open_stream(struct h2_session *session, uint32_t id, bool remoteClosed, const struct request *req) {
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        struct h2_stream *stream = &session->streams[i];
+        if (!stream->active) {
+            memset(stream, 0, sizeof(*stream));
+            stream->id = id;
+            stream->active = true;
+            stream->remoteClosed = remoteClosed;
+            stream->window = session->peer.initialWindowSize;
+            stream->response.fd = -1;
+            session->activeStreams++;
+            return start_response(session, stream, req);
+        }
+    }
+    return h2_send_rst_stream(session->conn, id, H2_REFUSED_STREAM);
+    }
+
+/**
+ * Header block completion function.
+ * @brief Decodes a complete header block and opens the stream it belongs to.
+ * @details The block is always decoded, even for refused streams, to keep the HPACK state in sync with the client.
+ * @return Returns H2_NO_ERROR, an error code the connection has to be closed with, or -1 if it failed.
+ */
+static int complete_headers(struct h2_session *session, uint32_t id) {
+    struct header_context headers;
+    memset(&headers, 0, sizeof(headers));
+    init_request(&headers.request, session->conn);
+
+    session->headerStreamId = 0;
+    if (hpack_decode(&session->decoder, session->headerBlock, session->headerBlockLength, collect_header, &headers) != 0) {
+        return H2_COMPRESSION_ERROR;
+    }
+
+    struct h2_stream *stream = find_stream(session, id);
+    if (stream != NULL) {
+        //trailers
+        if (!session->headerEndStream) {
+            return H2_PROTOCOL_ERROR;
+        }
+        stream->remoteClosed = true;
+        return H2_NO_ERROR;
+    }
+    if (id <= session->lastStreamId || id % 2 == 0) {
+        return H2_PROTOCOL_ERROR;
+    }
+    session->lastStreamId = id;
+
+    if (session->goawaySent) {
+        return H2_NO_ERROR;
+    }
+    if (headers.malformed || !headers.hasMethod || !headers.hasPath) {
+        return h2_send_rst_stream(session->conn, id, H2_PROTOCOL_ERROR);
+    }
+    //request bodies are not forwarded to upstreams over HTTP/2
+    headers.request.bodyLength = session->headerEndStream ? 0 : -1;
+    return open_stream(session, id, session->headerEndStream, &headers.request);
+    }
+
+static int append_header_block(struct h2_session *session, const uint8_t *data, size_t length) {
+    if (session->headerBlockLength + length > HPACK_MAX_HEADER_LIST) {
+        return -1;
+    }
+    if (session->headerBlockLength + length > session->headerBlockSize) {
+        size_t size = session->headerBlockLength + length;
+        uint8_t *tmp = realloc(session->headerBlock, size);
+        if (tmp == NULL) {
+            return -1;
+        }
+        session->headerBlock = tmp;
+        session->headerBlockSize = size;
+    }
+    memcpy(session->headerBlock + session->headerBlockLength, data, length);
+    session->headerBlockLength += length;
+    return 0;
+    }
+
+/**
+ * Settings function.
+ * @brief Applies a SETTINGS frame of the client and acknowledges it.
+ * @details A new initial window size changes the window of every open stream by the difference (RFC 9113 section
+ * 6.9.2).
+ */
+static int handle_settings(struct h2_session *session, const struct h2_frame *frame) {
+    if (frame->streamId != 0) {
+        return H2_PROTOCOL_ERROR;
+    }
+    if (frame->flags & H2_FLAG_ACK) {
+        return frame->length == 0 ? H2_NO_ERROR : H2_FRAME_SIZE_ERROR;
+    }
+
+    uint32_t previousWindow = session->peer.initialWindowSize;
+    int error = h2_apply_settings(&session->peer, frame->payload, frame->length);
+    if (error != H2_NO_ERROR) {
+        return error;
+    }
+
+    int64_t delta = (int64_t)session->peer.initialWindowSize - previousWindow;
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (session->streams[i].active) {
+            session->streams[i].window += delta;
+            if (session->streams[i].window > H2_MAX_WINDOW) {
+                return H2_FLOW_CONTROL_ERROR;
+            }
+        }
+    }
+    hpack_encoder_set_max_size(&session->encoder, session->peer.headerTableSize);
+    return h2_send_frame(session->conn, H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+    }
+
+static int handle_window_update(struct h2_session *session, const struct h2_frame *frame) {
+    if (frame->length != 4) {
+        return H2_FRAME_SIZE_ERROR;
+    }
+    uint32_t increment = h2_read_u32(frame->payload) & 0x7fffffff;
+
+    if (frame->streamId == 0) {
+        if (increment == 0) {
+            return H2_PROTOCOL_ERROR;
+        }
+        session->window += increment;
+        return session->window > H2_MAX_WINDOW ? H2_FLOW_CONTROL_ERROR : H2_NO_ERROR;
+    }
+
+    struct h2_stream *stream = find_stream(session, frame->streamId);
+    if (stream == NULL) {
+        return frame->streamId > session->lastStreamId ? H2_PROTOCOL_ERROR : H2_NO_ERROR;
+    }
+    if (increment == 0 || stream->window + increment > H2_MAX_WINDOW) {
+        int res = h2_send_rst_stream(session->conn, stream->id, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+        finish_stream(session, stream, false);
+        return res;
+    }
+    stream->window += increment;
+    return H2_NO_ERROR;
+    }
+
+/**
+ * Request body function.
+ * @brief Discards DATA sent by the client and gives the flow-control credit back right away.
+ */
+static int handle_data(struct h2_session *session, struct h2_frame *frame) {
+    uint32_t flowLength = frame->length;
+
+    if (frame->streamId == 0 || h2_strip_padding(frame) != 0) {
+        return H2_PROTOCOL_ERROR;
+    }
+    if (frame->streamId > session->lastStreamId) {
+        return H2_PROTOCOL_ERROR;
+    }
+
+    if (flowLength > 0 && h2_send_window_update(session->conn, 0, flowLength) != 0) {
+        return -1;
+    }
+
+    struct h2_stream *stream = find_stream(session, frame->streamId);
+    if (stream == NULL || stream->remoteClosed) {
+        return h2_send_rst_stream(session->conn, frame->streamId, H2_STREAM_CLOSED);
+    }
+    if (frame->flags & H2_FLAG_END_STREAM) {
+        stream->remoteClosed = true;
+    }
+    else if (flowLength > 0) {
+        return h2_send_window_update(session->conn, stream->id, flowLength);
+    }
+    return H2_NO_ERROR;
+    }
+
+/**
+ * Frame dispatch function.
+ * @brief Processes one frame received from the client.
+ * @return Returns H2_NO_ERROR, an error code the connection has to be closed with, or -1 if it failed.
+ */
+static int handle_frame(struct h2_session *session, struct h2_frame *frame) {
+    if (session->headerStreamId != 0 &&
+        (frame->type != H2_CONTINUATION || frame->streamId != session->headerStreamId)) {
+        return H2_PROTOCOL_ERROR;
+    }
+
+    switch (frame->type) {
+        case H2_DATA:
+            return handle_data(session, frame);
+        case H2_HEADERS:
+            if (frame->streamId == 0 || h2_strip_padding(frame) != 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            if (frame->flags & H2_FLAG_PRIORITY) {
+                if (frame->length < 5) {
+                    return H2_FRAME_SIZE_ERROR;
+                }
+                frame->payload += 5;
+                frame->length -= 5;
+            }
+            session->headerBlockLength = 0;
+            session->headerEndStream = (frame->flags & H2_FLAG_END_STREAM) != 0;
+            if (append_header_block(session, frame->payload, frame->length) != 0) {
+                return H2_ENHANCE_YOUR_CALM;
+            }
+            if (frame->flags & H2_FLAG_END_HEADERS) {
+                return complete_headers(session, frame->streamId);
+            }
+            session->headerStreamId = frame->streamId;
+            return H2_NO_ERROR;
+        case H2_CONTINUATION:
+            if (session->headerStreamId == 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            if (append_header_block(session, frame->payload, frame->length) != 0) {
+                return H2_ENHANCE_YOUR_CALM;
+            }
+            if (frame->flags & H2_FLAG_END_HEADERS) {
+                return complete_headers(session, frame->streamId);
+            }
+            return H2_NO_ERROR;
+        case H2_PRIORITY:
+            if (frame->streamId == 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            return frame->length == 5 ? H2_NO_ERROR : H2_FRAME_SIZE_ERROR;
+        case H2_RST_STREAM: {
+            if (frame->length != 4) {
+                return H2_FRAME_SIZE_ERROR;
+            }
+            if (frame->streamId == 0 || frame->streamId > session->lastStreamId) {
+                return H2_PROTOCOL_ERROR;
+            }
+            struct h2_stream *stream = find_stream(session, frame->streamId);
+            if (stream != NULL) {
+                finish_stream(session, stream, false);
+            }
+            return H2_NO_ERROR;
+        }
+        case H2_SETTINGS:
+            return handle_settings(session, frame);
+        case H2_PUSH_PROMISE:
+            return H2_PROTOCOL_ERROR;
+        case H2_PING:
+            if (frame->length != 8) {
+                return H2_FRAME_SIZE_ERROR;
+            }
+            if (frame->streamId != 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            if (frame->flags & H2_FLAG_ACK) {
+                return H2_NO_ERROR;
+            }
+            return h2_send_frame(session->conn, H2_PING, H2_FLAG_ACK, 0, frame->payload, 8);
+        case H2_GOAWAY:
+            if (frame->streamId != 0) {
+                return H2_PROTOCOL_ERROR;
+            }
+            session->goawayReceived = true;
+            return H2_NO_ERROR;
+        case H2_WINDOW_UPDATE:
+            return handle_window_update(session, frame);
+        default:
+            //unknown frame types are ignored
+            return H2_NO_ERROR;
+    }
+    }
+
+/**
+ * Input processing function.
+ * @brief Checks the connection preface and handles every complete frame in the input buffer.
+ * @return Returns H2_NO_ERROR, an error code the connection has to be closed with, or -1 if it failed.
+ */
+static int process_input(struct h2_session *session) {
+    size_t pos = 0;
+    int res = H2_NO_ERROR;
+
+    if (!session->prefaceReceived) {
+        if (session->inputLength < H2_PREFACE_LENGTH) {
+            return memcmp(session->input, H2_PREFACE, session->inputLength) == 0 ? H2_NO_ERROR : H2_PROTOCOL_ERROR;
+        }
+        if (memcmp(session->input, H2_PREFACE, H2_PREFACE_LENGTH) != 0) {
+            return H2_PROTOCOL_ERROR;
+        }
+        session->prefaceReceived = true;
+        pos = H2_PREFACE_LENGTH;
+    }
+
+    while (res == H2_NO_ERROR && session->inputLength - pos >= H2_FRAME_HEADER_LENGTH) {
+        struct h2_frame frame;
+        h2_parse_frame_header(session->input + pos, &frame);
+        if (frame.length > H2_DEFAULT_FRAME_SIZE) {
+            return H2_FRAME_SIZE_ERROR;
+        }
+        if (session->inputLength - pos < H2_FRAME_HEADER_LENGTH + frame.length) {
+            break;
+        }
+        //handling strips padding and priority fields off 'frame', the frame on the wire keeps its length
+        size_t frameLength = H2_FRAME_HEADER_LENGTH + frame.length;
+        res = handle_frame(session, &frame);
+        pos += frameLength;
+    }
+
+    memmove(session->input, session->input + pos, session->inputLength - pos);
+    session->inputLength -= pos;
+    return res;
+    }
+
+static bool has_pending_data(const struct h2_session *session) {
+    //after an upgrade the body of stream 1 waits for the client preface, clients buffer little before it
+    if (session->window <= 0 || !session->prefaceReceived) {
+        return false;
+    }
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        const struct h2_stream *stream = &session->streams[i];
+        if (stream->active && response_has_body(&stream->response) && stream->window > 0) {
+            return true;
+        }
+    }
+    return false;
+    }
+
+/**
+ * Proxied body function.
+ * @brief Reads up to 'chunk' bytes of the body of an upstream response and sends them as one DATA frame.
+ * @details Over a connection that takes spliced data, the payload is spliced into the pipe of the response first,
+ * the frame header is corked once its length is known and the payload follows from the pipe. The end of a body of
+ * unknown length is only noticed on the read after its last bytes, it is then marked with an empty DATA frame. An
+ * upstream failing midway resets the stream.
+ * @return Returns 0, or -1 if the connection failed.
+ */
+static int send_upstream_data(struct h2_session *session, struct h2_stream *stream, off_t chunk) {
+    uint8_t buffer[H2_FRAME_HEADER_LENGTH + H2_DEFAULT_FRAME_SIZE];
+    struct upstream_response *ur = stream->response.upstream;
+    bool zeroCopy = conn_can_splice(session->conn) && upstream_open_pipe(ur) == 0;
+
+    size_t capacity = zeroCopy ? UPSTREAM_SPLICE_SIZE : sizeof(buffer) - H2_FRAME_HEADER_LENGTH;
+    if ((size_t)chunk < capacity) {
+        capacity = chunk;
+    }
+    ssize_t n = zeroCopy ? upstream_splice_body(ur, capacity) :
+                         upstream_read_body(ur, buffer + H2_FRAME_HEADER_LENGTH, capacity);
+    if (n < 0) {
+        int res = h2_send_rst_stream(session->conn, stream->id, H2_INTERNAL_ERROR);
+        finish_stream(session, stream, false);
+        return res;
+    }
+
+    bool last = ur->done;
+    h2_pack_frame_header(buffer, (uint32_t)n, H2_DATA, last ? H2_FLAG_END_STREAM : 0, stream->id);
+    if (zeroCopy) {
+        if (conn_send_all(session->conn, buffer, H2_FRAME_HEADER_LENGTH, n > 0 ? MSG_MORE : 0) != 0 ||
+            (n > 0 && conn_splice(session->conn, ur->pipe[0], n, 0) != 0)) {
+            return -1;
+        }
+    }
+    else {
+        struct iovec iov = { buffer, H2_FRAME_HEADER_LENGTH + (size_t)n };
+        if (conn_sendv(session->conn, &iov, 1) != 0) {
+            return -1;
+        }
+    }
+    stream->sent += n;
+    stream->window -= n;
+    session->window -= n;
+    if (last) {
+        return finish_stream(session, stream, true);
+    }
+    return 0;
+    }
+
+/**
+ * Body transmission function.
+ * @brief Sends at most one DATA frame for every stream that has body left and flow-control credit.
+ * @details Going round the streams one frame at a time keeps a large file from holding up the small responses
+ * multiplexed next to it. The frame header is corked with MSG_MORE and the payload follows, via sendfile() for files.
+ * @return Returns 0, or -1 if the connection failed.
+ */
+static int send_data(struct h2_session *session) {
+    for (int n = 0; n < MAX_STREAMS && session->window > 0; n++) {
+        struct h2_stream *stream = &session->streams[(session->nextStream + n) % MAX_STREAMS];
+        if (!stream->active || !response_has_body(&stream->response) || stream->window <= 0) {
+            continue;
+        }
+
+        off_t remaining = stream->response.length >= 0 ? stream->response.length - stream->sent : H2_MAX_FRAME_SIZE;
+        off_t chunk = remaining;
+        if (chunk > session->peer.maxFrameSize) {
+            chunk = session->peer.maxFrameSize;
+        }
+        if (chunk > stream->window) {
+            chunk = stream->window;
+        }
+        if (chunk > session->window) {
+            chunk = session->window;
+        }
+        bool last = chunk == remaining;
+
+        if (stream->response.upstream != NULL) {
+            int res = send_upstream_data(session, stream, chunk);
+            if (res < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        uint8_t header[H2_FRAME_HEADER_LENGTH];
+        h2_pack_frame_header(header, (uint32_t)chunk, H2_DATA, last ? H2_FLAG_END_STREAM : 0, stream->id);
+        if (conn_send_all(session->conn, header, sizeof(header), MSG_MORE) != 0) {
+            return -1;
+        }
+        //the frame length is already on the wire, a short file leaves no way to recover
+        if (send_response_body(session->conn, &stream->response, stream->sent, chunk) != 0) {
+            perror("sendfile() failed");
+            return -1;
+        }
+
+        stream->sent += chunk;
+        stream->window -= chunk;
+        session->window -= chunk;
+        if (last && finish_stream(session, stream, true) != 0) {
+            return -1;
+        }
+    }
+    session->nextStream = (session->nextStream + 1) % MAX_STREAMS;
+    return 0;
+    }
+
+/**
+ * HTTP/2 connection function.
+ * @brief Serves an HTTP/2 connection until the client goes away, an error occurs or the server shuts down.
+ * @details Incoming frames are handled as they arrive while the bodies of all open streams are sent in turns.
+ * A shutdown is announced with GOAWAY and open streams are finished first.
+ * @param conn The connection.
+ * @param config The server configuration.
+ * @param initial Bytes already read from the connection, starting with the client preface if it has been sent.
+ * @param initialLength The number of bytes in 'initial'.
+ * @param upgraded The request of an 'h2c' upgrade, which becomes stream 1, or NULL.
+ * @param upgradeSettings The HTTP2-Settings header of the upgrade request, or NULL.
+ * @return Returns 0, or -1 if the connection ended with an error.
+ */
+int h2_serve_connection(struct connection *conn, const struct server_config *config, const char *initial, size_t initialLength,
+                        const struct request *upgraded, const char *upgradeSettings) {
+    struct h2_session *session = calloc(1, sizeof(struct h2_session));
+    if (session == NULL || initialLength > INPUT_BUFFER_SIZE) {
+        free(session);
+        return -1;
+    }
+    session->conn = conn;
+    session->config = config;
+    session->window = H2_DEFAULT_WINDOW;
+    h2_settings_init(&session->peer);
+    hpack_decoder_init(&session->decoder, HPACK_DEFAULT_TABLE_SIZE);
+    hpack_encoder_init(&session->encoder, HPACK_DEFAULT_TABLE_SIZE);
+    memcpy(session->input, initial, initialLength);
+    session->inputLength = initialLength;
+
+    int error = H2_NO_ERROR;
+    if (upgradeSettings != NULL) {
+        uint8_t payload[256];
+        long length = decode_settings_header(upgradeSettings, payload, sizeof(payload));
+        error = length < 0 ? H2_PROTOCOL_ERROR : h2_apply_settings(&session->peer, payload, length);
+        hpack_encoder_set_max_size(&session->encoder, session->peer.headerTableSize);
+    }
+
+    uint8_t settings[6] = { 0, H2_SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, MAX_STREAMS };
+    int res = h2_send_frame(conn, H2_SETTINGS, 0, 0, settings, sizeof(settings));
+    if (res == 0 && error == H2_NO_ERROR && upgraded != NULL) {
+        session->lastStreamId = 1;
+        res = open_stream(session, 1, true, upgraded);
+    }
+
+    time_t idleSince = time(NULL);
+    while (res == 0 && error == H2_NO_ERROR) {
+        error = process_input(session);
+        if (error < 0) {
+            res = -1;
+            break;
+        }
+        if (error != H2_NO_ERROR) {
+            break;
+        }
+
+        if (run == 0 && !session->goawaySent) {
+            session->goawaySent = true;
+            res = h2_send_goaway(conn, session->lastStreamId, H2_NO_ERROR);
+        }
+        if (session->activeStreams > 0) {
+            idleSince = time(NULL);
+        }
+        else if (session->goawaySent || session->goawayReceived) {
+            break;
+        }
+        else if (time(NULL) - idleSince >= IDLE_TIMEOUT) {
+            session->goawaySent = true;
+            h2_send_goaway(conn, session->lastStreamId, H2_NO_ERROR);
+            break;
+        }
+
+        bool pending = has_pending_data(session);
+        struct pollfd pfd = { conn->fd, POLLIN, 0 };
+        int ready = conn_pending(conn) ? 1 : 0;
+        if (ready == 0 && !pending && conn->spinBudget > 0) {
+            ready = conn_busy_poll(&pfd, 1, conn->spinBudget);
+        }
+        if (ready == 0) {
+            ready = poll(&pfd, 1, pending ? 0 : 1000);
+        }
+        if (ready < 0 && errno != EINTR) {
+            res = -1;
+            break;
+        }
+        if (ready > 0 && (conn_pending(conn) || (pfd.revents & (POLLIN | POLLHUP | POLLERR)))) {
+            ssize_t n = conn_recv(conn, session->input + session->inputLength, INPUT_BUFFER_SIZE - session->inputLength);
+            if (n <= 0) {
+                res = n < 0 ? -1 : 0;
+                break;
+            }
+            session->inputLength += n;
+        }
+        if (pending && send_data(session) != 0) {
+            res = -1;
+            break;
+        }
+    }
+
+    if (error > H2_NO_ERROR) {
+        h2_send_goaway(conn, session->lastStreamId, error);
+        res = -1;
+    }
+
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        if (session->streams[i].active) {
+            release_response(&session->streams[i].response);
+        }
+    }
+    hpack_decoder_free(&session->decoder);
+    hpack_encoder_free(&session->encoder);
+    free(session->headerBlock);
+    free(session);
+    return res;
+    }
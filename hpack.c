@@ -0,0 +1,669 @@
+/**
+*@file hpack.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief HPACK header compression.
+*
+* Implements the static and dynamic tables, prefix integers, string literals and the Huffman code of RFC 7541.
+**/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpack.h"
+
+#define STATIC_TABLE_LENGTH 61
+
+static const struct { const char *name; const char *value; } staticTable[STATIC_TABLE_LENGTH] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+/** Huffman codes of RFC 7541 Appendix B, symbol 256 is EOS. */
+static const uint32_t huffmanCodes[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5,
+    0xfffffe6, 0xfffffe7, 0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9,
+    0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec, 0xfffffed, 0xfffffee,
+    0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9,
+    0xffffffa, 0xffffffb, 0x14, 0x3f8, 0x3f9, 0xffa,
+    0x1ff9, 0x15, 0xf8, 0x7fa, 0x3fa, 0x3fb,
+    0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b,
+    0x1c, 0x1d, 0x1e, 0x1f, 0x5c, 0xfb,
+    0x7ffc, 0x20, 0xffb, 0x3fc, 0x1ffa, 0x21,
+    0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e,
+    0x6f, 0x70, 0x71, 0x72, 0xfc, 0x73,
+    0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5,
+    0x25, 0x26, 0x27, 0x6, 0x74, 0x75,
+    0x28, 0x29, 0x2a, 0x7, 0x2b, 0x76,
+    0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd,
+    0x1ffd, 0xffffffc, 0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8,
+    0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9, 0x3fffd6, 0x7fffda,
+    0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1,
+    0x7fffe2, 0x7fffe3, 0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5,
+    0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef, 0x3fffda, 0x1fffdd,
+    0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf,
+    0x7fffeb, 0x7fffec, 0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2,
+    0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef, 0xfffea, 0x3fffe2,
+    0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2,
+    0x3fffe8, 0x1ffffec, 0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde,
+    0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed, 0x7fff2, 0x1fffe3,
+    0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3,
+    0x7ffffe4, 0x7ffffe5, 0xfffec, 0xfffff3, 0xfffed, 0x1fffe6,
+    0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3, 0x3fffea, 0x3fffeb,
+    0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8,
+    0x7ffffe9, 0x7ffffea, 0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed,
+    0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee, 0x3fffffff,
+};
+
+static const uint8_t huffmanCodeLength[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+/** The code is canonical, so decoding only needs the symbols ordered by code and the number of codes per length. */
+static const uint16_t huffmanSymbols[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37,
+    45, 46, 47, 51, 52, 53, 54, 55, 56, 57, 61, 65,
+    95, 98, 100, 102, 103, 104, 108, 109, 110, 112, 114, 117,
+    58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+    77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89,
+    106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44, 59,
+    88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35, 62,
+    0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+    195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161,
+    167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129,
+    132, 133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170,
+    173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+    233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+    151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182,
+    183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159,
+    171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+    200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243,
+    255, 203, 204, 211, 212, 214, 221, 222, 223, 241, 244, 245,
+    246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5,
+    6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+    21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220,
+    249, 10, 13, 22, 256,
+};
+
+static const uint16_t huffmanCount[31] = {
+    0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3,
+    0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4
+};
+
+/** Output cursor used while encoding, 'overflow' is set instead of writing past the end. */
+struct writer {
+    uint8_t *out;
+    size_t size;
+    size_t pos;
+    bool overflow;
+};
+
+static void table_init(struct hpack_table *table, size_t maxSize) {
+    table->capacity = maxSize / 32 + 1;
+    table->entries = calloc(table->capacity, sizeof(struct hpack_entry));
+    table->count = 0;
+    table->head = 0;
+    table->size = 0;
+    table->maxSize = maxSize;
+    }
+
+static void table_evict(struct hpack_table *table) {
+    size_t oldest = (table->head + table->capacity - (table->count - 1)) % table->capacity;
+    struct hpack_entry *entry = &table->entries[oldest];
+
+    table->size -= entry->nameLength + entry->valueLength + 32;
+    free(entry->name);
+    free(entry->value);
+    entry->name = NULL;
+    entry->value = NULL;
+    table->count--;
+    }
+
+static void table_free(struct hpack_table *table) {
+    while (table->count > 0) {
+        table_evict(table);
+        }
+    free(table->entries);
+    table->entries = NULL;
+    }
+
+static void table_resize(struct hpack_table *table, size_t maxSize) {
+    table->maxSize = maxSize;
+    while (table->count > 0 && table->size > table->maxSize) {
+        table_evict(table);
+        }
+    }
+
+/**
+ * Table insertion function.
+ * @brief Adds an entry, evicting the oldest ones until it fits (RFC 7541 section 4.4).
+ * @details The strings are copied before eviction, since 'name' may point into an entry that is about to be evicted.
+ * @return Returns 0, or -1 when memory runs out.
+ */
+static int table_add(struct hpack_table *table, const char *name, size_t nameLength, const char *value, size_t valueLength) {
+    size_t entrySize = nameLength + valueLength + 32;
+    char *nameCopy = malloc(nameLength + 1);
+    char *valueCopy = malloc(valueLength + 1);
+    if (nameCopy == NULL || valueCopy == NULL) {
+        free(nameCopy);
+        free(valueCopy);
+        return -1;
+        }
+    memcpy(nameCopy, name, nameLength);
+    nameCopy[nameLength] = '\0';
+    memcpy(valueCopy, value, valueLength);
+    valueCopy[valueLength] = '\0';
+
+    while (table->count > 0 && table->size + entrySize > table->maxSize) {
+        table_evict(table);
+        }
+    if (entrySize > table->maxSize || table->count == table->capacity) {
+        free(nameCopy);
+        free(valueCopy);
+        return 0;
+        }
+
+    table->head = (table->head + 1) % table->capacity;
+    struct hpack_entry *entry = &table->entries[table->head];
+    entry->name = nameCopy;
+    entry->nameLength = nameLength;
+    entry->value = valueCopy;
+    entry->valueLength = valueLength;
+    table->size += entrySize;
+    table->count++;
+    return 0;
+    }
+
+/**
+ * Index lookup function.
+ * @brief Resolves an index of the combined static and dynamic table address space.
+ * @return Returns 0, or -1 if the index is out of range.
+ */
+static int table_get(const struct hpack_table *table, uint32_t index, const char **name, size_t *nameLength,
+                     const char **value, size_t *valueLength) {
+    if (index == 0) {
+        return -1;
+        }
+    if (index <= STATIC_TABLE_LENGTH) {
+        *name = staticTable[index - 1].name;
+        *nameLength = strlen(*name);
+        *value = staticTable[index - 1].value;
+        *valueLength = strlen(*value);
+        return 0;
+        }
+    index -= STATIC_TABLE_LENGTH + 1;
+    if (index >= table->count) {
+        return -1;
+        }
+    const struct hpack_entry *entry = &table->entries[(table->head + table->capacity - index) % table->capacity];
+    *name = entry->name;
+    *nameLength = entry->nameLength;
+    *value = entry->value;
+    *valueLength = entry->valueLength;
+    return 0;
+    }
+
+static int decode_integer(const uint8_t **pos, const uint8_t *end, int prefix, uint32_t *value) {
+    uint32_t mask = (1u << prefix) - 1;
+    uint32_t result = **pos & mask;
+    (*pos)++;
+    if (result < mask) {
+        *value = result;
+        return 0;
+        }
+
+    int shift = 0;
+    while (*pos < end) {
+        uint8_t b = **pos;
+        (*pos)++;
+        if (shift > 21) {
+            return -1;
+            }
+        result += (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+        if ((b & 0x80) == 0) {
+            *value = result;
+            return 0;
+            }
+        }
+    return -1;
+    }
+
+/**
+ * Huffman decoding function.
+ * @brief Decodes 'length' octets into 'out', which has to hold at least length * 8 / 5 bytes.
+ * @details Walks the canonical code bit by bit. Padding longer than 7 bits, padding that is not a prefix of EOS and
+ * a decoded EOS are errors (RFC 7541 section 5.2).
+ * @return Returns the decoded length, or -1 on a malformed string.
+ */
+static long huffman_decode(const uint8_t *in, size_t length, char *out) {
+    long produced = 0;
+    uint32_t code = 0, first = 0, index = 0;
+    int bits = 0;
+    bool allOnes = true;
+
+    for (size_t i = 0; i < length; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (in[i] >> bit) & 1;
+            code |= b;
+            bits++;
+            allOnes = allOnes && b;
+
+            uint32_t count = huffmanCount[bits];
+            if (code - first < count) {
+                uint16_t symbol = huffmanSymbols[index + code - first];
+                if (symbol == 256) {
+                    return -1;
+                    }
+                out[produced++] = (char)symbol;
+                code = first = index = 0;
+                bits = 0;
+                allOnes = true;
+                continue;
+                }
+            if (bits == 30) {
+                return -1;
+                }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+            }
+        }
+
+    if (bits > 7 || !allOnes) {
+        return -1;
+        }
+    return produced;
+    }
+
+/** Grows the scratch buffer of 'decoder' to at least 'needed' bytes, which may move it. */
+static int reserve_scratch(struct hpack_decoder *decoder, size_t needed) {
+    if (needed > decoder->scratchSize) {
+        char *tmp = realloc(decoder->scratch, needed);
+        if (tmp == NULL) {
+            return -1;
+            }
+        decoder->scratch = tmp;
+        decoder->scratchSize = needed;
+        }
+    return 0;
+    }
+
+/**
+ * String literal decoding function.
+ * @brief Reads a string literal, decoding Huffman data into the scratch buffer at 'offset'.
+ * @details Plain literals point straight into the header block, so the result may move if the scratch buffer grows.
+ * @return Returns 0, or -1 on malformed input.
+ */
+static int decode_string(struct hpack_decoder *decoder, const uint8_t **pos, const uint8_t *end, size_t offset,
+                         const char **out, size_t *outLength, bool *inScratch) {
+    if (*pos >= end) {
+        return -1;
+        }
+    bool huffman = (**pos & 0x80) != 0;
+    uint32_t length;
+    if (decode_integer(pos, end, 7, &length) != 0 || length > (size_t)(end - *pos) || length > HPACK_MAX_HEADER_LIST) {
+        return -1;
+        }
+
+    if (!huffman) {
+        *out = (const char *)*pos;
+        *outLength = length;
+        *inScratch = false;
+        *pos += length;
+        return 0;
+        }
+
+    if (reserve_scratch(decoder, offset + (size_t)length * 8 / 5 + 1) != 0) {
+        return -1;
+        }
+    long decoded = huffman_decode(*pos, length, decoder->scratch + offset);
+    if (decoded < 0) {
+        return -1;
+        }
+    *out = decoder->scratch + offset;
+    *outLength = (size_t)decoded;
+    *inScratch = true;
+    *pos += length;
+    return 0;
+    }
+
+void hpack_decoder_init(struct hpack_decoder *decoder, size_t maxSize) {
+    table_init(&decoder->table, maxSize);
+    decoder->settingsMaxSize = maxSize;
+    decoder->scratch = NULL;
+    decoder->scratchSize = 0;
+    }
+
+void hpack_decoder_free(struct hpack_decoder *decoder) {
+    table_free(&decoder->table);
+    free(decoder->scratch);
+    decoder->scratch = NULL;
+    }
+
+/**
+ * Header block decoding function.
+ * @brief Decodes a complete header block and hands every field to 'callback' in order.
+ * @details Any failure leaves the decoder state out of sync with the peer and must be treated as a connection
+ * error of type COMPRESSION_ERROR.
+ * @param decoder The decoder of the connection.
+ * @param block The concatenated header block fragments.
+ * @param length The length of the block.
+ * @param callback Function receiving the fields.
+ * @param ctx Passed through to the callback.
+ * @return Returns 0, -1 on a malformed block, or the non-zero value returned by the callback.
+ */
+int hpack_decode(struct hpack_decoder *decoder, const uint8_t *block, size_t length, hpack_header_cb callback, void *ctx) {
+    const uint8_t *pos = block;
+    const uint8_t *end = block + length;
+    size_t listSize = 0;
+    bool fieldSeen = false;
+
+    while (pos < end) {
+        const char *name, *value;
+        size_t nameLength, valueLength;
+        uint32_t index;
+        uint8_t b = *pos;
+
+        if (b & 0x80) {
+            if (decode_integer(&pos, end, 7, &index) != 0 ||
+                table_get(&decoder->table, index, &name, &nameLength, &value, &valueLength) != 0) {
+                return -1;
+                }
+            }
+        else if ((b & 0xe0) == 0x20) {
+            if (fieldSeen || decode_integer(&pos, end, 5, &index) != 0 || index > decoder->settingsMaxSize) {
+                return -1;
+                }
+            table_resize(&decoder->table, index);
+            continue;
+            }
+        else {
+            bool incremental = (b & 0x40) != 0;
+            bool nameInScratch = false, valueInScratch;
+            if (decode_integer(&pos, end, incremental ? 6 : 4, &index) != 0) {
+                return -1;
+                }
+            if (index != 0) {
+                const char *unused;
+                size_t unusedLength;
+                if (table_get(&decoder->table, index, &name, &nameLength, &unused, &unusedLength) != 0) {
+                    return -1;
+                    }
+                }
+            else if (decode_string(decoder, &pos, end, 0, &name, &nameLength, &nameInScratch) != 0) {
+                return -1;
+                }
+            if (decode_string(decoder, &pos, end, nameInScratch ? nameLength : 0, &value, &valueLength,
+                              &valueInScratch) != 0) {
+                return -1;
+                }
+            if (nameInScratch) {
+                name = decoder->scratch;
+                if (valueInScratch) {
+                    value = decoder->scratch + nameLength;
+                    }
+                }
+            else if (incremental && index > STATIC_TABLE_LENGTH) {
+                //adding the field may evict the entry the name points into, so the callback gets a copy
+                size_t offset = valueInScratch ? valueLength : 0;
+                if (reserve_scratch(decoder, offset + nameLength) != 0) {
+                    return -1;
+                    }
+                memcpy(decoder->scratch + offset, name, nameLength);
+                name = decoder->scratch + offset;
+                if (valueInScratch) {
+                    value = decoder->scratch;
+                    }
+                }
+            if (incremental && table_add(&decoder->table, name, nameLength, value, valueLength) != 0) {
+                return -1;
+                }
+            }
+
+        fieldSeen = true;
+        listSize += nameLength + valueLength + 32;
+        if (listSize > HPACK_MAX_HEADER_LIST) {
+            return -1;
+            }
+        int res = callback(ctx, name, nameLength, value, valueLength);
+        if (res != 0) {
+            return res;
+            }
+        }
+    return 0;
+    }
+
+static void emit_byte(struct writer *w, uint8_t b) {
+    if (w->pos >= w->size) {
+        w->overflow = true;
+        return;
+        }
+    w->out[w->pos++] = b;
+    }
+
+static void emit_integer(struct writer *w, uint8_t flags, int prefix, uint32_t value) {
+    uint32_t mask = (1u << prefix) - 1;
+    if (value < mask) {
+        emit_byte(w, flags | (uint8_t)value);
+        return;
+        }
+    emit_byte(w, flags | (uint8_t)mask);
+    value -= mask;
+    while (value >= 0x80) {
+        emit_byte(w, (uint8_t)((value & 0x7f) | 0x80));
+        value >>= 7;
+        }
+    emit_byte(w, (uint8_t)value);
+    }
+
+/** Emits a string literal, Huffman coded whenever that is shorter. */
+static void emit_string(struct writer *w, const char *s, size_t length) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < length; i++) {
+        bits += huffmanCodeLength[(uint8_t)s[i]];
+        }
+    size_t huffmanLength = (size_t)((bits + 7) / 8);
+
+    if (huffmanLength >= length) {
+        emit_integer(w, 0x00, 7, (uint32_t)length);
+        for (size_t i = 0; i < length; i++) {
+            emit_byte(w, (uint8_t)s[i]);
+            }
+        return;
+        }
+
+    emit_integer(w, 0x80, 7, (uint32_t)huffmanLength);
+    uint64_t acc = 0;
+    int pending = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t symbol = (uint8_t)s[i];
+        acc = (acc << huffmanCodeLength[symbol]) | huffmanCodes[symbol];
+        pending += huffmanCodeLength[symbol];
+        while (pending >= 8) {
+            pending -= 8;
+            emit_byte(w, (uint8_t)(acc >> pending));
+            }
+        }
+    if (pending > 0) {
+        emit_byte(w, (uint8_t)((acc << (8 - pending)) | (0xff >> pending)));
+        }
+    }
+
+void hpack_encoder_init(struct hpack_encoder *encoder, size_t maxSize) {
+    table_init(&encoder->table, maxSize);
+    encoder->sizeUpdate = false;
+    }
+
+/**
+ * Table size function.
+ * @brief Applies the peer's SETTINGS_HEADER_TABLE_SIZE.
+ * @details The encoder never grows beyond the size it was created with, a change is signalled at the start of
+ * the next header block.
+ */
+void hpack_encoder_set_max_size(struct hpack_encoder *encoder, size_t maxSize) {
+    size_t limit = (encoder->table.capacity - 1) * 32;
+    if (maxSize > limit) {
+        maxSize = limit;
+        }
+    if (maxSize != encoder->table.maxSize) {
+        table_resize(&encoder->table, maxSize);
+        encoder->sizeUpdate = true;
+        }
+    }
+
+void hpack_encoder_free(struct hpack_encoder *encoder) {
+    table_free(&encoder->table);
+    }
+
+/**
+ * Header field encoding function.
+ * @brief Appends one field to a header block, using the smallest representation the tables allow.
+ * @details Fields with 'index' set are added to the dynamic table so that repeated values on later streams shrink
+ * to a single byte; values that change on every response should be passed with 'index' unset.
+ * @param encoder The encoder of the connection.
+ * @param out The output buffer.
+ * @param outSize Space left in the output buffer.
+ * @param name The lowercase field name.
+ * @param value The field value.
+ * @param index Whether the field should be added to the dynamic table.
+ * @return Returns the number of bytes written, or 0 if 'out' is too small.
+ */
+size_t hpack_encode(struct hpack_encoder *encoder, uint8_t *out, size_t outSize, const char *name, const char *value, bool index) {
+    struct writer w = { out, outSize, 0, false };
+    size_t nameLength = strlen(name);
+    size_t valueLength = strlen(value);
+
+    if (encoder->sizeUpdate) {
+        emit_integer(&w, 0x20, 5, (uint32_t)encoder->table.maxSize);
+        }
+
+    uint32_t fullMatch = 0, nameMatch = 0;
+    uint32_t total = STATIC_TABLE_LENGTH + (uint32_t)encoder->table.count;
+    for (uint32_t i = 1; i <= total && fullMatch == 0; i++) {
+        const char *entryName, *entryValue;
+        size_t entryNameLength, entryValueLength;
+        table_get(&encoder->table, i, &entryName, &entryNameLength, &entryValue, &entryValueLength);
+        if (entryNameLength != nameLength || memcmp(entryName, name, nameLength) != 0) {
+            continue;
+            }
+        if (entryValueLength == valueLength && memcmp(entryValue, value, valueLength) == 0) {
+            fullMatch = i;
+            }
+        else if (nameMatch == 0) {
+            nameMatch = i;
+            }
+        }
+
+    if (fullMatch != 0) {
+        emit_integer(&w, 0x80, 7, fullMatch);
+        }
+    else {
+        if (index) {
+            emit_integer(&w, 0x40, 6, nameMatch);
+            }
+        else {
+            emit_integer(&w, 0x00, 4, nameMatch);
+            }
+        if (nameMatch == 0) {
+            emit_string(&w, name, nameLength);
+            }
+        emit_string(&w, value, valueLength);
+        }
+
+    if (w.overflow) {
+        return 0;
+        }
+    encoder->sizeUpdate = false;
+    if (fullMatch == 0 && index) {
+        table_add(&encoder->table, name, nameLength, value, valueLength);
+        }
+    return w.pos;
+    }
@@ -0,0 +1,66 @@
+/**
+*@file hpack.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief HPACK header compression.
+*
+* Encoder and decoder for HTTP/2 header blocks as described in RFC 7541, shared by server and client.
+**/
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+#define HPACK_MAX_HEADER_LIST 65536
+
+/** A single name/value pair held in a dynamic table. */
+struct hpack_entry {
+    char *name;
+    char *value;
+    size_t nameLength;
+    size_t valueLength;
+};
+
+/** Dynamic table kept as a ring buffer, the newest entry sits at 'head'. */
+struct hpack_table {
+    struct hpack_entry *entries;
+    size_t capacity;
+    size_t count;
+    size_t head;
+    size_t size;
+    size_t maxSize;
+};
+
+struct hpack_decoder {
+    struct hpack_table table;
+    size_t settingsMaxSize;
+    char *scratch;
+    size_t scratchSize;
+};
+
+struct hpack_encoder {
+    struct hpack_table table;
+    bool sizeUpdate;
+};
+
+/**
+ * Callback receiving each decoded header field.
+ * The strings are only valid during the call and are not NUL-terminated. A non-zero return aborts decoding.
+ */
+typedef int (*hpack_header_cb)(void *ctx, const char *name, size_t nameLength, const char *value, size_t valueLength);
+
+void hpack_decoder_init(struct hpack_decoder *decoder, size_t maxSize);
+void hpack_decoder_free(struct hpack_decoder *decoder);
+int hpack_decode(struct hpack_decoder *decoder, const uint8_t *block, size_t length, hpack_header_cb callback, void *ctx);
+
+void hpack_encoder_init(struct hpack_encoder *encoder, size_t maxSize);
+void hpack_encoder_set_max_size(struct hpack_encoder *encoder, size_t maxSize);
+void hpack_encoder_free(struct hpack_encoder *encoder);
+size_t hpack_encode(struct hpack_encoder *encoder, uint8_t *out, size_t outSize, const char *name, const char *value, bool index);
+
+#endif
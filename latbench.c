@@ -0,0 +1,158 @@
+/**
+*@file latbench.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Request latency benchmark.
+*
+* Fetches a path from a server over and over, one request per connection as the server answers HTTP/1.1, and
+* reports the percentiles of the time from connecting to the end of the response. Meant to compare server modes
+* on loopback, like the default against busy polling.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define DEFAULT_REQUESTS 20000
+#define DEFAULT_WARMUP 1000
+
+static char *MYPROG;
+
+static void usage(char* message) {
+    fprintf(stderr,"Usage Error! \tProper input: %s [-n REQUESTS] [-w WARMUP] HOST PORT PATH\n%s\n", MYPROG, message);
+    exit(1);}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+    }
+
+static int compare_samples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+    }
+
+/**
+ * Request function.
+ * @brief Connects, sends 'request' and reads the response until the server closes the connection.
+ * @return Returns the number of bytes received, or -1 on failure.
+ */
+static long fetch(const struct addrinfo *address, const char *request, size_t length) {
+    int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+        return -1;
+    }
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (connect(fd, address->ai_addr, address->ai_addrlen) != 0 || send(fd, request, length, 0) != (ssize_t)length) {
+        close(fd);
+        return -1;
+    }
+    char buffer[16384];
+    long received = 0;
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        received += n;
+    }
+    close(fd);
+    return n == 0 ? received : -1;
+    }
+
+static uint64_t percentile(const uint64_t *samples, size_t count, double fraction) {
+    size_t index = (size_t)(fraction * count);
+    return samples[index < count ? index : count - 1];
+    }
+
+/**
+ * Program entry point.
+ * @brief Measures the latency of requests for PATH from the server at HOST and PORT.
+ * @details -n sets how many requests are measured, after -w requests that are not.
+ * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char *argv[]) {
+    MYPROG = argv[0];
+    long requests = DEFAULT_REQUESTS;
+    long warmup = DEFAULT_WARMUP;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+        char *end;
+        switch (opt) {
+            case 'n':
+                requests = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || requests < 1) {
+                    usage("Invalid argument to the option 'n'\n");
+                }
+                break;
+            case 'w':
+                warmup = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || warmup < 0) {
+                    usage("Invalid argument to the option 'w'\n");
+                }
+                break;
+            default:
+                usage("Unknown Option!");
+        }
+    }
+    if (optind != argc - 3) {
+        usage("Too many or lacking input arguments");
+    }
+
+    struct addrinfo hints, *address;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int res = getaddrinfo(argv[optind], argv[optind + 1], &hints, &address);
+    if (res != 0) {
+        fprintf(stderr, "getaddrinfo() failed: %s\n", gai_strerror(res));
+        return EXIT_FAILURE;
+    }
+    char request[2048];
+    int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", argv[optind + 2],
+                          argv[optind]);
+    if (length < 0 || length >= (int)sizeof(request)) {
+        usage("Path too long");
+    }
+
+    uint64_t *samples = malloc(requests * sizeof(uint64_t));
+    if (samples == NULL) {
+        perror("malloc() failed");
+        return EXIT_FAILURE;
+    }
+    for (long i = -warmup; i < requests; i++) {
+        uint64_t start = now_ns();
+        if (fetch(address, request, length) < 0) {
+            perror("Request failed");
+            freeaddrinfo(address);
+            free(samples);
+            return EXIT_FAILURE;
+        }
+        if (i >= 0) {
+            samples[i] = now_ns() - start;
+        }
+    }
+    freeaddrinfo(address);
+
+    qsort(samples, requests, sizeof(uint64_t), compare_samples);
+    uint64_t total = 0;
+    for (long i = 0; i < requests; i++) {
+        total += samples[i];
+    }
+    printf("%ld requests: mean %.1f us, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", requests,
+           total / 1000.0 / requests, percentile(samples, requests, 0.5) / 1000.0,
+           percentile(samples, requests, 0.99) / 1000.0, percentile(samples, requests, 0.999) / 1000.0,
+           samples[requests - 1] / 1000.0);
+    free(samples);
+    return EXIT_SUCCESS;
+    }
@@ -0,0 +1,111 @@
+/**
+*@file metrics.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Server metrics.
+*
+* Keeps the counters of the server and renders them as the plain text page served at the metrics path.
+**/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "metrics.h"
+
+struct server_metrics metrics;
+
+/**
+ * CPU time function.
+ * @brief Returns the CPU time consumed by the calling thread in nanoseconds, or 0 if it is not available.
+ */
+uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    }
+
+static uint64_t load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+    }
+
+/**
+ * Metrics page function.
+ * @brief Writes one "name value" line per counter to 'out'.
+ * @details Handshake CPU time is reported in microseconds per handshake, averaged since startup.
+ * @return Returns the length of the page, or -1 if it does not fit into 'out'.
+ */
+int metrics_format(char *out, size_t size) {
+    uint64_t full = load(&metrics.tlsFullHandshakes);
+    uint64_t resumed = load(&metrics.tlsResumedHandshakes);
+    uint64_t fullCpu = load(&metrics.tlsFullHandshakeCpuNs);
+    uint64_t resumedCpu = load(&metrics.tlsResumedHandshakeCpuNs);
+
+    int length = snprintf(out, size,
+                          "connections %llu\n"
+                          "connections_shed %llu\n"
+                          "requests %llu\n"
+                          "requests_limited %llu\n"
+                          "tls_handshakes_full %llu\n"
+                          "tls_handshakes_resumed %llu\n"
+                          "tls_handshakes_failed %llu\n"
+                          "tls_handshake_cpu_us_full %llu\n"
+                          "tls_handshake_cpu_us_resumed %llu\n"
+                          "proxy_requests %llu\n"
+                          "upstream_connects %llu\n"
+                          "upstream_reuses %llu\n"
+                          "upstream_failures %llu\n"
+                          "proxy_bytes_spliced %llu\n"
+                          "cache_hits %llu\n"
+                          "cache_misses %llu\n"
+                          "cache_coalesced %llu\n"
+                          "cache_disk_hits %llu\n"
+                          "cache_stores %llu\n"
+                          "cache_evictions %llu\n"
+                          "cache_snapshot_hits %llu\n"
+                          "cache_arena_fallbacks %llu\n"
+                          "prewarm_files %llu\n"
+                          "prewarm_bytes %llu\n"
+                          "zerocopy_pinned %llu\n"
+                          "page_cache_drops %llu\n"
+                          "direct_sends %llu\n"
+                          "direct_fallbacks %llu\n"
+                          "responses_paced %llu\n"
+                          "responses_paced_userspace %llu\n",
+                          (unsigned long long)load(&metrics.connections),
+                          (unsigned long long)load(&metrics.connectionsShed),
+                          (unsigned long long)load(&metrics.requests),
+                          (unsigned long long)load(&metrics.requestsLimited),
+                          (unsigned long long)full,
+                          (unsigned long long)resumed,
+                          (unsigned long long)load(&metrics.tlsFailedHandshakes),
+                          (unsigned long long)(full > 0 ? fullCpu / full / 1000 : 0),
+                          (unsigned long long)(resumed > 0 ? resumedCpu / resumed / 1000 : 0),
+                          (unsigned long long)load(&metrics.proxyRequests),
+                          (unsigned long long)load(&metrics.upstreamConnects),
+                          (unsigned long long)load(&metrics.upstreamReuses),
+                          (unsigned long long)load(&metrics.upstreamFailures),
+                          (unsigned long long)load(&metrics.proxyBytesSpliced),
+                          (unsigned long long)load(&metrics.cacheHits),
+                          (unsigned long long)load(&metrics.cacheMisses),
+                          (unsigned long long)load(&metrics.cacheCoalesced),
+                          (unsigned long long)load(&metrics.cacheDiskHits),
+                          (unsigned long long)load(&metrics.cacheStores),
+                          (unsigned long long)load(&metrics.cacheEvictions),
+                          (unsigned long long)load(&metrics.cacheSnapshotHits),
+                          (unsigned long long)load(&metrics.cacheArenaFallbacks),
+                          (unsigned long long)load(&metrics.prewarmFiles),
+                          (unsigned long long)load(&metrics.prewarmBytes),
+                          (unsigned long long)load(&metrics.zerocopyPinned),
+                          (unsigned long long)load(&metrics.filehintDrops),
+                          (unsigned long long)load(&metrics.directSends),
+                          (unsigned long long)load(&metrics.directFallbacks),
+                          (unsigned long long)load(&metrics.pacedResponses),
+                          (unsigned long long)load(&metrics.pacedInUserspace));
+    if (length < 0 || (size_t)length >= size) {
+        return -1;
+    }
+    return length;
+    }
@@ -0,0 +1,59 @@
+/**
+*@file metrics.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Server metrics.
+*
+* Counters shared by all workers. They are only ever incremented, with relaxed atomic additions, so that counting
+* costs no lock on the serving path.
+**/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The counters, in the order they are reported. */
+struct server_metrics {
+    uint64_t connections;
+    uint64_t connectionsShed;
+    uint64_t requests;
+    uint64_t requestsLimited;
+    uint64_t tlsFullHandshakes;
+    uint64_t tlsResumedHandshakes;
+    uint64_t tlsFailedHandshakes;
+    uint64_t tlsFullHandshakeCpuNs;
+    uint64_t tlsResumedHandshakeCpuNs;
+    uint64_t proxyRequests;
+    uint64_t upstreamConnects;
+    uint64_t upstreamReuses;
+    uint64_t upstreamFailures;
+    uint64_t proxyBytesSpliced;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;
+    uint64_t cacheCoalesced;
+    uint64_t cacheDiskHits;
+    uint64_t cacheStores;
+    uint64_t cacheEvictions;
+    uint64_t cacheSnapshotHits;
+    uint64_t cacheArenaFallbacks;
+    uint64_t prewarmFiles;
+    uint64_t prewarmBytes;
+    uint64_t zerocopyPinned;
+    uint64_t filehintDrops;
+    uint64_t directSends;
+    uint64_t directFallbacks;
+    uint64_t pacedResponses;
+    uint64_t pacedInUserspace;
+};
+
+extern struct server_metrics metrics;
+
+#define METRICS_ADD(counter, n) __atomic_fetch_add(&metrics.counter, (uint64_t)(n), __ATOMIC_RELAXED)
+
+uint64_t thread_cpu_ns(void);
+int metrics_format(char *out, size_t size);
+
+#endif
@@ -0,0 +1,180 @@
+/**
+*@file mime.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Content types of files.
+*
+* The type of a file is found by its extension, first among the types read from a mime.types file, if one was
+* given, then in the table generated from mime.defaults. Both are only read once the workers are running.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mime.h"
+
+/** A slot of the generated table, 'type' indexes mimeTableTypes. Empty slots hold a key no extension has. */
+struct mime_slot {
+    struct mime_key key;
+    int type;
+};
+
+#include "mimetable.h"
+
+#define OVERRIDE_MULTIPLIER 0x9e3779b97f4a7c15ull
+#define MAX_LINE_LENGTH 4096
+
+/** An extension of the mime.types file, and the type it was given there. */
+struct mime_override {
+    struct mime_key key;
+    const char *type;
+};
+
+//open addressing table of the mime.types file, NULL without one
+static struct mime_override *overrides;
+static size_t overrideSlots;
+static unsigned int overrideShift;
+static char **overrideTypes;
+static size_t overrideTypeCount;
+
+static bool same_key(const struct mime_key *a, const struct mime_key *b) {
+    return a->low == b->low && a->high == b->high;
+    }
+
+/**
+ * Override table function.
+ * @brief Puts the extensions read from a mime.types file into a table with twice as many slots, probed linearly.
+ * An extension given more than once keeps the last type.
+ * @return Returns 0, or -1 if memory is short.
+ */
+static int build_overrides(const struct mime_override *entries, size_t count) {
+    unsigned int bits = 4;
+    while (((size_t)1 << bits) < 2 * count) {
+        bits++;
+    }
+    overrideSlots = (size_t)1 << bits;
+    overrideShift = 64 - bits;
+    overrides = calloc(overrideSlots, sizeof(struct mime_override));
+    if (overrides == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = mime_hash(&entries[i].key, OVERRIDE_MULTIPLIER, overrideShift);
+        while (overrides[slot].type != NULL && !same_key(&overrides[slot].key, &entries[i].key)) {
+            slot = (slot + 1) & (overrideSlots - 1);
+        }
+        overrides[slot] = entries[i];
+    }
+    return 0;
+    }
+
+/**
+ * Loading function.
+ * @brief Reads a file in the format of mime.types, "TYPE EXTENSION..." per line, whose types then take precedence
+ * over the built-in ones.
+ * @details Lines without extensions, empty lines and comments are skipped. Extensions longer than
+ * MIME_MAX_EXTENSION characters are ignored.
+ * @return Returns 0, or -1 if the file could not be read.
+ */
+int mime_load(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror("fopen() failed");
+        return -1;
+    }
+
+    struct mime_override *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    char line[MAX_LINE_LENGTH];
+    int res = 0;
+    while (res == 0 && fgets(line, sizeof(line), in) != NULL) {
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *type = strtok(line, " \t");
+        char *name = type != NULL ? strtok(NULL, " \t") : NULL;
+        if (name == NULL) {
+            continue;
+        }
+        char **grown = realloc(overrideTypes, (overrideTypeCount + 1) * sizeof(char *));
+        if (grown == NULL || (grown[overrideTypeCount] = strdup(type)) == NULL) {
+            overrideTypes = grown != NULL ? grown : overrideTypes;
+            res = -1;
+            break;
+        }
+        overrideTypes = grown;
+        const char *stored = overrideTypes[overrideTypeCount++];
+
+        for (; name != NULL; name = strtok(NULL, " \t")) {
+            struct mime_key key;
+            if (!mime_pack(name, strlen(name), &key)) {
+                continue;
+            }
+            if (count == capacity) {
+                capacity = capacity > 0 ? 2 * capacity : 256;
+                struct mime_override *more = realloc(entries, capacity * sizeof(struct mime_override));
+                if (more == NULL) {
+                    res = -1;
+                    break;
+                }
+                entries = more;
+            }
+            entries[count].key = key;
+            entries[count].type = stored;
+            count++;
+        }
+    }
+    fclose(in);
+
+    if (res == 0) {
+        res = build_overrides(entries, count);
+    }
+    free(entries);
+    if (res != 0) {
+        fprintf(stderr, "Not enough memory for the types of %s\n", path);
+        mime_free();
+    }
+    return res;
+    }
+
+void mime_free(void) {
+    for (size_t i = 0; i < overrideTypeCount; i++) {
+        free(overrideTypes[i]);
+    }
+    free(overrideTypes);
+    free(overrides);
+    overrideTypes = NULL;
+    overrideTypeCount = 0;
+    overrides = NULL;
+    }
+
+/**
+ * Lookup function.
+ * @brief Finds the content type of a file by the extension of its name.
+ * @details Names without an extension, and hidden files named only by one, are of MIME_DEFAULT_TYPE, as are
+ * unknown extensions.
+ * @return Returns the type, which stays valid until mime_free().
+ */
+const char *mime_type(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash != NULL ? slash + 1 : path;
+    const char *dot = strrchr(name, '.');
+    struct mime_key key;
+    if (dot == NULL || dot == name || !mime_pack(dot + 1, strlen(dot + 1), &key)) {
+        return MIME_DEFAULT_TYPE;
+    }
+
+    if (overrides != NULL) {
+        size_t slot = mime_hash(&key, OVERRIDE_MULTIPLIER, overrideShift);
+        while (overrides[slot].type != NULL) {
+            if (same_key(&overrides[slot].key, &key)) {
+                return overrides[slot].type;
+            }
+            slot = (slot + 1) & (overrideSlots - 1);
+        }
+    }
+
+    const struct mime_slot *slot = &mimeTable[mime_hash(&key, MIME_TABLE_MULTIPLIER, MIME_TABLE_SHIFT)];
+    return same_key(&slot->key, &key) ? mimeTableTypes[slot->type] : MIME_DEFAULT_TYPE;
+    }
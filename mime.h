@@ -0,0 +1,67 @@
+/**
+*@file mime.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Content types of files.
+*
+* File name extensions are packed into two 64-bit words, so that they are hashed and compared as integers. The
+* known extensions are put into a perfect hash table by mimegen when the server is built, a mime.types file read
+* at startup can add to them or change them.
+**/
+
+#ifndef MIME_H
+#define MIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MIME_MAX_EXTENSION 16
+#define MIME_DEFAULT_TYPE "application/octet-stream"
+
+/** An extension of up to 16 characters in lower case, the first eight in 'low', zero-padded. */
+struct mime_key {
+    uint64_t low;
+    uint64_t high;
+};
+
+/**
+ * Packing function.
+ * @brief Packs an extension into a key, in lower case.
+ * @return Returns false if the extension is empty, too long or has characters no extension has.
+ */
+static inline bool mime_pack(const char *extension, size_t length, struct mime_key *key) {
+    key->low = 0;
+    key->high = 0;
+    if (length == 0 || length > MIME_MAX_EXTENSION) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        uint64_t c = (unsigned char)extension[i];
+        if (c <= ' ' || c == '/' || c >= 0x7f) {
+            return false;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (i < 8) {
+            key->low |= c << (8 * i);
+        }
+        else {
+            key->high |= c << (8 * (i - 8));
+        }
+    }
+    return true;
+    }
+
+/** Hashes a key into a table of 2^(64 - shift) slots, multiplicatively with the given odd multiplier. */
+static inline uint32_t mime_hash(const struct mime_key *key, uint64_t multiplier, unsigned int shift) {
+    return (uint32_t)(((key->low ^ (key->high * 0x9e3779b97f4a7c15ull)) * multiplier) >> shift);
+    }
+
+int mime_load(const char *path);
+void mime_free(void);
+const char *mime_type(const char *path);
+
+#endif
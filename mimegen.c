@@ -0,0 +1,184 @@
+/**
+*@file mimegen.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Generator of the content type table of the server.
+*
+* Reads a list of content types in the format of mime.types and writes a header with a perfect hash table of their
+* extensions to stdout: a multiplier under which no two extensions share a slot, and the slots. The server then
+* finds the type of an extension with one multiplication, a shift and an integer comparison.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mime.h"
+
+#define MAX_TYPES 256
+#define MAX_EXTENSIONS 1024
+#define MAX_LINE_LENGTH 1024
+#define MAX_ATTEMPTS 1000000
+
+struct extension {
+    struct mime_key key;
+    char name[MIME_MAX_EXTENSION + 1];
+    int type;
+};
+
+static char *types[MAX_TYPES];
+static int typeCount;
+static struct extension extensions[MAX_EXTENSIONS];
+static int extensionCount;
+
+static void usage(const char *programName) {
+    fprintf(stderr, "Usage: %s TYPES_FILE\n", programName);
+    exit(EXIT_FAILURE);
+    }
+
+/**
+ * Reading function.
+ * @brief Reads the "TYPE EXTENSION..." lines of a types file, skipping empty lines and comments.
+ * @return Returns 0, or -1 after printing what is wrong with the file.
+ */
+static int read_types(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror("fopen() failed");
+        return -1;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    int lineNumber = 0;
+    int res = 0;
+    while (res == 0 && fgets(line, sizeof(line), in) != NULL) {
+        lineNumber++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *type = strtok(line, " \t");
+        if (type == NULL) {
+            continue;
+        }
+        if (typeCount == MAX_TYPES || (types[typeCount] = strdup(type)) == NULL) {
+            fprintf(stderr, "Too many types in line %d\n", lineNumber);
+            res = -1;
+            break;
+        }
+
+        for (char *name = strtok(NULL, " \t"); name != NULL && res == 0; name = strtok(NULL, " \t")) {
+            struct extension *extension = &extensions[extensionCount];
+            if (extensionCount == MAX_EXTENSIONS || !mime_pack(name, strlen(name), &extension->key)) {
+                fprintf(stderr, "Invalid extension in line %d: %s\n", lineNumber, name);
+                res = -1;
+                break;
+            }
+            for (int i = 0; i < extensionCount; i++) {
+                if (extensions[i].key.low == extension->key.low && extensions[i].key.high == extension->key.high) {
+                    fprintf(stderr, "Extension given twice in line %d: %s\n", lineNumber, name);
+                    res = -1;
+                    break;
+                }
+            }
+            strcpy(extension->name, name);
+            extension->type = typeCount;
+            extensionCount++;
+        }
+        typeCount++;
+    }
+    fclose(in);
+    return res;
+    }
+
+/**
+ * Multiplier search function.
+ * @brief Tries odd multipliers from a fixed sequence until one sends every extension to a slot of its own.
+ * @return Returns the multiplier, or 0 if none of the tried ones does.
+ */
+static uint64_t find_multiplier(unsigned int shift, size_t slotCount) {
+    unsigned char *taken = malloc(slotCount);
+    if (taken == NULL) {
+        return 0;
+    }
+    //xorshift, with a fixed start so that every build produces the same table
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    uint64_t found = 0;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS && found == 0; attempt++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        uint64_t multiplier = state | 1;
+
+        memset(taken, 0, slotCount);
+        int i = 0;
+        for (; i < extensionCount; i++) {
+            uint32_t slot = mime_hash(&extensions[i].key, multiplier, shift);
+            if (taken[slot]) {
+                break;
+            }
+            taken[slot] = 1;
+        }
+        if (i == extensionCount) {
+            found = multiplier;
+        }
+    }
+    free(taken);
+    return found;
+    }
+
+/**
+ * Generator of the content type table.
+ * @brief Writes the perfect hash table of the extensions in TYPES_FILE to stdout.
+ * @details The table starts with four slots per extension, and doubles until a multiplier is found.
+ * @return Returns EXIT_SUCCESS, or EXIT_FAILURE if the file is invalid or no table could be built.
+ */
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        usage(argv[0]);
+    }
+    if (read_types(argv[1]) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    unsigned int bits = 2;
+    while ((1 << bits) < 4 * extensionCount) {
+        bits++;
+    }
+    uint64_t multiplier = 0;
+    for (; bits <= 16 && multiplier == 0; bits++) {
+        multiplier = find_multiplier(64 - bits, (size_t)1 << bits);
+    }
+    if (multiplier == 0) {
+        fprintf(stderr, "No perfect hash found for %d extensions\n", extensionCount);
+        return EXIT_FAILURE;
+    }
+    bits--;
+
+    static struct extension *slots[1 << 16];
+    for (int i = 0; i < extensionCount; i++) {
+        slots[mime_hash(&extensions[i].key, multiplier, 64 - bits)] = &extensions[i];
+    }
+
+    printf("/* Generated by mimegen from %s, do not edit. */\n\n", argv[1]);
+    printf("#define MIME_TABLE_MULTIPLIER 0x%016llxull\n", (unsigned long long)multiplier);
+    printf("#define MIME_TABLE_SHIFT %u\n", 64 - bits);
+    printf("#define MIME_TABLE_SLOTS %u\n\n", 1u << bits);
+    printf("static const char *const mimeTableTypes[%d] = {\n", typeCount);
+    for (int i = 0; i < typeCount; i++) {
+        printf("    \"%s\",\n", types[i]);
+    }
+    printf("};\n\n");
+    printf("static const struct mime_slot mimeTable[MIME_TABLE_SLOTS] = {\n");
+    for (unsigned int i = 0; i < 1u << bits; i++) {
+        if (slots[i] != NULL) {
+            printf("    [%u] = {{0x%016llxull, 0x%016llxull}, %d}, /* %s */\n", i,
+                   (unsigned long long)slots[i]->key.low, (unsigned long long)slots[i]->key.high, slots[i]->type,
+                   slots[i]->name);
+        }
+    }
+    printf("};\n");
+
+    for (int i = 0; i < typeCount; i++) {
+        free(types[i]);
+    }
+    return EXIT_SUCCESS;
+    }
@@ -0,0 +1,180 @@
+/* Generated by mimegen from mime.defaults, do not edit. */
+
+#define MIME_TABLE_MULTIPLIER 0x539d786ce6fa375bull
+#define MIME_TABLE_SHIFT 55
+#define MIME_TABLE_SLOTS 512
+
+static const char *const mimeTableTypes[72] = {
+    "text/html",
+    "text/css",
+    "text/plain",
+    "text/csv",
+    "text/xml",
+    "text/javascript",
+    "text/calendar",
+    "text/markdown",
+    "text/vtt",
+    "application/json",
+    "application/ld+json",
+    "application/manifest+json",
+    "application/xhtml+xml",
+    "application/rss+xml",
+    "application/atom+xml",
+    "application/pdf",
+    "application/postscript",
+    "application/rtf",
+    "application/wasm",
+    "application/zip",
+    "application/gzip",
+    "application/x-bzip2",
+    "application/x-xz",
+    "application/zstd",
+    "application/x-tar",
+    "application/x-7z-compressed",
+    "application/vnd.rar",
+    "application/java-archive",
+    "application/x-sh",
+    "application/msword",
+    "application/vnd.ms-excel",
+    "application/vnd.ms-powerpoint",
+    "application/vnd.openxmlformats-officedocument.wordprocessingml.document",
+    "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet",
+    "application/vnd.openxmlformats-officedocument.presentationml.presentation",
+    "application/vnd.oasis.opendocument.text",
+    "application/vnd.oasis.opendocument.spreadsheet",
+    "application/epub+zip",
+    "application/octet-stream",
+    "image/png",
+    "image/jpeg",
+    "image/gif",
+    "image/webp",
+    "image/avif",
+    "image/svg+xml",
+    "image/x-icon",
+    "image/bmp",
+    "image/tiff",
+    "image/apng",
+    "font/woff",
+    "font/woff2",
+    "font/ttf",
+    "font/otf",
+    "application/vnd.ms-fontobject",
+    "audio/mpeg",
+    "audio/ogg",
+    "audio/wav",
+    "audio/flac",
+    "audio/aac",
+    "audio/mp4",
+    "audio/webm",
+    "audio/midi",
+    "video/mp4",
+    "video/webm",
+    "video/ogg",
+    "video/quicktime",
+    "video/x-msvideo",
+    "video/x-matroska",
+    "video/mpeg",
+    "video/mp2t",
+    "application/vnd.apple.mpegurl",
+    "application/dash+xml",
+};
+
+static const struct mime_slot mimeTable[MIME_TABLE_SLOTS] = {
+    [0] = {{0x000000006d736177ull, 0x0000000000000000ull}, 18}, /* wasm */
+    [2] = {{0x0000000000676f6cull, 0x0000000000000000ull}, 2}, /* log */
+    [4] = {{0x0000000000007a37ull, 0x0000000000000000ull}, 25}, /* 7z */
+    [13] = {{0x000000000065706aull, 0x0000000000000000ull}, 40}, /* jpe */
+    [21] = {{0x0000000000747070ull, 0x0000000000000000ull}, 31}, /* ppt */
+    [22] = {{0x0000000000766177ull, 0x0000000000000000ull}, 56}, /* wav */
+    [24] = {{0x00000000006c6d78ull, 0x0000000000000000ull}, 4}, /* xml */
+    [25] = {{0x0000000066697661ull, 0x0000000000000000ull}, 43}, /* avif */
+    [33] = {{0x000000000067676full, 0x0000000000000000ull}, 55}, /* ogg */
+    [36] = {{0x0000000000737372ull, 0x0000000000000000ull}, 13}, /* rss */
+    [38] = {{0x0000000000666470ull, 0x0000000000000000ull}, 15}, /* pdf */
+    [46] = {{0x0000000078747070ull, 0x0000000000000000ull}, 34}, /* pptx */
+    [49] = {{0x000000000076346dull, 0x0000000000000000ull}, 62}, /* m4v */
+    [54] = {{0x000000007375706full, 0x0000000000000000ull}, 55}, /* opus */
+    [58] = {{0x000000000000646dull, 0x0000000000000000ull}, 2}, /* md */
+    [61] = {{0x000000000076676full, 0x0000000000000000ull}, 64}, /* ogv */
+    [62] = {{0x000000000070697aull, 0x0000000000000000ull}, 19}, /* zip */
+    [70] = {{0x00000000676e7061ull, 0x0000000000000000ull}, 48}, /* apng */
+    [78] = {{0x000000000074737aull, 0x0000000000000000ull}, 23}, /* zst */
+    [83] = {{0x0000000000676d64ull, 0x0000000000000000ull}, 38}, /* dmg */
+    [87] = {{0x0000000000737363ull, 0x0000000000000000ull}, 1}, /* css */
+    [92] = {{0x0000000000726174ull, 0x0000000000000000ull}, 24}, /* tar */
+    [108] = {{0x0000000000666967ull, 0x0000000000000000ull}, 41}, /* gif */
+    [111] = {{0x000000000061346dull, 0x0000000000000000ull}, 59}, /* m4a */
+    [114] = {{0x0000000000667474ull, 0x0000000000000000ull}, 51}, /* ttf */
+    [117] = {{0x000000000064696dull, 0x0000000000000000ull}, 61}, /* mid */
+    [122] = {{0x0000000000007a78ull, 0x0000000000000000ull}, 22}, /* xz */
+    [123] = {{0x000000000061676full, 0x0000000000000000ull}, 55}, /* oga */
+    [127] = {{0x00000000006f7369ull, 0x0000000000000000ull}, 38}, /* iso */
+    [138] = {{0x0000000000747874ull, 0x0000000000000000ull}, 2}, /* txt */
+    [148] = {{0x0000000000736369ull, 0x0000000000000000ull}, 6}, /* ics */
+    [161] = {{0x0000000000657865ull, 0x0000000000000000ull}, 38}, /* exe */
+    [163] = {{0x0000000000007370ull, 0x0000000000000000ull}, 16}, /* ps */
+    [171] = {{0x000000000074646full, 0x0000000000000000ull}, 35}, /* odt */
+    [174] = {{0x00000000006e6962ull, 0x0000000000000000ull}, 38}, /* bin */
+    [179] = {{0x0000000000696e69ull, 0x0000000000000000ull}, 2}, /* ini */
+    [183] = {{0x0000000061626577ull, 0x0000000000000000ull}, 60}, /* weba */
+    [184] = {{0x000000000000736aull, 0x0000000000000000ull}, 5}, /* js */
+    [189] = {{0x000000006e6f736aull, 0x0000000000000000ull}, 9}, /* json */
+    [198] = {{0x0000000000766f6dull, 0x0000000000000000ull}, 65}, /* mov */
+    [208] = {{0x00000000006f6369ull, 0x0000000000000000ull}, 45}, /* ico */
+    [226] = {{0x66696e616d626577ull, 0x0000000000747365ull}, 11}, /* webmanifest */
+    [234] = {{0x0000000000666974ull, 0x0000000000000000ull}, 47}, /* tif */
+    [236] = {{0x0000000000747476ull, 0x0000000000000000ull}, 8}, /* vtt */
+    [237] = {{0x000000006d626577ull, 0x0000000000000000ull}, 63}, /* webm */
+    [248] = {{0x000000000033706dull, 0x0000000000000000ull}, 54}, /* mp3 */
+    [252] = {{0x0000000063616c66ull, 0x0000000000000000ull}, 57}, /* flac */
+    [254] = {{0x000000007a677673ull, 0x0000000000000000ull}, 44}, /* svgz */
+    [261] = {{0x0000000000636f64ull, 0x0000000000000000ull}, 29}, /* doc */
+    [265] = {{0x0000000066666f77ull, 0x0000000000000000ull}, 49}, /* woff */
+    [270] = {{0x0000000000726172ull, 0x0000000000000000ull}, 26}, /* rar */
+    [273] = {{0x0000000000006873ull, 0x0000000000000000ull}, 28}, /* sh */
+    [274] = {{0x000000000064706dull, 0x0000000000000000ull}, 71}, /* mpd */
+    [276] = {{0x000000006c6d7468ull, 0x0000000000000000ull}, 0}, /* html */
+    [279] = {{0x0000006c6d746878ull, 0x0000000000000000ull}, 12}, /* xhtml */
+    [283] = {{0x0000646c6e6f736aull, 0x0000000000000000ull}, 10}, /* jsonld */
+    [286] = {{0x0000000078636f64ull, 0x0000000000000000ull}, 32}, /* docx */
+    [292] = {{0x0000000000667472ull, 0x0000000000000000ull}, 17}, /* rtf */
+    [293] = {{0x0000000000327a62ull, 0x0000000000000000ull}, 21}, /* bz2 */
+    [298] = {{0x0000000000767363ull, 0x0000000000000000ull}, 3}, /* csv */
+    [302] = {{0x000000000066746full, 0x0000000000000000ull}, 52}, /* otf */
+    [305] = {{0x00000000006d7468ull, 0x0000000000000000ull}, 0}, /* htm */
+    [306] = {{0x0000000000677673ull, 0x0000000000000000ull}, 44}, /* svg */
+    [312] = {{0x0000000062757065ull, 0x0000000000000000ull}, 37}, /* epub */
+    [317] = {{0x000000006d6f7461ull, 0x0000000000000000ull}, 14}, /* atom */
+    [320] = {{0x0000000000007374ull, 0x0000000000000000ull}, 69}, /* ts */
+    [323] = {{0x0000003266666f77ull, 0x0000000000000000ull}, 50}, /* woff2 */
+    [325] = {{0x00000000007a6774ull, 0x0000000000000000ull}, 20}, /* tgz */
+    [337] = {{0x0000000000697661ull, 0x0000000000000000ull}, 66}, /* avi */
+    [351] = {{0x0000000000007a67ull, 0x0000000000000000ull}, 20}, /* gz */
+    [356] = {{0x0000000000676e70ull, 0x0000000000000000ull}, 39}, /* png */
+    [371] = {{0x0000000000736c78ull, 0x0000000000000000ull}, 30}, /* xls */
+    [378] = {{0x0000000070626577ull, 0x0000000000000000ull}, 42}, /* webp */
+    [380] = {{0x0000000000706d62ull, 0x0000000000000000ull}, 46}, /* bmp */
+    [383] = {{0x00000000666e6f63ull, 0x0000000000000000ull}, 2}, /* conf */
+    [395] = {{0x0000000078736c78ull, 0x0000000000000000ull}, 33}, /* xlsx */
+    [407] = {{0x0000000000676d69ull, 0x0000000000000000ull}, 38}, /* img */
+    [415] = {{0x0000000074786574ull, 0x0000000000000000ull}, 2}, /* text */
+    [421] = {{0x000000006765706dull, 0x0000000000000000ull}, 68}, /* mpeg */
+    [426] = {{0x000000003875336dull, 0x0000000000000000ull}, 70}, /* m3u8 */
+    [427] = {{0x0000000000746f65ull, 0x0000000000000000ull}, 53}, /* eot */
+    [431] = {{0x000000006765706aull, 0x0000000000000000ull}, 40}, /* jpeg */
+    [434] = {{0x0000000066666974ull, 0x0000000000000000ull}, 47}, /* tiff */
+    [442] = {{0x000000000073646full, 0x0000000000000000ull}, 36}, /* ods */
+    [459] = {{0x000000006964696dull, 0x0000000000000000ull}, 61}, /* midi */
+    [460] = {{0x00000000006c6c64ull, 0x0000000000000000ull}, 38}, /* dll */
+    [461] = {{0x0000000000736a6dull, 0x0000000000000000ull}, 5}, /* mjs */
+    [467] = {{0x0000006c6d746873ull, 0x0000000000000000ull}, 0}, /* shtml */
+    [468] = {{0x000000000072616aull, 0x0000000000000000ull}, 27}, /* jar */
+    [470] = {{0x0000000000636161ull, 0x0000000000000000ull}, 58}, /* aac */
+    [475] = {{0x0000000000766b6dull, 0x0000000000000000ull}, 67}, /* mkv */
+    [485] = {{0x000000000067706dull, 0x0000000000000000ull}, 68}, /* mpg */
+    [488] = {{0x000000000070616dull, 0x0000000000000000ull}, 9}, /* map */
+    [489] = {{0x000000000034706dull, 0x0000000000000000ull}, 62}, /* mp4 */
+    [493] = {{0x6e776f646b72616dull, 0x0000000000000000ull}, 7}, /* markdown */
+    [495] = {{0x000000000067706aull, 0x0000000000000000ull}, 40}, /* jpg */
+    [501] = {{0x0000000000737065ull, 0x0000000000000000ull}, 16}, /* eps */
+};
@@ -0,0 +1,399 @@
+/**
+*@file pack.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Packs a document root into an archive the server can serve from memory.
+*
+* Every regular file below the document root is stored with the header lines it will be served with: ETag,
+* Content-Type and Content-Length, and a gzip variant with its own ETag if compression saves at least an eighth.
+* Bodies are page-aligned, so that the server sends them straight from its mapping of the archive.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "archive.h"
+#include "mime.h"
+
+#define MAX_PATH_LENGTH 4096
+#define MIN_GZIP_LENGTH 256
+
+char *MYPROG;
+
+static int out = -1;
+static uint64_t outOffset = ARCHIVE_ALIGNMENT;
+
+static struct archive_entry *entries;
+static uint32_t entryCount;
+static uint32_t entryCapacity;
+
+//paths and header lines, their offsets are relative until the strings are written
+static char *strings;
+static size_t stringsLength;
+static size_t stringsCapacity;
+
+static size_t gzipCount;
+
+static void usage(char *message) {
+    fprintf(stderr, "Usage Error! \tProper input: %s [-T MIME_TYPES] DOC_ROOT ARCHIVE\n%s\n", MYPROG, message);
+    exit(EXIT_FAILURE);
+    }
+
+static int write_at(const void *data, size_t length, uint64_t offset) {
+    const char *pos = data;
+    while (length > 0) {
+        ssize_t n = pwrite(out, pos, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("pwrite() failed");
+            return -1;
+        }
+        pos += n;
+        offset += n;
+        length -= n;
+    }
+    return 0;
+    }
+
+/**
+ * Body writing function.
+ * @brief Writes a body at the next page boundary of the archive.
+ * @return Returns the offset of the body, or 0 if writing failed.
+ */
+static uint64_t write_body(const void *data, size_t length) {
+    uint64_t offset = (outOffset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+    if (write_at(data, length, offset) != 0) {
+        return 0;
+    }
+    outOffset = offset + length;
+    return offset;
+    }
+
+/**
+ * String function.
+ * @brief Appends formatted text to the strings of the index.
+ * @return Returns the relative offset of the text and sets 'length', or returns SIZE_MAX if memory is short.
+ */
+static size_t add_string(uint32_t *length, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (stringsLength + needed + 1 > stringsCapacity) {
+        size_t capacity = stringsCapacity > 0 ? stringsCapacity : 65536;
+        while (stringsLength + needed + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *grown = realloc(strings, capacity);
+        if (grown == NULL) {
+            return SIZE_MAX;
+        }
+        strings = grown;
+        stringsCapacity = capacity;
+    }
+    va_start(args, format);
+    vsnprintf(strings + stringsLength, needed + 1, format, args);
+    va_end(args);
+    size_t offset = stringsLength;
+    stringsLength += needed;
+    *length = needed;
+    return offset;
+    }
+
+/**
+ * Compression function.
+ * @brief Compresses a body into a gzip stream.
+ * @return Returns the stream, to be freed by the caller, or NULL if it is not at least an eighth smaller.
+ */
+static unsigned char *gzip_body(const unsigned char *body, size_t length, size_t *gzipLength) {
+    if (length < MIN_GZIP_LENGTH) {
+        return NULL;
+    }
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t limit = length - length / 8;
+    unsigned char *gzip = malloc(limit);
+    if (gzip == NULL) {
+        deflateEnd(&stream);
+        return NULL;
+    }
+    stream.next_in = (unsigned char *)body;
+    stream.avail_in = length;
+    stream.next_out = gzip;
+    stream.avail_out = limit;
+    int res = deflate(&stream, Z_FINISH);
+    *gzipLength = stream.total_out;
+    deflateEnd(&stream);
+    if (res != Z_STREAM_END) {
+        free(gzip);
+        return NULL;
+    }
+    return gzip;
+    }
+
+/**
+ * File packing function.
+ * @brief Writes the body of a file, and its gzip variant, into the archive and adds its entry to the index.
+ * @return Returns 0, or -1 if the file could not be read or the archive not be written.
+ */
+static int pack_file(const char *fsPath, const char *urlPath, off_t size) {
+    int fd = open(fsPath, O_RDONLY);
+    if (fd < 0) {
+        perror("open() failed");
+        return -1;
+    }
+    const unsigned char *body = (const unsigned char *)"";
+    if (size > 0) {
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap() failed");
+            close(fd);
+            return -1;
+        }
+        body = map;
+    }
+    close(fd);
+
+    if (entryCount == entryCapacity) {
+        uint32_t capacity = entryCapacity > 0 ? 2 * entryCapacity : 256;
+        struct archive_entry *grown = realloc(entries, capacity * sizeof(struct archive_entry));
+        if (grown == NULL) {
+            if (size > 0) {
+                munmap((void *)body, size);
+            }
+            return -1;
+        }
+        entries = grown;
+        entryCapacity = capacity;
+    }
+
+    struct archive_entry *entry = &entries[entryCount];
+    memset(entry, 0, sizeof(struct archive_entry));
+    size_t gzipLength = 0;
+    unsigned char *gzip = gzip_body(body, size, &gzipLength);
+    const char *vary = gzip != NULL ? "Vary: Accept-Encoding\r\n" : "";
+    const char *type = mime_type(fsPath);
+    char etag[32];
+    int res = 0;
+
+    //both ETag lines have the same length, so the 304 header lines are as long for either variant
+    snprintf(etag, sizeof(etag), "ETag: \"%016llx\"\r\n", (unsigned long long)archive_hash((const char *)body, size));
+    entry->hash = archive_hash(urlPath, strlen(urlPath));
+    entry->pathOffset = add_string(&entry->pathLength, "%s", urlPath);
+    entry->headersOffset = add_string(&entry->headersLength, "%s%sContent-Type: %s\r\nContent-Length: %lld\r\n",
+                                      etag, vary, type, (long long)size);
+    entry->notModifiedLength = strlen(etag) + strlen(vary);
+    entry->bodyLength = size;
+    entry->bodyOffset = write_body(body, size);
+    if (entry->pathOffset == SIZE_MAX || entry->headersOffset == SIZE_MAX || entry->bodyOffset == 0) {
+        res = -1;
+    }
+
+    if (res == 0 && gzip != NULL) {
+        snprintf(etag, sizeof(etag), "ETag: \"%016llx\"\r\n",
+                 (unsigned long long)archive_hash((const char *)gzip, gzipLength));
+        entry->gzipHeadersOffset = add_string(&entry->gzipHeadersLength, "%s%sContent-Type: %s\r\n"
+                                              "Content-Encoding: gzip\r\nContent-Length: %zu\r\n",
+                                              etag, vary, type, gzipLength);
+        entry->gzipLength = gzipLength;
+        entry->gzipOffset = write_body(gzip, gzipLength);
+        if (entry->gzipHeadersOffset == SIZE_MAX || entry->gzipOffset == 0) {
+            res = -1;
+        }
+        gzipCount++;
+    }
+
+    free(gzip);
+    if (size > 0) {
+        munmap((void *)body, size);
+    }
+    if (res == 0) {
+        entryCount++;
+    }
+    return res;
+    }
+
+/**
+ * Directory packing function.
+ * @brief Packs the files of a directory and its subdirectories, as the paths below 'urlPrefix'.
+ * @details Symbolic links to files are followed, symbolic links to directories are not, so that the walk ends.
+ * @return Returns 0, or -1 if packing failed.
+ */
+static int pack_dir(const char *dirPath, const char *urlPrefix) {
+    DIR *dir = opendir(dirPath);
+    if (dir == NULL) {
+        perror("opendir() failed");
+        return -1;
+    }
+    int res = 0;
+    struct dirent *file;
+    while (res == 0 && (file = readdir(dir)) != NULL) {
+        if (strcmp(file->d_name, ".") == 0 || strcmp(file->d_name, "..") == 0) {
+            continue;
+        }
+        char fsPath[MAX_PATH_LENGTH];
+        char urlPath[MAX_PATH_LENGTH];
+        if (snprintf(fsPath, sizeof(fsPath), "%s/%s", dirPath, file->d_name) >= (int)sizeof(fsPath) ||
+            snprintf(urlPath, sizeof(urlPath), "%s/%s", urlPrefix, file->d_name) >= (int)sizeof(urlPath)) {
+            fprintf(stderr, "Path too long: %s/%s\n", dirPath, file->d_name);
+            res = -1;
+            break;
+        }
+
+        struct stat st;
+        if (lstat(fsPath, &st) != 0) {
+            perror("lstat() failed");
+            res = -1;
+        }
+        else if (S_ISDIR(st.st_mode)) {
+            res = pack_dir(fsPath, urlPath);
+        }
+        else if (S_ISLNK(st.st_mode) && stat(fsPath, &st) == 0 && S_ISREG(st.st_mode)) {
+            res = pack_file(fsPath, urlPath, st.st_size);
+        }
+        else if (S_ISREG(st.st_mode)) {
+            res = pack_file(fsPath, urlPath, st.st_size);
+        }
+    }
+    closedir(dir);
+    return res;
+    }
+
+/**
+ * Index writing function.
+ * @brief Writes the slot table, the entries and the strings after the bodies, and then the header pointing to them.
+ * @return Returns 0, or -1 if memory is short or writing failed.
+ */
+static int write_index(void) {
+    uint32_t slotCount = 16;
+    while (slotCount < 2 * entryCount) {
+        slotCount *= 2;
+    }
+    uint32_t *slots = calloc(slotCount, sizeof(uint32_t));
+    if (slots == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < entryCount; i++) {
+        uint32_t slot = entries[i].hash & (slotCount - 1);
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slotCount - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    struct archive_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+    header.slotCount = slotCount;
+    header.entryCount = entryCount;
+    header.slotsOffset = (outOffset + 7) / 8 * 8;
+    header.entriesOffset = (header.slotsOffset + (uint64_t)slotCount * sizeof(uint32_t) + 7) / 8 * 8;
+    uint64_t stringsOffset = header.entriesOffset + (uint64_t)entryCount * sizeof(struct archive_entry);
+    header.size = stringsOffset + stringsLength;
+
+    for (uint32_t i = 0; i < entryCount; i++) {
+        entries[i].pathOffset += stringsOffset;
+        entries[i].headersOffset += stringsOffset;
+        if (entries[i].gzipLength > 0) {
+            entries[i].gzipHeadersOffset += stringsOffset;
+        }
+    }
+    int res = write_at(slots, slotCount * sizeof(uint32_t), header.slotsOffset) != 0 ||
+              write_at(entries, entryCount * sizeof(struct archive_entry), header.entriesOffset) != 0 ||
+              write_at(strings, stringsLength, stringsOffset) != 0 ||
+              ftruncate(out, header.size) != 0 ||
+              write_at(&header, sizeof(header), 0) != 0 ? -1 : 0;
+    free(slots);
+    return res;
+    }
+
+/**
+ * Archive packer.
+ * @brief Packs the document root DOC_ROOT into the archive ARCHIVE, which the server serves when it is given as
+ * its document root.
+ * @details The archive is written next to ARCHIVE and renamed over it when it is complete, so that a server
+ * starting meanwhile never maps half an archive. -T reads a mime.types file whose types take precedence over the
+ * built-in ones.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char *argv[]) {
+    MYPROG = argv[0];
+    int opt;
+    while ((opt = getopt(argc, argv, "T:")) != -1) {
+        switch (opt) {
+            case 'T':
+                if (mime_load(optarg) != 0) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage("Unknown Option!");
+                break;
+        }
+    }
+    if (optind != argc - 2) {
+        usage("Too many or lacking input arguments");
+    }
+    const char *docRoot = argv[optind];
+    const char *archivePath = argv[optind + 1];
+
+    char tempPath[MAX_PATH_LENGTH];
+    if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", archivePath) >= (int)sizeof(tempPath)) {
+        usage("Archive path too long");
+    }
+    out = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror("open() failed");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t rootLength = strlen(docRoot);
+    while (rootLength > 1 && docRoot[rootLength - 1] == '/') {
+        rootLength--;
+    }
+    char root[MAX_PATH_LENGTH];
+    snprintf(root, sizeof(root), "%.*s", (int)rootLength, docRoot);
+
+    int res = pack_dir(root, "");
+    if (res == 0) {
+        res = write_index();
+    }
+    if (res == 0 && fsync(out) != 0) {
+        perror("fsync() failed");
+        res = -1;
+    }
+    close(out);
+    if (res == 0 && rename(tempPath, archivePath) != 0) {
+        perror("rename() failed");
+        res = -1;
+    }
+    if (res != 0) {
+        unlink(tempPath);
+    }
+    else {
+        printf("Packed %u files, %zu of them with a gzip variant, into %s\n", entryCount, gzipCount, archivePath);
+    }
+
+    free(entries);
+    free(strings);
+    mime_free();
+    return res == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
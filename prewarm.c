@@ -0,0 +1,369 @@
+/**
+*@file prewarm.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Cache prewarming.
+*
+* What loading a file means depends on its site: files of sites with a cache are read into it, the bodies of
+* archives are paged in with madvise(), and files of other sites are read ahead into the page cache. Access logs
+* are read in the Common or Combined Log Format, as written by the proxies and servers in front of or before this
+* one.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "cache.h"
+#include "metrics.h"
+#include "mime.h"
+#include "prewarm.h"
+#include "vhost.h"
+
+#define MAX_LINE_LENGTH 8192
+#define MAX_PATH_LENGTH 4096
+
+/** How often a path was requested successfully, in an open addressing table. */
+struct path_count {
+    char *path;
+    size_t count;
+};
+
+static int add_item(struct prewarm *prewarm, size_t *capacity, const char *host, const char *path, size_t pathLength) {
+    if (prewarm->itemCount == *capacity) {
+        size_t grown = *capacity > 0 ? 2 * *capacity : 256;
+        struct prewarm_item *items = realloc(prewarm->items, grown * sizeof(struct prewarm_item));
+        if (items == NULL) {
+            return -1;
+        }
+        prewarm->items = items;
+        *capacity = grown;
+    }
+    struct prewarm_item *item = &prewarm->items[prewarm->itemCount];
+    item->host = host != NULL ? strdup(host) : NULL;
+    item->path = strndup(path, pathLength);
+    if ((host != NULL && item->host == NULL) || item->path == NULL) {
+        free(item->host);
+        free(item->path);
+        return -1;
+    }
+    prewarm->itemCount++;
+    return 0;
+    }
+
+/**
+ * Manifest function.
+ * @brief Adds the paths of a manifest, one "[HOST] PATH" line each, to the items.
+ * @details Empty lines and lines starting with '#' are skipped, as are paths not starting with '/'.
+ * @return Returns 0, or -1 if the manifest could not be read.
+ */
+static int read_manifest(struct prewarm *prewarm, size_t *capacity) {
+    FILE *in = fopen(prewarm->manifest, "r");
+    if (in == NULL) {
+        perror("fopen() failed");
+        return -1;
+    }
+    char line[MAX_LINE_LENGTH];
+    int res = 0;
+    while (res == 0 && run == 1 && fgets(line, sizeof(line), in) != NULL) {
+        line[strcspn(line, "#\r\n")] = '\0';
+        char *first = strtok(line, " \t");
+        char *second = first != NULL ? strtok(NULL, " \t") : NULL;
+        const char *path = second != NULL ? second : first;
+        if (path != NULL && path[0] == '/') {
+            res = add_item(prewarm, capacity, second != NULL ? first : NULL, path, strlen(path));
+        }
+    }
+    fclose(in);
+    return res;
+    }
+
+static uint64_t hash_path(const char *path, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)path[i]) * 1099511628211ull;
+    }
+    return hash;
+    }
+
+/**
+ * Counting function.
+ * @brief Counts one request for a path, growing the table when it is half full.
+ * @return Returns 0, or -1 if memory is short.
+ */
+static int count_path(struct path_count **table, size_t *slotCount, size_t *used, const char *path, size_t length) {
+    if (2 * (*used + 1) > *slotCount) {
+        size_t grownCount = *slotCount > 0 ? 2 * *slotCount : 4096;
+        struct path_count *grown = calloc(grownCount, sizeof(struct path_count));
+        if (grown == NULL) {
+            return -1;
+        }
+        for (size_t i = 0; i < *slotCount; i++) {
+            if ((*table)[i].path != NULL) {
+                size_t slot = hash_path((*table)[i].path, strlen((*table)[i].path)) & (grownCount - 1);
+                while (grown[slot].path != NULL) {
+                    slot = (slot + 1) & (grownCount - 1);
+                }
+                grown[slot] = (*table)[i];
+            }
+        }
+        free(*table);
+        *table = grown;
+        *slotCount = grownCount;
+    }
+
+    size_t slot = hash_path(path, length) & (*slotCount - 1);
+    while ((*table)[slot].path != NULL) {
+        if (strncmp((*table)[slot].path, path, length) == 0 && (*table)[slot].path[length] == '\0') {
+            (*table)[slot].count++;
+            return 0;
+        }
+        slot = (slot + 1) & (*slotCount - 1);
+    }
+    (*table)[slot].path = strndup(path, length);
+    if ((*table)[slot].path == NULL) {
+        return -1;
+    }
+    (*table)[slot].count = 1;
+    (*used)++;
+    return 0;
+    }
+
+static int compare_counts(const void *a, const void *b) {
+    const struct path_count *first = a;
+    const struct path_count *second = b;
+    if (first->count != second->count) {
+        return first->count > second->count ? -1 : 1;
+    }
+    return strcmp(first->path, second->path);
+    }
+
+/**
+ * Access log function.
+ * @brief Adds the most requested paths of an access log to the items, most requested first.
+ * @details Only GET requests answered with 200 or 304 are counted, and paths are counted without their query.
+ * Lines not in the Common or Combined Log Format are skipped.
+ * @return Returns 0, or -1 if the log could not be read.
+ */
+static int read_access_log(struct prewarm *prewarm, size_t *capacity) {
+    FILE *in = fopen(prewarm->accessLog, "r");
+    if (in == NULL) {
+        perror("fopen() failed");
+        return -1;
+    }
+    struct path_count *table = NULL;
+    size_t slotCount = 0;
+    size_t used = 0;
+    char line[MAX_LINE_LENGTH];
+    int res = 0;
+    while (res == 0 && run == 1 && fgets(line, sizeof(line), in) != NULL) {
+        //host ident user [time] "GET /path HTTP/1.1" 200 size ...
+        char *request = strchr(line, '"');
+        if (request == NULL || strncmp(request + 1, "GET /", 5) != 0) {
+            continue;
+        }
+        char *path = request + 5;
+        size_t pathLength = strcspn(path, " ?\"");
+        char *requestEnd = strchr(path + pathLength, '"');
+        if (requestEnd == NULL) {
+            continue;
+        }
+        int status = atoi(requestEnd + 1);
+        if (status == 200 || status == 304) {
+            res = count_path(&table, &slotCount, &used, path, pathLength);
+        }
+    }
+    fclose(in);
+
+    //the table is compacted in place before sorting, so that its paths can still be freed afterwards
+    size_t count = 0;
+    for (size_t i = 0; i < slotCount; i++) {
+        if (table[i].path != NULL) {
+            table[count++] = table[i];
+        }
+    }
+    if (res == 0) {
+        qsort(table, count, sizeof(struct path_count), compare_counts);
+        for (size_t i = 0; i < count && i < prewarm->top && res == 0; i++) {
+            res = add_item(prewarm, capacity, NULL, table[i].path, strlen(table[i].path));
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(table[i].path);
+    }
+    free(table);
+    return res;
+    }
+
+/**
+ * Path loading function.
+ * @brief Loads one file into the cache of its site, or into memory where the site has no cache.
+ * @details Files too large for the cache are skipped, and without a cache only the first PREWARM_READAHEAD bytes
+ * are read, so that a single huge path does not push the files that matter out of the page cache.
+ * @return Returns the number of bytes loaded, 0 if the path names no file or is skipped.
+ */
+static off_t load_item(const struct server_config *config, const struct prewarm_item *item) {
+    const struct site *site = &config->site;
+    if (item->host != NULL && config->vhosts != NULL) {
+        const struct site *named = vhost_find(config->vhosts, item->host, strlen(item->host));
+        if (named != NULL) {
+            site = named;
+        }
+    }
+    if (strstr(item->path, "/..") != NULL) {
+        return 0;
+    }
+    size_t pathLength = strlen(item->path);
+    const char *index = item->path[pathLength - 1] == '/' ? site->defaultFileName : "";
+
+    if (site->archive != NULL) {
+        char path[MAX_PATH_LENGTH];
+        int length = snprintf(path, sizeof(path), "%s%s", item->path, index);
+        const struct archive_entry *entry = length < (int)sizeof(path) ?
+                                            archive_find(site->archive, path, length) : NULL;
+        if (entry == NULL) {
+            return 0;
+        }
+        //bodies start on pages of their own
+        madvise((void *)(site->archive->map + entry->bodyOffset), entry->bodyLength, MADV_WILLNEED);
+        if (entry->gzipLength > 0) {
+            madvise((void *)(site->archive->map + entry->gzipOffset), entry->gzipLength, MADV_WILLNEED);
+        }
+        return entry->bodyLength + entry->gzipLength;
+    }
+
+    char path[MAX_PATH_LENGTH];
+    if (snprintf(path, sizeof(path), "%s%s%s", site->docRoot, item->path, index) >= (int)sizeof(path)) {
+        return 0;
+    }
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    if (site->cache != NULL && (size_t)st.st_size > site->cache->budget / CACHE_OBJECT_SHARE) {
+        close(fd);
+        return 0;
+    }
+    if (site->cache == NULL && st.st_size > PREWARM_READAHEAD) {
+        readahead(fd, 0, PREWARM_READAHEAD);
+        close(fd);
+        return PREWARM_READAHEAD;
+    }
+    //starts reading the whole file at once, rather than page by page as pread() asks for it
+    readahead(fd, 0, st.st_size);
+
+    //no lookup first, which would count as a miss, the caches are empty at startup anyway; every node gets a copy
+    for (size_t i = 0; i < site->cacheShards; i++) {
+        struct cache_entry *entry = cache_load_file(&site->cache[i], path, fd, &st, mime_type(path));
+        if (entry != NULL) {
+            cache_release(entry);
+        }
+    }
+    close(fd);
+    return st.st_size;
+    }
+
+static void *load_items(void *arg) {
+    struct prewarm *prewarm = arg;
+    while (run == 1) {
+        size_t i = __atomic_fetch_add(&prewarm->next, 1, __ATOMIC_RELAXED);
+        if (i >= prewarm->itemCount) {
+            break;
+        }
+        off_t loaded = load_item(prewarm->config, &prewarm->items[i]);
+        if (loaded > 0) {
+            METRICS_ADD(prewarmFiles, 1);
+            METRICS_ADD(prewarmBytes, loaded);
+        }
+    }
+    return NULL;
+    }
+
+/**
+ * Planning thread.
+ * @brief Collects the paths to load, loads them with PREWARM_THREADS - 1 helpers, and reports how long it took.
+ */
+static void *plan(void *arg) {
+    struct prewarm *prewarm = arg;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t capacity = 0;
+    if ((prewarm->manifest != NULL && read_manifest(prewarm, &capacity) != 0) ||
+        (prewarm->accessLog != NULL && read_access_log(prewarm, &capacity) != 0)) {
+        fprintf(stderr, "Prewarming stopped after %zu paths\n", prewarm->itemCount);
+    }
+
+    pthread_t helpers[PREWARM_THREADS - 1];
+    int started = 0;
+    for (; started < PREWARM_THREADS - 1 && (size_t)started + 1 < prewarm->itemCount; started++) {
+        if (pthread_create(&helpers[started], NULL, load_items, prewarm) != 0) {
+            perror("pthread_create() failed");
+            break;
+        }
+    }
+    load_items(prewarm);
+    for (int i = 0; i < started; i++) {
+        pthread_join(helpers[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    fprintf(stdout, "Prewarmed %llu of %zu paths, %llu bytes, in %ld ms\n",
+            (unsigned long long)__atomic_load_n(&metrics.prewarmFiles, __ATOMIC_RELAXED), prewarm->itemCount,
+            (unsigned long long)__atomic_load_n(&metrics.prewarmBytes, __ATOMIC_RELAXED), elapsed);
+    fflush(stdout);
+
+    for (size_t i = 0; i < prewarm->itemCount; i++) {
+        free(prewarm->items[i].host);
+        free(prewarm->items[i].path);
+    }
+    free(prewarm->items);
+    prewarm->items = NULL;
+    prewarm->itemCount = 0;
+    return NULL;
+    }
+
+/**
+ * Prewarming function.
+ * @brief Starts loading the files of the manifest and the access log in the background.
+ * @return Returns 0, or -1 if the planning thread could not be started.
+ */
+int prewarm_start(struct prewarm *prewarm) {
+    prewarm->items = NULL;
+    prewarm->itemCount = 0;
+    prewarm->next = 0;
+    if (pthread_create(&prewarm->thread, NULL, plan, prewarm) != 0) {
+        perror("pthread_create() failed");
+        return -1;
+    }
+    prewarm->running = true;
+    return 0;
+    }
+
+/**
+ * Prewarming shutdown function.
+ * @brief Waits for the prewarming threads, which stop early with the server.
+ */
+void prewarm_stop(struct prewarm *prewarm) {
+    if (prewarm->running) {
+        pthread_join(prewarm->thread, NULL);
+        prewarm->running = false;
+    }
+    }
@@ -0,0 +1,52 @@
+/**
+*@file prewarm.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Cache prewarming.
+*
+* Loads the files a freshly started server is going to be asked for, named by a manifest or by the most requested
+* paths of an access log, in background threads while the server already accepts connections.
+**/
+
+#ifndef PREWARM_H
+#define PREWARM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "server.h"
+
+#define PREWARM_THREADS 4
+#define DEFAULT_PREWARM_TOP 1000
+#define PREWARM_READAHEAD (4 * 1024 * 1024)
+
+/** A path to load, of the site of 'host', or of the default site if 'host' is NULL. */
+struct prewarm_item {
+    char *host;
+    char *path;
+};
+
+/**
+ * A prewarming run. The paths of 'manifest' and the 'top' most requested paths of 'accessLog', either of which
+ * may be NULL, are collected into 'items' by a planning thread, which then loads them together with helpers.
+ * 'next' is the index of the next item to load, taken by the loading threads with atomic increments.
+ */
+struct prewarm {
+    const struct server_config *config;
+    const char *manifest;
+    const char *accessLog;
+    size_t top;
+
+    pthread_t thread;
+    bool running;
+    struct prewarm_item *items;
+    size_t itemCount;
+    size_t next;
+};
+
+int prewarm_start(struct prewarm *prewarm);
+void prewarm_stop(struct prewarm *prewarm);
+
+#endif
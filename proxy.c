@@ -0,0 +1,938 @@
+/**
+*@file proxy.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Reverse proxy.
+*
+* Forwards requests to upstream HTTP/1.1 servers. Each route balances over its upstreams by least connections,
+* skipping those the health checker found down. Upstream connections are kept alive and pooled per upstream, so
+* that a proxied request normally costs no connection setup at all.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+#include "metrics.h"
+#include "proxy.h"
+
+#define CONNECT_TIMEOUT_MS 2000
+#define UPSTREAM_TIMEOUT 30
+#define HEALTH_INTERVAL 2
+
+/**
+ * Upstream parsing function.
+ * @brief Resolves one "HOST:PORT" (or "[ADDRESS]:PORT") of a route.
+ * @return Returns the new upstream, or NULL if it is invalid or cannot be resolved.
+ */
+static struct upstream *new_upstream(const char *spec, size_t length) {
+    char name[MAX_UPSTREAM_NAME];
+    if (length == 0 || length >= sizeof(name)) {
+        return NULL;
+    }
+    memcpy(name, spec, length);
+    name[length] = '\0';
+
+    char *colon = strrchr(name, ':');
+    if (colon == NULL || colon[1] == '\0') {
+        return NULL;
+    }
+    *colon = '\0';
+    char *host = name;
+    if (host[0] == '[' && colon[-1] == ']') {
+        host++;
+        colon[-1] = '\0';
+    }
+
+    struct addrinfo hints, *results;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, colon + 1, &hints, &results) != 0) {
+        return NULL;
+    }
+
+    struct upstream *up = calloc(1, sizeof(struct upstream));
+    if (up != NULL) {
+        memcpy(up->name, spec, length);
+        up->name[length] = '\0';
+        memcpy(&up->address, results->ai_addr, results->ai_addrlen);
+        up->addressLength = results->ai_addrlen;
+        pthread_mutex_init(&up->lock, NULL);
+        up->healthy = true;
+    }
+    freeaddrinfo(results);
+    return up;
+    }
+
+/**
+ * Route function.
+ * @brief Adds a route given as "PREFIX=HOST:PORT[,HOST:PORT...]".
+ * @return Returns 0, or -1 if the route is invalid.
+ */
+int proxy_add_route(struct proxy *proxy, const char *spec) {
+    const char *equals = strchr(spec, '=');
+    if (proxy->routeCount == MAX_ROUTES || equals == NULL || spec[0] != '/' ||
+        (size_t)(equals - spec) >= MAX_TARGET_LENGTH) {
+        return -1;
+    }
+
+    struct route *route = &proxy->routes[proxy->routeCount];
+    memset(route, 0, sizeof(*route));
+    route->prefixLength = equals - spec;
+    memcpy(route->prefix, spec, route->prefixLength);
+
+    const char *pos = equals + 1;
+    while (*pos != '\0') {
+        size_t length = strcspn(pos, ",");
+        struct upstream *up = route->count < MAX_UPSTREAMS ? new_upstream(pos, length) : NULL;
+        if (up == NULL) {
+            return -1;
+        }
+        route->upstreams[route->count++] = up;
+        proxy->upstreams[proxy->upstreamCount++] = up;
+        pos += length;
+        if (*pos == ',') {
+            pos++;
+        }
+    }
+    if (route->count == 0) {
+        return -1;
+    }
+    proxy->routeCount++;
+    return 0;
+    }
+
+/**
+ * Route lookup function.
+ * @brief Finds the route with the longest prefix of 'path'.
+ * @details A prefix only matches whole path segments, so '/api' takes '/api/users' and '/api?q' but not '/apiary'.
+ * @return Returns the route, or NULL if the path is served from the document root.
+ */
+struct route *proxy_match(struct proxy *proxy, const char *path) {
+    struct route *best = NULL;
+    for (size_t i = 0; i < proxy->routeCount; i++) {
+        struct route *route = &proxy->routes[i];
+        if (strncmp(path, route->prefix, route->prefixLength) != 0) {
+            continue;
+        }
+        char next = path[route->prefixLength];
+        bool segment = route->prefix[route->prefixLength - 1] == '/' || next == '\0' || next == '/' || next == '?';
+        if (segment && (best == NULL || route->prefixLength > best->prefixLength)) {
+            best = route;
+        }
+    }
+    return best;
+    }
+
+/**
+ * Connection function.
+ * @brief Opens a new connection to an upstream, giving up after CONNECT_TIMEOUT_MS.
+ * @return Returns the connected socket, or -1.
+ */
+static int connect_upstream(const struct upstream *up) {
+    int fd = socket(up->address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)&up->address, up->addressLength) != 0) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (errno != EINPROGRESS || poll(&pfd, 1, CONNECT_TIMEOUT_MS) != 1 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    struct timeval timeout = { UPSTREAM_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return fd;
+    }
+
+/**
+ * Connection acquiring function.
+ * @brief Takes an idle connection from the pool of the upstream, or opens a new one.
+ * @details Pooled connections the upstream has closed in the meantime are readable, they are dropped here.
+ * @return Returns the socket, or -1 if no connection could be established.
+ */
+static int acquire_connection(struct upstream *up, bool *reused) {
+    for (;;) {
+        pthread_mutex_lock(&up->lock);
+        int fd = up->idleCount > 0 ? up->idle[--up->idleCount] : -1;
+        pthread_mutex_unlock(&up->lock);
+        if (fd < 0) {
+            break;
+        }
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) == 0) {
+            *reused = true;
+            METRICS_ADD(upstreamReuses, 1);
+            return fd;
+        }
+        close(fd);
+    }
+
+    *reused = false;
+    int fd = connect_upstream(up);
+    if (fd < 0) {
+        __atomic_store_n(&up->healthy, false, __ATOMIC_RELAXED);
+        return -1;
+    }
+    METRICS_ADD(upstreamConnects, 1);
+    return fd;
+    }
+
+static void release_connection(struct upstream *up, int fd) {
+    pthread_mutex_lock(&up->lock);
+    if (up->idleCount < UPSTREAM_POOL_SIZE) {
+        up->idle[up->idleCount++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&up->lock);
+    if (fd >= 0) {
+        close(fd);
+    }
+    }
+
+/**
+ * Balancing function.
+ * @brief Picks the healthy upstream of a route with the fewest requests in flight and counts one more for it.
+ * @details Ties are broken round robin, so that idle upstreams share the load.
+ * @return Returns the upstream, or NULL if all of them are down.
+ */
+static struct upstream *pick_upstream(struct route *route) {
+    unsigned int start = __atomic_fetch_add(&route->next, 1, __ATOMIC_RELAXED);
+    struct upstream *best = NULL;
+    int bestActive = 0;
+
+    for (size_t n = 0; n < route->count; n++) {
+        struct upstream *up = route->upstreams[(start + n) % route->count];
+        int active = __atomic_load_n(&up->active, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&up->healthy, __ATOMIC_RELAXED) && (best == NULL || active < bestActive)) {
+            best = up;
+            bestActive = active;
+        }
+    }
+    if (best != NULL) {
+        __atomic_fetch_add(&best->active, 1, __ATOMIC_RELAXED);
+    }
+    return best;
+    }
+
+static int send_all(int fd, const void *buf, size_t len) {
+    const char *pos = buf;
+    while (len > 0) {
+        ssize_t sent = send(fd, pos, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        pos += sent;
+        len -= sent;
+    }
+    return 0;
+    }
+
+/**
+ * Header copying function.
+ * @brief Copies the header lines of 'req' to 'out', which holds at least MAX_HEADERS_LENGTH + 100 bytes, with a
+ * single X-Forwarded-For field that appends the address of the client to the chain the request came with.
+ * @return Returns the number of bytes written.
+ */
+static int copy_headers(char *out, const struct request *req) {
+    char chain[MAX_HEADERS_LENGTH];
+    size_t chainLength = 0;
+    int length = 0;
+    const char *end = req->headers + req->headersLength;
+    //the lines were written by add_request_header(), each ends in CRLF
+    for (const char *line = req->headers; line < end;) {
+        const char *next = (const char *)memchr(line, '\n', end - line) + 1;
+        if (next - line > 16 && strncasecmp(line, "X-Forwarded-For:", 16) == 0) {
+            const char *value = line + 16;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            size_t valueLength = next - 2 - value;
+            if (valueLength > 0) {
+                if (chainLength > 0) {
+                    memcpy(chain + chainLength, ", ", 2);
+                    chainLength += 2;
+                }
+                memcpy(chain + chainLength, value, valueLength);
+                chainLength += valueLength;
+            }
+        }
+        else {
+            memcpy(out + length, line, next - line);
+            length += next - line;
+        }
+        line = next;
+    }
+    if (chainLength > 0 || req->clientAddress[0] != '\0') {
+        length += sprintf(out + length, "X-Forwarded-For: %.*s%s%s\r\n", (int)chainLength, chain,
+                          chainLength > 0 && req->clientAddress[0] != '\0' ? ", " : "", req->clientAddress);
+    }
+    return length;
+    }
+
+/**
+ * Request forwarding function.
+ * @brief Sends the request head and, if there is one, the request body to the upstream.
+ * @return Returns 0, or -1 on failure.
+ */
+static int send_request(int fd, const struct request *req) {
+    char head[MAX_METHOD_LENGTH + MAX_TARGET_LENGTH + MAX_HEADERS_LENGTH + 160];
+    int length = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\n", req->method, req->path);
+    length += copy_headers(head + length, req);
+    if (req->bodyLength > 0) {
+        length += snprintf(head + length, sizeof(head) - length, "Content-Length: %lld\r\n", (long long)req->bodyLength);
+    }
+    length += snprintf(head + length, sizeof(head) - length, "\r\n");
+    if (send_all(fd, head, length) != 0) {
+        return -1;
+    }
+
+    if (req->bodyLength <= 0) {
+        return 0;
+    }
+    if (send_all(fd, req->bodyStart, req->bodyBuffered) != 0) {
+        return -1;
+    }
+    off_t remaining = req->bodyLength - req->bodyBuffered;
+    char buffer[UPSTREAM_BUFFER_SIZE];
+    while (remaining > 0) {
+        ssize_t n = conn_recv(req->conn, buffer, remaining < (off_t)sizeof(buffer) ? (size_t)remaining : sizeof(buffer));
+        if (n <= 0 || send_all(fd, buffer, n) != 0) {
+            return -1;
+        }
+        remaining -= n;
+    }
+    return 0;
+    }
+
+/**
+ * Buffer filling function.
+ * @brief Reads more of the upstream response into the buffer, moving unread data to its start first.
+ * @return Returns the number of bytes read, 0 if the upstream closed the connection, or -1 on failure.
+ */
+static ssize_t fill_buffer(struct upstream_response *ur) {
+    if (ur->bufferStart > 0) {
+        memmove(ur->buffer, ur->buffer + ur->bufferStart, ur->bufferEnd - ur->bufferStart);
+        ur->bufferEnd -= ur->bufferStart;
+        ur->bufferStart = 0;
+    }
+    if (ur->bufferEnd == sizeof(ur->buffer)) {
+        return -1;
+    }
+    ssize_t n;
+    do {
+        n = recv(ur->fd, ur->buffer + ur->bufferEnd, sizeof(ur->buffer) - ur->bufferEnd, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        ur->bufferEnd += n;
+    }
+    return n;
+    }
+
+/**
+ * Line function.
+ * @brief Finds the end of the next CRLF-terminated line in the buffer, reading more as needed.
+ * @return Returns a pointer to the CR, or NULL if the upstream failed before sending a complete line.
+ */
+static char *next_line(struct upstream_response *ur) {
+    for (;;) {
+        char *start = ur->buffer + ur->bufferStart;
+        char *end = memchr(start, '\n', ur->bufferEnd - ur->bufferStart);
+        if (end != NULL && end > start && end[-1] == '\r') {
+            return end - 1;
+        }
+        if (end != NULL) {
+            return NULL;
+        }
+        if (fill_buffer(ur) <= 0) {
+            return NULL;
+        }
+    }
+    }
+
+/**
+ * Response head function.
+ * @brief Reads and parses the status line and header of the upstream response, skipping interim 1xx responses.
+ * @details Hop-by-hop header fields are dropped, the others are kept to be forwarded to the client.
+ * @return Returns 0, or -1 if the upstream failed or sent something that is not HTTP/1.x.
+ */
+static int read_response_head(struct upstream_response *ur, const struct request *req) {
+    bool keepAlive;
+    do {
+        char *end = next_line(ur);
+        if (end == NULL) {
+            return -1;
+        }
+        *end = '\0';
+        char *line = ur->buffer + ur->bufferStart;
+        ur->bufferStart = end + 2 - ur->buffer;
+
+        int minor;
+        int consumed = 0;
+        if (sscanf(line, "HTTP/1.%d %3d%n", &minor, &ur->status, &consumed) != 2 || ur->status < 100 || ur->status > 999) {
+            return -1;
+        }
+        const char *reason = line + consumed;
+        while (*reason == ' ') {
+            reason++;
+        }
+        snprintf(ur->reason, sizeof(ur->reason), "%s", reason);
+        keepAlive = minor >= 1;
+
+        ur->headersLength = 0;
+        ur->contentLength = -1;
+        ur->chunked = false;
+        for (;;) {
+            end = next_line(ur);
+            if (end == NULL) {
+                return -1;
+            }
+            line = ur->buffer + ur->bufferStart;
+            size_t length = end - line;
+            ur->bufferStart = end + 2 - ur->buffer;
+            if (length == 0) {
+                break;
+            }
+
+            char *colon = memchr(line, ':', length);
+            if (colon == NULL) {
+                return -1;
+            }
+            size_t nameLength = colon - line;
+            char *value = colon + 1;
+            while (value < end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            size_t valueLength = end - value;
+
+            if (nameLength == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                char *numberEnd;
+                ur->contentLength = strtoll(value, &numberEnd, 10);
+                if (numberEnd == value || ur->contentLength < 0) {
+                    return -1;
+                }
+            }
+            else if (nameLength == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                ur->chunked = valueLength >= 7 && strncasecmp(end - 7, "chunked", 7) == 0;
+                if (!ur->chunked) {
+                    return -1;
+                }
+                continue;
+            }
+            else if (nameLength == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                if (valueLength >= 5 && strncasecmp(value, "close", 5) == 0) {
+                    keepAlive = false;
+                }
+                else if (valueLength >= 10 && strncasecmp(value, "keep-alive", 10) == 0) {
+                    keepAlive = true;
+                }
+            }
+            if (is_hop_by_hop(line, nameLength)) {
+                continue;
+            }
+            if (ur->headersLength + length + 2 > sizeof(ur->headers)) {
+                return -1;
+            }
+            memcpy(ur->headers + ur->headersLength, line, length);
+            memcpy(ur->headers + ur->headersLength + length, "\r\n", 2);
+            ur->headersLength += length + 2;
+        }
+    } while (ur->status < 200);
+
+    if (ur->chunked) {
+        ur->contentLength = -1;
+    }
+    ur->reusable = keepAlive;
+    //a chunked body starts with a chunk size line, the remaining length is only used for the current chunk then
+    ur->remaining = ur->chunked ? 0 : ur->contentLength;
+    ur->done = strcmp(req->method, "HEAD") == 0 || ur->status == 204 || ur->status == 304 || ur->contentLength == 0;
+    if (!ur->done && !ur->chunked && ur->contentLength < 0) {
+        //the body ends with the connection
+        ur->reusable = false;
+    }
+    return 0;
+    }
+
+/**
+ * Exchange function.
+ * @brief Sends a request on a connection to 'ur->upstream' and reads the head of the response.
+ * @details A pooled connection may have been closed by the upstream just as it was taken. If it fails before
+ * any response arrives, a request without body is retried once on a new connection.
+ * @return Returns 0, or -1 if the upstream failed.
+ */
+static int exchange(struct upstream_response *ur, const struct request *req) {
+    bool reused = false;
+    ur->fd = acquire_connection(ur->upstream, &reused);
+    for (int attempt = 0; ur->fd >= 0; attempt++) {
+        ur->bufferStart = 0;
+        ur->bufferEnd = 0;
+        ur->chunkCrlf = false;
+        if (send_request(ur->fd, req) == 0 && read_response_head(ur, req) == 0) {
+            return 0;
+        }
+        close(ur->fd);
+        if (attempt > 0 || !reused || ur->bufferEnd > 0 || req->bodyLength > 0) {
+            break;
+        }
+        if ((ur->fd = connect_upstream(ur->upstream)) >= 0) {
+            METRICS_ADD(upstreamConnects, 1);
+        }
+    }
+    return -1;
+    }
+
+/**
+ * Forwarding function.
+ * @brief Forwards a request to an upstream of its route and fills in the response with the upstream response,
+ * whose body is then relayed by the caller.
+ * @details An upstream that cannot be connected to is marked as down and the next one is tried. Once a request
+ * has been sent, a failure is answered with 502 rather than repeating a request that may not be idempotent.
+ */
+static void forward_request(struct route *route, const struct request *req, struct response *resp) {
+    resp->status = 502;
+    if (req->bodyLength < 0) {
+        resp->status = 501;
+        return;
+    }
+    struct upstream_response *ur = malloc(sizeof(struct upstream_response));
+    if (ur == NULL) {
+        resp->status = 500;
+        return;
+    }
+    ur->pipe[0] = -1;
+    ur->pipe[1] = -1;
+
+    for (size_t tries = 0; tries < route->count; tries++) {
+        ur->upstream = pick_upstream(route);
+        if (ur->upstream == NULL) {
+            break;
+        }
+        if (exchange(ur, req) == 0) {
+            resp->status = ur->status;
+            resp->upstream = ur;
+            resp->length = ur->done ? 0 : ur->contentLength;
+            resp->reason = ur->reason;
+            resp->headers = ur->headers;
+            resp->headersLength = ur->headersLength;
+            return;
+        }
+        METRICS_ADD(upstreamFailures, 1);
+        __atomic_fetch_sub(&ur->upstream->active, 1, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&ur->upstream->healthy, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    free(ur);
+    }
+
+/** Serves a response from a cache entry, whose reference the response takes over. */
+static void serve_cached(struct cache_entry *entry, const struct request *req, struct response *resp) {
+    resp->status = entry->status;
+    resp->cached = entry;
+    resp->reason = entry->reason;
+    resp->headers = entry->headers;
+    resp->headersLength = entry->headersLength;
+    resp->data = entry->body;
+    resp->length = strcmp(req->method, "HEAD") == 0 ? 0 : (off_t)entry->bodyLength;
+    }
+
+/**
+ * Store function.
+ * @brief Reads the body of an upstream response into a new cache entry if the response may be stored, and turns
+ * the response into one served from that entry.
+ * @details Only bodies of known length are stored. Their upstream connection goes back to the pool as soon as the
+ * body is read, before anything is sent to the client. An upstream failing midway leaves a 502.
+ * @return Returns true if the response was stored.
+ */
+static bool store_response(struct cache *cache, const char *key, const struct request *req, struct response *resp) {
+    struct upstream_response *ur = resp->upstream;
+    if (ur->contentLength < 0) {
+        return false;
+    }
+    struct cache_entry *entry = cache_prepare(cache, key, ur->status, ur->reason, ur->headers, ur->headersLength,
+                                              req->headers, req->headersLength, ur->done ? 0 : ur->contentLength);
+    if (entry == NULL) {
+        return false;
+    }
+
+    size_t received = 0;
+    while (received < entry->bodyLength) {
+        ssize_t n = upstream_read_body(ur, entry->body + received, entry->bodyLength - received);
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    upstream_finish(ur);
+    resp->upstream = NULL;
+    resp->headers = NULL;
+    if (received < entry->bodyLength) {
+        METRICS_ADD(upstreamFailures, 1);
+        cache_release(entry);
+        resp->status = 502;
+        resp->length = 0;
+        return false;
+    }
+
+    cache_insert(entry);
+    serve_cached(entry, req, resp);
+    return true;
+    }
+
+/**
+ * Proxy function.
+ * @brief Answers a request under a route, from the cache if it holds a fresh response, from an upstream otherwise.
+ * @details A GET that misses either fetches the response and stores it, or waits for the request that is already
+ * fetching it, see cache_lookup(). Responses are cached per host and target, unless the two do not fit into a
+ * key of CACHE_MAX_KEY bytes.
+ */
+void proxy_request(struct proxy *proxy, struct route *route, const struct request *req, struct response *resp) {
+    METRICS_ADD(proxyRequests, 1);
+    char key[CACHE_MAX_KEY];
+    bool leader = false;
+
+    struct cache *cache = proxy->cache;
+    if (cache != NULL && cache_request_allowed(req->method, req->headers, req->headersLength)) {
+        size_t hostLength = 0;
+        const char *host = cache_field(req->headers, req->headersLength, "Host", &hostLength);
+        //a truncated key could name another target, so requests whose key does not fit bypass the cache
+        if (snprintf(key, sizeof(key), "%.*s %s", (int)hostLength, host != NULL ? host : "", req->path) <
+            (int)sizeof(key)) {
+            struct cache_entry *entry = cache_lookup(cache, key, req->headers, req->headersLength,
+                                                     strcmp(req->method, "GET") == 0, &leader);
+            if (entry != NULL) {
+                serve_cached(entry, req, resp);
+                return;
+            }
+        }
+    }
+
+    forward_request(route, req, resp);
+    if (leader) {
+        bool stored = resp->upstream != NULL && store_response(cache, key, req, resp);
+        cache_fill_done(cache, key, stored);
+    }
+    }
+
+/**
+ * Chunk size function.
+ * @brief Reads the next chunk size line of a chunked body, and the trailer section after the last chunk.
+ * @return Returns 0, or -1 if the chunked encoding is broken.
+ */
+static int next_chunk(struct upstream_response *ur) {
+    if (ur->chunkCrlf) {
+        char *end = next_line(ur);
+        if (end != ur->buffer + ur->bufferStart) {
+            return -1;
+        }
+        ur->bufferStart += 2;
+        ur->chunkCrlf = false;
+    }
+
+    char *end = next_line(ur);
+    if (end == NULL) {
+        return -1;
+    }
+    char *numberEnd;
+    long long size = strtoll(ur->buffer + ur->bufferStart, &numberEnd, 16);
+    if (numberEnd == ur->buffer + ur->bufferStart || size < 0 || (*numberEnd != '\r' && *numberEnd != ';' &&
+                                                                  *numberEnd != ' ')) {
+        return -1;
+    }
+    ur->bufferStart = end + 2 - ur->buffer;
+    ur->remaining = size;
+
+    if (size == 0) {
+        for (;;) {
+            end = next_line(ur);
+            if (end == NULL) {
+                return -1;
+            }
+            bool last = end == ur->buffer + ur->bufferStart;
+            ur->bufferStart = end + 2 - ur->buffer;
+            if (last) {
+                break;
+            }
+        }
+        ur->done = true;
+    }
+    return 0;
+    }
+
+/**
+ * Body window function.
+ * @brief Clamps 'len' to what may be read of the body next, reading the next chunk size line first if needed.
+ * @return Returns the number of bytes to read, 0 at the end of the body, or -1 if the chunked encoding is broken.
+ */
+static ssize_t body_window(struct upstream_response *ur, size_t len) {
+    if (ur->chunked && !ur->done && ur->remaining == 0 && next_chunk(ur) != 0) {
+        ur->reusable = false;
+        return -1;
+    }
+    if (ur->done) {
+        return 0;
+    }
+    if (ur->remaining >= 0 && (off_t)len > ur->remaining) {
+        len = ur->remaining;
+    }
+    return len;
+    }
+
+/** Accounts for 'n' bytes of the body having been read. */
+static void body_consumed(struct upstream_response *ur, size_t n) {
+    if (ur->remaining >= 0) {
+        ur->remaining -= n;
+        if (ur->remaining == 0) {
+            if (ur->chunked) {
+                ur->chunkCrlf = true;
+            }
+            else {
+                ur->done = true;
+            }
+        }
+    }
+    }
+
+/**
+ * Body reading function.
+ * @brief Reads up to 'len' bytes of the body of an upstream response, removing the chunked encoding.
+ * @return Returns the number of bytes read, 0 at the end of the body, or -1 if the upstream failed.
+ */
+ssize_t upstream_read_body(struct upstream_response *ur, void *buf, size_t len) {
+    ssize_t window = len > 0 ? body_window(ur, len) : 0;
+    if (window <= 0) {
+        return window;
+    }
+    len = window;
+
+    ssize_t n;
+    if (ur->bufferEnd > ur->bufferStart) {
+        n = ur->bufferEnd - ur->bufferStart < len ? ur->bufferEnd - ur->bufferStart : len;
+        memcpy(buf, ur->buffer + ur->bufferStart, n);
+        ur->bufferStart += n;
+    }
+    else {
+        do {
+            n = recv(ur->fd, buf, len, 0);
+        } while (n < 0 && errno == EINTR);
+        if (n == 0 && ur->remaining < 0) {
+            ur->done = true;
+            return 0;
+        }
+        if (n <= 0) {
+            ur->reusable = false;
+            return -1;
+        }
+    }
+    body_consumed(ur, n);
+    return n;
+    }
+
+/**
+ * Pipe function.
+ * @brief Creates the pipe the body of the response is spliced through, unless it already exists.
+ * @return Returns 0, or -1 if no pipe could be created and the body has to be copied.
+ */
+int upstream_open_pipe(struct upstream_response *ur) {
+    if (ur->pipe[0] >= 0) {
+        return 0;
+    }
+    if (pipe2(ur->pipe, O_CLOEXEC) != 0) {
+        perror("pipe2() failed");
+        ur->pipe[0] = -1;
+        ur->pipe[1] = -1;
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Body splicing function.
+ * @brief Moves up to 'len' bytes of the body of an upstream response into its pipe, removing the chunked encoding.
+ * @details The body goes from the upstream socket to the pipe with splice(), without passing through userspace.
+ * Only bytes that were read into the buffer together with the head or a chunk size line are written from there.
+ * The pipe must be open and empty, and 'len' at most UPSTREAM_SPLICE_SIZE, so that this never waits on the pipe.
+ * @return Returns the number of bytes now in the pipe, 0 at the end of the body, or -1 if the upstream failed.
+ */
+ssize_t upstream_splice_body(struct upstream_response *ur, size_t len) {
+    ssize_t window = len > 0 ? body_window(ur, len) : 0;
+    if (window <= 0) {
+        return window;
+    }
+    len = window;
+
+    ssize_t n;
+    if (ur->bufferEnd > ur->bufferStart) {
+        size_t buffered = ur->bufferEnd - ur->bufferStart < len ? ur->bufferEnd - ur->bufferStart : len;
+        do {
+            n = write(ur->pipe[1], ur->buffer + ur->bufferStart, buffered);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            ur->reusable = false;
+            return -1;
+        }
+        ur->bufferStart += n;
+    }
+    else {
+        do {
+            n = splice(ur->fd, NULL, ur->pipe[1], NULL, len, SPLICE_F_MOVE);
+        } while (n < 0 && errno == EINTR);
+        if (n == 0 && ur->remaining < 0) {
+            ur->done = true;
+            return 0;
+        }
+        if (n <= 0) {
+            ur->reusable = false;
+            return -1;
+        }
+        METRICS_ADD(proxyBytesSpliced, n);
+    }
+    body_consumed(ur, n);
+    return n;
+    }
+
+/**
+ * Relay function.
+ * @brief Sends the whole body of an upstream response to the client connection.
+ * @details The body is spliced from socket to socket if the connection takes spliced data, and copied through a
+ * buffer only for userspace TLS, which has to encrypt it.
+ * @return Returns 0, or -1 if the upstream or the client failed.
+ */
+int proxy_relay_body(struct connection *conn, struct upstream_response *ur) {
+    if (conn_can_splice(conn) && upstream_open_pipe(ur) == 0) {
+        for (;;) {
+            ssize_t n = upstream_splice_body(ur, UPSTREAM_SPLICE_SIZE);
+            if (n <= 0) {
+                return n;
+            }
+            if (conn_splice(conn, ur->pipe[0], n, ur->done ? 0 : SPLICE_F_MORE) != 0) {
+                ur->reusable = false;
+                return -1;
+            }
+        }
+    }
+
+    char buffer[UPSTREAM_BUFFER_SIZE];
+    for (;;) {
+        ssize_t n = upstream_read_body(ur, buffer, sizeof(buffer));
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (conn_send_all(conn, buffer, n, 0) != 0) {
+            ur->reusable = false;
+            return -1;
+        }
+    }
+    }
+
+/**
+ * Response release function.
+ * @brief Gives the upstream connection back to the pool if the response was read completely and the upstream
+ * keeps the connection open, closes it otherwise.
+ */
+void upstream_finish(struct upstream_response *ur) {
+    if (ur->done && ur->reusable && ur->bufferStart == ur->bufferEnd) {
+        release_connection(ur->upstream, ur->fd);
+    }
+    else {
+        close(ur->fd);
+    }
+    if (ur->pipe[0] >= 0) {
+        close(ur->pipe[0]);
+        close(ur->pipe[1]);
+    }
+    __atomic_fetch_sub(&ur->upstream->active, 1, __ATOMIC_RELAXED);
+    free(ur);
+    }
+
+/**
+ * Health check function.
+ * @brief Probes every upstream with a TCP connection every HEALTH_INTERVAL seconds until the server stops.
+ * @details An upstream that refuses the probe is skipped by the balancer until a later probe succeeds. Failed
+ * requests mark an upstream as down right away, between probes.
+ */
+static void *check_health(void *arg) {
+    struct proxy *proxy = arg;
+
+    while (run == 1) {
+        for (size_t i = 0; i < proxy->upstreamCount && run == 1; i++) {
+            struct upstream *up = proxy->upstreams[i];
+            int fd = connect_upstream(up);
+            bool healthy = fd >= 0;
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (healthy != __atomic_load_n(&up->healthy, __ATOMIC_RELAXED)) {
+                fprintf(stderr, "Upstream %s is %s\n", up->name, healthy ? "up" : "down");
+            }
+            __atomic_store_n(&up->healthy, healthy, __ATOMIC_RELAXED);
+        }
+        for (int i = 0; i < HEALTH_INTERVAL * 10 && run == 1; i++) {
+            struct timespec pause = { 0, 100000000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+    }
+
+int proxy_start(struct proxy *proxy) {
+    if (pthread_create(&proxy->healthThread, NULL, check_health, proxy) != 0) {
+        perror("pthread_create() failed");
+        return -1;
+    }
+    proxy->healthRunning = true;
+    return 0;
+    }
+
+/**
+ * Proxy shutdown function.
+ * @brief Waits for the health checker, which stops with the server, and closes the pooled connections.
+ */
+void proxy_stop(struct proxy *proxy) {
+    if (proxy->healthRunning) {
+        pthread_join(proxy->healthThread, NULL);
+        proxy->healthRunning = false;
+    }
+    for (size_t i = 0; i < proxy->upstreamCount; i++) {
+        struct upstream *up = proxy->upstreams[i];
+        while (up->idleCount > 0) {
+            close(up->idle[--up->idleCount]);
+        }
+        pthread_mutex_destroy(&up->lock);
+        free(up);
+    }
+    proxy->upstreamCount = 0;
+    proxy->routeCount = 0;
+    }
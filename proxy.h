@@ -0,0 +1,105 @@
+/**
+*@file proxy.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Reverse proxy.
+*
+* Requests under configured path prefixes are forwarded to upstream HTTP/1.1 servers instead of being served from
+* the document root.
+**/
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "cache.h"
+#include "server.h"
+
+#define MAX_ROUTES 16
+#define MAX_UPSTREAMS 16
+#define UPSTREAM_POOL_SIZE 32
+#define UPSTREAM_BUFFER_SIZE 16384
+#define UPSTREAM_SPLICE_SIZE 65536
+#define MAX_UPSTREAM_NAME 280
+
+/** An upstream server with its pool of idle keep-alive connections. */
+struct upstream {
+    char name[MAX_UPSTREAM_NAME];
+    struct sockaddr_storage address;
+    socklen_t addressLength;
+
+    pthread_mutex_t lock;
+    int idle[UPSTREAM_POOL_SIZE];
+    int idleCount;
+
+    int active;
+    bool healthy;
+};
+
+/** A path prefix and the upstreams its requests are balanced over. */
+struct route {
+    char prefix[MAX_TARGET_LENGTH];
+    size_t prefixLength;
+    struct upstream *upstreams[MAX_UPSTREAMS];
+    size_t count;
+    unsigned int next;
+};
+
+/** The routes and upstreams of the proxy. GET responses are kept in 'cache' unless it is NULL. */
+struct proxy {
+    struct route routes[MAX_ROUTES];
+    size_t routeCount;
+    struct upstream *upstreams[MAX_ROUTES * MAX_UPSTREAMS];
+    size_t upstreamCount;
+    pthread_t healthThread;
+    bool healthRunning;
+    struct cache *cache;
+};
+
+/**
+ * The response of an upstream, read as the body is relayed. 'headers' holds its end-to-end header lines, ready to
+ * be forwarded; 'contentLength' is -1 if the body is chunked or ends when the upstream closes. 'pipe' is the pipe
+ * the body is spliced through, created on first use.
+ */
+struct upstream_response {
+    struct upstream *upstream;
+    int fd;
+    int status;
+    char reason[64];
+    char headers[MAX_HEADERS_LENGTH];
+    size_t headersLength;
+
+    off_t contentLength;
+    off_t remaining;
+    bool chunked;
+    bool chunkCrlf;
+    bool done;
+    bool reusable;
+
+    char buffer[UPSTREAM_BUFFER_SIZE];
+    size_t bufferStart;
+    size_t bufferEnd;
+
+    int pipe[2];
+};
+
+int proxy_add_route(struct proxy *proxy, const char *spec);
+int proxy_start(struct proxy *proxy);
+void proxy_stop(struct proxy *proxy);
+
+struct route *proxy_match(struct proxy *proxy, const char *path);
+void proxy_request(struct proxy *proxy, struct route *route, const struct request *req, struct response *resp);
+
+ssize_t upstream_read_body(struct upstream_response *ur, void *buf, size_t len);
+int upstream_open_pipe(struct upstream_response *ur);
+ssize_t upstream_splice_body(struct upstream_response *ur, size_t len);
+int proxy_relay_body(struct connection *conn, struct upstream_response *ur);
+void upstream_finish(struct upstream_response *ur);
+
+#endif
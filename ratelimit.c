@@ -0,0 +1,217 @@
+/**
+*@file ratelimit.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Per-client rate limits.
+*
+* A client hashes to one shard and a home slot in it, and is looked for in the RATELIMIT_PROBES slots from there
+* on, wrapping around within the shard. A client not found takes a free slot among them, or else the one used least
+* recently, so the table forgets the clients that stopped sending first. All updates are atomic, but a slot and its
+* buckets are not claimed together: a client may briefly see the buckets of the client it evicted, which only makes
+* the limits approximate for that moment.
+* Request tokens are counted in thousandths, byte tokens in bytes. The byte bucket is charged with the length of a
+* response once it is known and may go into debt, which keeps the client out until it is paid back.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "ratelimit.h"
+
+#define REQUEST_COST 1000
+#define MAX_REFILL_MS 100000
+
+/**
+ * Initialisation function.
+ * @brief Allocates an empty table for the given limits, either of which is 0 if it is not to be enforced.
+ * @return Returns 0, or -1 on failure.
+ */
+int ratelimit_init(struct rate_limit *limit, uint32_t requestRate, uint32_t byteRate, int prefix) {
+    limit->slots = calloc((size_t)RATELIMIT_SHARDS * RATELIMIT_SHARD_SLOTS, sizeof(struct rate_slot));
+    if (limit->slots == NULL) {
+        perror("calloc() failed");
+        return -1;
+    }
+    limit->requestRate = requestRate;
+    limit->byteRate = byteRate > INT32_MAX ? INT32_MAX : byteRate;
+    limit->prefix = prefix;
+    return 0;
+    }
+
+void ratelimit_destroy(struct rate_limit *limit) {
+    free(limit->slots);
+    limit->slots = NULL;
+    }
+
+static uint32_t now_ms(void) {
+    //a coarse clock is read without a system call and precise enough for buckets of a second
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+    }
+
+/**
+ * Key function.
+ * @brief Maps a client address to the key of its bucket, the address masked to the configured prefix.
+ * @return Returns the key, or 0 for clients that are not limited, like those of Unix domain sockets.
+ */
+static uint64_t client_key(const struct rate_limit *limit, const struct sockaddr *address) {
+    const unsigned char *bytes;
+    if (address->sa_family == AF_INET) {
+        bytes = (const unsigned char *)&((const struct sockaddr_in *)address)->sin_addr;
+    }
+    else if (address->sa_family == AF_INET6) {
+        const struct in6_addr *ip = &((const struct sockaddr_in6 *)address)->sin6_addr;
+        if (!IN6_IS_ADDR_V4MAPPED(ip)) {
+            uint64_t prefix;
+            memcpy(&prefix, ip->s6_addr, sizeof(prefix));
+            //IPv6 keys have the top bit set, IPv4 keys never do
+            return (prefix * 0x9e3779b97f4a7c15ull) | (1ull << 63);
+        }
+        bytes = ip->s6_addr + 12;
+    }
+    else {
+        return 0;
+    }
+    uint32_t ip = (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+    uint32_t mask = limit->prefix == 0 ? 0 : 0xffffffffu << (32 - limit->prefix);
+    return (1ull << 32) | (ip & mask);
+    }
+
+static uint64_t pack(uint32_t stamp, int64_t tokens) {
+    return (uint64_t)stamp << 32 | (uint32_t)(int32_t)tokens;
+    }
+
+/**
+ * Refill function.
+ * @brief Computes the tokens of a bucket at 'now', refilled at 'perSecond' up to 'capacity'.
+ * @details The time of the refill only moves on when it adds a token, so that frequent calls do not lose the
+ * fractions of tokens in between.
+ * @return Returns the tokens, and the time of the refill in 'stamp'.
+ */
+static int64_t refill(uint64_t bucket, uint32_t now, int64_t perSecond, int64_t capacity, uint32_t *stamp) {
+    *stamp = bucket >> 32;
+    int64_t tokens = (int32_t)(uint32_t)bucket;
+    uint32_t elapsed = now - *stamp;
+    int64_t added = (int64_t)(elapsed < MAX_REFILL_MS ? elapsed : MAX_REFILL_MS) * perSecond / 1000;
+    if (added > 0) {
+        *stamp = now;
+        tokens += added;
+    }
+    return tokens < capacity ? tokens : capacity;
+    }
+
+static int64_t request_capacity(const struct rate_limit *limit) {
+    return limit->requestRate > 0 ? (int64_t)limit->requestRate * REQUEST_COST : REQUEST_COST;
+    }
+
+/**
+ * Slot lookup function.
+ * @brief Finds the slot of 'key', claiming one for it if it has none.
+ * @return Returns the slot, which always exists, the table never being full.
+ */
+static struct rate_slot *find_slot(struct rate_limit *limit, uint64_t key, uint32_t now) {
+    uint64_t hash = key * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 29;
+    struct rate_slot *shard = limit->slots + (hash >> 58) * RATELIMIT_SHARD_SLOTS;
+    size_t home = hash & (RATELIMIT_SHARD_SLOTS - 1);
+    struct rate_slot *victim = NULL;
+    uint64_t victimKey = 0;
+    uint32_t victimAge = 0;
+
+    for (size_t i = 0; i < RATELIMIT_PROBES; i++) {
+        struct rate_slot *slot = &shard[(home + i) & (RATELIMIT_SHARD_SLOTS - 1)];
+        uint64_t current = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (current == 0 && __atomic_compare_exchange_n(&slot->key, &current, key, false, __ATOMIC_ACQ_REL,
+                                                        __ATOMIC_ACQUIRE)) {
+            victim = slot;
+            break;
+        }
+        //a failed claim leaves the key that won it in 'current'
+        if (current == key) {
+            return slot;
+        }
+        uint32_t age = now - (uint32_t)(__atomic_load_n(&slot->requests, __ATOMIC_RELAXED) >> 32);
+        if (victim == NULL || age > victimAge) {
+            victim = slot;
+            victimKey = current;
+            victimAge = age;
+        }
+    }
+    if (victimKey != 0 && !__atomic_compare_exchange_n(&victim->key, &victimKey, key, false, __ATOMIC_ACQ_REL,
+                                                       __ATOMIC_ACQUIRE)) {
+        //another worker evicted it first, for this client or another one; sharing it errs on the strict side
+        return victim;
+    }
+    __atomic_store_n(&victim->requests, pack(now, request_capacity(limit)), __ATOMIC_RELAXED);
+    __atomic_store_n(&victim->bytes, pack(now, limit->byteRate), __ATOMIC_RELAXED);
+    return victim;
+    }
+
+/**
+ * Admission function.
+ * @brief Takes a request token of the client at 'address', unless it has none or is in debt for bytes.
+ * @return Returns true if the request may be served.
+ */
+bool ratelimit_admit(struct rate_limit *limit, const struct sockaddr *address) {
+    uint64_t key = client_key(limit, address);
+    if (key == 0) {
+        return true;
+    }
+    uint32_t now = now_ms();
+    struct rate_slot *slot = find_slot(limit, key, now);
+    uint32_t stamp;
+
+    if (limit->byteRate > 0 &&
+        refill(__atomic_load_n(&slot->bytes, __ATOMIC_RELAXED), now, limit->byteRate, limit->byteRate, &stamp) < 0) {
+        return false;
+    }
+    if (limit->requestRate == 0) {
+        //the slot is only used for the byte bucket, its request bucket keeps the time for the eviction
+        __atomic_store_n(&slot->requests, pack(now, REQUEST_COST), __ATOMIC_RELAXED);
+        return true;
+    }
+
+    int64_t capacity = request_capacity(limit);
+    uint64_t bucket = __atomic_load_n(&slot->requests, __ATOMIC_RELAXED);
+    for (;;) {
+        int64_t tokens = refill(bucket, now, (int64_t)limit->requestRate * REQUEST_COST, capacity, &stamp);
+        if (tokens < REQUEST_COST) {
+            return false;
+        }
+        //a failed exchange reloads 'bucket' with what another worker wrote
+        if (__atomic_compare_exchange_n(&slot->requests, &bucket, pack(stamp, tokens - REQUEST_COST), true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    }
+
+/** Takes 'bytes' tokens from the byte bucket of the client at 'address', going into debt if there are too few. */
+void ratelimit_charge(struct rate_limit *limit, const struct sockaddr *address, uint64_t bytes) {
+    uint64_t key = client_key(limit, address);
+    if (key == 0 || limit->byteRate == 0 || bytes == 0) {
+        return;
+    }
+    uint32_t now = now_ms();
+    struct rate_slot *slot = find_slot(limit, key, now);
+    int64_t cost = bytes < INT32_MAX ? (int64_t)bytes : INT32_MAX;
+    uint64_t bucket = __atomic_load_n(&slot->bytes, __ATOMIC_RELAXED);
+    uint32_t stamp;
+    for (;;) {
+        int64_t tokens = refill(bucket, now, limit->byteRate, limit->byteRate, &stamp) - cost;
+        if (tokens < INT32_MIN) {
+            tokens = INT32_MIN;
+        }
+        if (__atomic_compare_exchange_n(&slot->bytes, &bucket, pack(stamp, tokens), true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+            return;
+        }
+    }
+    }
@@ -0,0 +1,53 @@
+/**
+*@file ratelimit.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Per-client rate limits.
+*
+* Limits the requests per second and the bytes per second each client, or each subnet of clients, is served with
+* token buckets, kept in a table of fixed size that all workers update without locks.
+**/
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define RATELIMIT_SHARDS 64
+#define RATELIMIT_SHARD_SLOTS 1024
+#define RATELIMIT_PROBES 8
+#define RATELIMIT_IPV6_PREFIX 64
+
+/**
+ * The buckets of a client. 'requests' and 'bytes' each hold the millisecond of the last refill in the upper and
+ * the tokens in the lower 32 bits, so that they are updated with a single compare-and-swap. A 'key' of 0 marks a
+ * free slot.
+ */
+struct rate_slot {
+    uint64_t key;
+    uint64_t requests;
+    uint64_t bytes;
+};
+
+/**
+ * A table of the buckets, in RATELIMIT_SHARDS shards of RATELIMIT_SHARD_SLOTS slots. Clients may send
+ * 'requestRate' requests and be sent 'byteRate' bytes per second, where they are not 0, with bursts of a second's
+ * worth of each. IPv4 clients are grouped by the first 'prefix' bits of their address, IPv6 clients by the first
+ * RATELIMIT_IPV6_PREFIX bits.
+ */
+struct rate_limit {
+    struct rate_slot *slots;
+    uint32_t requestRate;
+    uint32_t byteRate;
+    int prefix;
+};
+
+int ratelimit_init(struct rate_limit *limit, uint32_t requestRate, uint32_t byteRate, int prefix);
+void ratelimit_destroy(struct rate_limit *limit);
+bool ratelimit_admit(struct rate_limit *limit, const struct sockaddr *address);
+void ratelimit_charge(struct rate_limit *limit, const struct sockaddr *address, uint64_t bytes);
+
+#endif
@@ -1,4 +1,4 @@
-/**     
+/**
 *@file server.c
 *@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
 *@date 04.01.2022
@@ -6,42 +6,101 @@
 *@brief Main program module.
 *
 * This server program implements HTTP 1.1 and waits for connections to transmit a file using sockets.
+* Clients may also speak cleartext HTTP/2 (h2c), either with prior knowledge or through an HTTP/1.1 upgrade.
+* Given a certificate and key, the server speaks HTTPS instead and negotiates HTTP/2 with ALPN.
+* Local clients can also connect through a Unix domain socket, which is served the same way but without TLS.
 **/
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <assert.h>
-#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <strings.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <limits.h>
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <linux/filter.h>
+
+#include "archive.h"
+#include "cache.h"
+#include "conn.h"
+#include "h2.h"
+#include "metrics.h"
+#include "proxy.h"
+#include "server.h"
+#include "vhost.h"
+#include "mime.h"
+#include "prewarm.h"
+#include "filehint.h"
+#include "directio.h"
+#include "ratelimit.h"
+#include "topology.h"
+
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 256
+#define DEFAULT_DISK_CACHE_MB 1024
+#define MAX_LISTENERS 2
+#define METRICS_PAGE_SIZE 1024
+#define REQUEST_BUFFER_SIZE 8192
+#define MAX_SPIN_MICROSECONDS 1000000
+#define ZEROCOPY_THRESHOLD 16384
+#define DIRECT_BUFFERS_PER_WORKER 2
+#define DEFAULT_PACE_THRESHOLD_KB 1024
+#define RETRY_AFTER_SECONDS "1"
+#define LIMITED_HEADERS "Retry-After: " RETRY_AFTER_SECONDS "\r\n"
+#define SHED_RESPONSE "HTTP/1.1 503 Service Unavailable\r\nRetry-After: " RETRY_AFTER_SECONDS \
+                      "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
 
 static char *MYPROG;
 
 volatile sig_atomic_t run = 1;
-volatile sig_atomic_t waiting = 0;
+
+/**
+ * A listening socket. Connections accepted on a Unix domain socket are local and never encrypted. Listeners of a
+ * 'node' or a 'cpu' are only accepted from by the workers of that node or CPU, those with -1 by all.
+ */
+struct listener {
+    int fd;
+    bool local;
+    int node;
+    int cpu;
+};
+
+/** State handed to each worker thread, which is pinned to 'cpu', or else to the CPUs of 'node', unless both are -1. */
+struct worker {
+    pthread_t thread;
+    const struct listener *listeners;
+    size_t listenerCount;
+    const struct server_config *config;
+    int node;
+    int cpu;
+};
 
 
 /**
  * Signal handling function.
- * @brief This function handles the given signal by decrementing a global variable, and
- * terminating the program when necessary.
- * @details global variables: run, waiting.
+ * @brief This function handles the given signal by clearing a global variable, which makes the main thread
+ * stop the workers.
+ * @details global variables: run.
  * @param signal The given signal.
  */
 void handle_signal(int signal) {
     fprintf(stderr, "\nSignal detected: %d\n", signal);
     run = 0;
-
-    if (waiting == 1) {
-        exit(0);
-        }
     }
 
 /**
@@ -49,276 +108,1583 @@ void handle_signal(int signal) {
  * @brief This function writes helpful usage information to stderr about how program should be called.
  */
 static void usage(char* message) {
-    fprintf(stderr,"Usage Error! \tProper input: %s [-p PORT] [-i INDEX] DOC_ROOT\n%s\n", MYPROG, message);
+    fprintf(stderr,"Usage Error! \tProper input: %s [-p PORT|none] [-U SOCKET_PATH] [-i INDEX] [-V VHOSTS_FILE] [-F FILE_CACHE_MB] [-T MIME_TYPES] [-W MANIFEST] [-L ACCESS_LOG[,TOP]] [-S SNAPSHOT_DIR] [-N] [-R] [-B SPIN_US] [-A MAX_QUEUED[,MAX_DELAY_MS]] [-Q REQUESTS_PER_S[,KB_PER_S[,PREFIX]]] [-P KB_PER_S[,THRESHOLD_KB]] [-O DIRECT_MB] [-w WORKERS] [-c CERT -k KEY] [-m METRICS_PATH] [-u PREFIX=HOST:PORT[,HOST:PORT...]]... [-M CACHE_MB[,DISK_MB] [-D CACHE_DIR]] DOC_ROOT\n%s\n", MYPROG, message);
     exit(1);}
 
 /**
- * Program entry point.
- * @brief The program starts here, and takes a directory from the user to be shared through accepted connections.
- * @details The program receives a directory from the user and waits for socket connections to transmit requested files from
- * this server directory. Different headers are prepared and transitted by the program according to the received request message.
- * Process of waiting for connections can be ended by SIGINT and SIGTERM signals, while -p option can be used to specify a port 
- * number and -i option specifies a file in the directory to be transmitted. 
- * @param argc The argument counter.
- * @param argv The argument vector.
- * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ * Status text function.
+ * @brief Returns the reason phrase for the status codes the server sends.
  */
-int main(int argc, char *argv[]) {
+const char *status_reason(int status) {
+    switch (status) {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+    }
 
-    struct sigaction sa;
-    sa.sa_handler = &handle_signal;
-    sa.sa_flags = SA_RESTART;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
+/**
+ * Date function.
+ * @brief Writes the current time in the format of the Date header to 'out'.
+ * @return Returns 0, or -1 on failure.
+ */
+int format_date(char *out, size_t size) {
+    time_t t;
+    struct tm tmp;
 
-    MYPROG = argv[0];
-    char port[7] = "8080";
-    char defaultFileName[32] = "index.html";
-    char* docRoot;
+    t = time(NULL);
+    if (localtime_r(&t, &tmp) == NULL) {
+        perror("localtime");
+        return -1;
+       }
+    if (strftime(out, size, "%a, %d %b %y %T %Z", &tmp) == 0) {
+        fprintf(stderr, "strftime returned 0");
+        return -1;
+       }
+    return 0;
+    }
 
-    int opt;
-    while((opt = getopt(argc, argv, "p:i:")) != -1) 
-    { 
-        switch(opt) 
-        { 
-            case 'p':
-                if (optarg == NULL) {
-                    usage("Missing argument to the option 'p'\n");
-                }
+/**
+ * Request initialization function.
+ * @brief Clears a request received on 'conn' and notes the address of the client for upstreams.
+ */
+void init_request(struct request *req, struct connection *conn) {
+    req->method[0] = '\0';
+    req->path[0] = '\0';
+    req->headersLength = 0;
+    req->clientAddress[0] = '\0';
+    req->bodyLength = 0;
+    req->bodyStart = NULL;
+    req->bodyBuffered = 0;
+    req->conn = conn;
 
-                char* endPointer;
-                strtol(optarg, &endPointer, 10);
-                if (endPointer == optarg || strlen(optarg) > 6) {
-                    usage("Invalid argument to the option 'p'\n");
-                }
-                strcpy(port, optarg);
-                break; 
-            case 'i': 
-                if (optarg == NULL) {
-                    usage("Missing argument to the option 'i'\n");
-                }
-                if (strlen(optarg) > 31) {
-                    usage("Invalid argument to the option 'i'\n");
-                }
-                strcpy(defaultFileName, optarg);
-                break; 
-            case '?': 
-                usage("Unknown Option!");
-                break; 
-            default:
-                assert(0);
-                break;
-        } 
+    struct sockaddr_storage *address = &req->peer;
+    socklen_t length = sizeof(req->peer);
+    if (getpeername(conn->fd, (struct sockaddr *)address, &length) == 0) {
+        if (address->ss_family == AF_INET) {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)address)->sin_addr, req->clientAddress, sizeof(req->clientAddress));
+        }
+        else if (address->ss_family == AF_INET6) {
+            inet_ntop(AF_INET6, &((struct sockaddr_in6 *)address)->sin6_addr, req->clientAddress, sizeof(req->clientAddress));
+        }
+    }
+    else {
+        address->ss_family = AF_UNSPEC;
+    }
     }
-    
-    docRoot = argv[optind];
-    DIR* dir = opendir(docRoot);
-    if (ENOENT == errno) {
-        usage("Invalid directory");}
-    closedir(dir);
 
-    if (argc > 6 || argc < 2) {
-        usage("Too many or lacking input arguments");}
+/**
+ * Hop-by-hop function.
+ * @brief Tells whether a header field only concerns one connection, so that a proxy must not forward it.
+ */
+bool is_hop_by_hop(const char *name, size_t nameLength) {
+    static const char *fields[] = { "Connection", "Keep-Alive", "Proxy-Authenticate", "Proxy-Authorization",
+                                    "Proxy-Connection", "TE", "Trailer", "Transfer-Encoding", "Upgrade",
+                                    "HTTP2-Settings" };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strlen(fields[i]) == nameLength && strncasecmp(name, fields[i], nameLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+    }
+
+/**
+ * Request header function.
+ * @brief Appends a header field to the ones forwarded with a request. Hop-by-hop fields and Content-Length,
+ * which the proxy sets itself, are left out.
+ * @return Returns 0, or -1 if the headers do not fit.
+ */
+int add_request_header(struct request *req, const char *name, size_t nameLength, const char *value, size_t valueLength) {
+    if (is_hop_by_hop(name, nameLength) || (nameLength == 14 && strncasecmp(name, "Content-Length", 14) == 0)) {
+        return 0;
+    }
+    if (req->headersLength + nameLength + valueLength + 4 > sizeof(req->headers)) {
+        return -1;
+    }
+    char *pos = req->headers + req->headersLength;
+    memcpy(pos, name, nameLength);
+    memcpy(pos + nameLength, ": ", 2);
+    memcpy(pos + nameLength + 2, value, valueLength);
+    memcpy(pos + nameLength + 2 + valueLength, "\r\n", 2);
+    req->headersLength += nameLength + valueLength + 4;
+    return 0;
+    }
 
+/**
+ * Cached file function.
+ * @brief Serves a file of a site with a cache from memory, reading it into the cache on a miss.
+ * @details A cached copy is used for as long as the inode, size and modification time of the file are unchanged,
+ * so a hit costs one stat() instead of opening the file. The Content-Type is looked up when the file is read and
+ * kept with the entry. Files the cache does not take are left to the usual lookup, which gives them their page cache
+ * hints or direct I/O.
+ * @return Returns true if the response was filled in, false if the file has to be looked up the usual way.
+ */
+static bool serve_from_cache(struct cache *cache, const char *path, struct response *resp) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    bool leader;
+    struct cache_entry *entry = cache_lookup(cache, path, NULL, 0, false, &leader);
+    if (entry != NULL && !cache_entry_current(entry, &st)) {
+        cache_release(entry);
+        entry = NULL;
+    }
 
-    //socket struct setup
-    struct addrinfo hints, *ai, *results;
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_flags = AI_PASSIVE;
+    if (entry == NULL) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        entry = cache_load_file(cache, path, fd, &st, mime_type(path));
+        close(fd);
+        if (entry == NULL) {
+            return false;
+        }
+    }
 
-    int res = getaddrinfo(NULL, port, &hints, &results);
-    if (res != 0) {
-        fprintf(stderr, "getaddrinfo() failed");
-        freeaddrinfo(results);
-        exit(EXIT_FAILURE);
+    resp->cached = entry;
+    resp->data = entry->body;
+    resp->length = entry->bodyLength;
+    resp->contentType = entry->contentType;
+    return true;
     }
-    
-    int sockfd;
-    for (ai = results; ai != NULL; ai = ai->ai_next) {
-        sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-        if (sockfd == -1) {
-            continue;
+
+/**
+ * Encoding function.
+ * @brief Tells whether the Accept-Encoding field of a request accepts gzip, that is names it without "q=0".
+ */
+static bool accepts_gzip(const struct request *req) {
+    size_t length;
+    const char *value = cache_field(req->headers, req->headersLength, "Accept-Encoding", &length);
+    if (value == NULL) {
+        return false;
+    }
+    const char *end = value + length;
+    while (value < end) {
+        const char *tokenEnd = memchr(value, ',', end - value);
+        if (tokenEnd == NULL) {
+            tokenEnd = end;
+        }
+        while (value < tokenEnd && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        if (tokenEnd - value >= 4 && strncasecmp(value, "gzip", 4) == 0 &&
+            (value + 4 == tokenEnd || value[4] == ';' || value[4] == ' ')) {
+            for (const char *c = value + 4; c + 1 < tokenEnd; c++) {
+                if ((*c == 'q' || *c == 'Q') && c[1] == '=') {
+                    return strtod(c + 2, NULL) > 0;
+                }
+            }
+            return true;
         }
+        value = tokenEnd + 1;
+    }
+    return false;
+    }
 
-        int enable = 1;
-        if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1) {
-            continue;
-        }  
-        if (bind(sockfd, ai->ai_addr, ai->ai_addrlen) != -1) {
-            break;
+/**
+ * Entity tag function.
+ * @brief Tells whether an If-None-Match field names the given entity tag, or any with "*".
+ * @details The comparison is weak, as If-None-Match requires, so tags marked with W/ match as well.
+ */
+static bool etag_matches(const char *value, size_t length, const char *etag, size_t etagLength) {
+    const char *end = value + length;
+    while (value < end) {
+        const char *tokenEnd = memchr(value, ',', end - value);
+        if (tokenEnd == NULL) {
+            tokenEnd = end;
         }
-        
-        close(sockfd);
+        while (value < tokenEnd && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        if (tokenEnd - value >= 2 && strncmp(value, "W/", 2) == 0) {
+            value += 2;
+        }
+        const char *tagEnd = tokenEnd;
+        while (tagEnd > value && (tagEnd[-1] == ' ' || tagEnd[-1] == '\t')) {
+            tagEnd--;
+        }
+        if ((tagEnd - value == 1 && *value == '*') ||
+            ((size_t)(tagEnd - value) == etagLength && memcmp(value, etag, etagLength) == 0)) {
+            return true;
+        }
+        value = tokenEnd + 1;
+    }
+    return false;
     }
 
-    if (ai == NULL) {
-        perror("socket() or bind() failed");
-        close(sockfd);
-        freeaddrinfo(results);
-        exit(EXIT_FAILURE);
+/**
+ * Archive function.
+ * @brief Serves a file of a site whose document root is an archive, straight from its mapping.
+ * @details The gzip variant is sent if the file has one and the request accepts it. A request whose
+ * If-None-Match names the ETag of that variant is answered with 304. Paths have to match a packed file exactly,
+ * so no path can lead out of the archive, and a request costs no system call until the response is sent.
+ */
+static void serve_from_archive(const struct site *site, const struct request *req, struct response *resp) {
+    const struct archive *archive = site->archive;
+    char path[MAX_TARGET_LENGTH + sizeof(site->defaultFileName)];
+    size_t pathLength = strlen(req->path);
+    memcpy(path, req->path, pathLength + 1);
+    if (pathLength > 0 && path[pathLength - 1] == '/') {
+        strcpy(path + pathLength, site->defaultFileName);
+        pathLength += strlen(site->defaultFileName);
+    }
+    const struct archive_entry *entry = archive_find(archive, path, pathLength);
+    if (entry == NULL) {
+        resp->status = 404;
+        return;
     }
-    freeaddrinfo(results);
 
-    if (listen(sockfd, 1) < 0) {
-        perror("listen() failed");
-        close(sockfd);
-        exit(EXIT_FAILURE);
+    bool gzip = entry->gzipLength > 0 && accepts_gzip(req);
+    resp->archive = archive;
+    resp->reason = status_reason(200);
+    resp->headers = archive->map + (gzip ? entry->gzipHeadersOffset : entry->headersOffset);
+    resp->headersLength = gzip ? entry->gzipHeadersLength : entry->headersLength;
+
+    //the header lines start with "ETag: " and the tag
+    const char *etag = resp->headers + 6;
+    size_t etagLength = (const char *)memchr(etag, '\r', resp->headersLength - 6) - etag;
+    size_t matchLength;
+    const char *match = cache_field(req->headers, req->headersLength, "If-None-Match", &matchLength);
+    if (match != NULL && etag_matches(match, matchLength, etag, etagLength)) {
+        resp->status = 304;
+        resp->reason = status_reason(304);
+        resp->headersLength = entry->notModifiedLength;
+        return;
+    }
+    resp->data = (char *)archive->map + (gzip ? entry->gzipOffset : entry->bodyOffset);
+    resp->length = gzip ? entry->gzipLength : entry->bodyLength;
     }
 
-    fprintf(stdout, "Waiting for a connection...\n\n");
+/**
+ * Target resolution function.
+ * @brief Fills in the response for the target of a request that was admitted by resolve_request().
+ */
+static void resolve_target(const struct server_config *config, const struct request *req, struct response *resp) {
+    if (config->proxy != NULL) {
+        struct route *route = proxy_match(config->proxy, req->path);
+        if (route != NULL) {
+            proxy_request(config->proxy, route, req, resp);
+            return;
+        }
+    }
 
-    while (run == 1) 
-    { //inside of while-loop
+    if (strcmp(req->method, "GET") != 0) {
+        resp->status = 501;
+        return;
+    }
 
+    if (config->metricsPath != NULL && strcmp(req->path, config->metricsPath) == 0) {
+        resp->data = malloc(METRICS_PAGE_SIZE);
+        int length = resp->data != NULL ? metrics_format(resp->data, METRICS_PAGE_SIZE) : -1;
+        if (length < 0) {
+            release_response(resp);
+            resp->status = 500;
+            return;
+        }
+        resp->length = length;
+        resp->contentType = "text/plain";
+        return;
+    }
 
-    waiting = 1;
-    int connfd = accept(sockfd, NULL, NULL);
-    if (connfd < 0) {
-        perror("accept() failed");
-        close(sockfd);
-        exit(EXIT_FAILURE);
+    const struct site *site = &config->site;
+    if (config->vhosts != NULL) {
+        size_t hostLength;
+        const char *host = cache_field(req->headers, req->headersLength, "Host", &hostLength);
+        const struct site *named = host != NULL ? vhost_find(config->vhosts, host, hostLength) : NULL;
+        if (named != NULL) {
+            site = named;
+        }
+    }
+    if (site->archive != NULL) {
+        serve_from_archive(site, req, resp);
+        return;
     }
-    waiting = 0;
 
-    char buffer[1512];
-    if (recv(connfd, buffer, sizeof(buffer), 0) < 0) {
-        perror("recv() failed");
-        close(connfd);
-        exit(EXIT_FAILURE);
+    size_t pathLength = strlen(req->path);
+    char requestedPath[strlen(site->docRoot) + pathLength + strlen(site->defaultFileName) + 1];
+
+    if (pathLength > 0 && req->path[pathLength - 1] == '/') {
+        sprintf(requestedPath, "%s%s%s", site->docRoot, req->path, site->defaultFileName);
+    }
+    else {
+        sprintf(requestedPath, "%s%s", site->docRoot, req->path);
     }
 
-    char buffer_backup[1512];
-    strcpy(buffer_backup, buffer);
-    char* checkLine = strtok(buffer_backup, "\r");
+    if (site->cache != NULL && serve_from_cache(site_cache(site), requestedPath, resp)) {
+        return;
+    }
+
+    if (access(requestedPath, F_OK) != 0) {
+        resp->status = 404;
+        return;
+    }
 
-    char header[128];
-    
-    char* token;
-    token = strtok(checkLine, " ");
-    char* function = token;
+    int fd = open(requestedPath, O_RDONLY);
+    if (fd < 0) {
+        perror("open() failed");
+        resp->status = 500;
+        return;
+    }
 
-    token = strtok(NULL, " ");
-    char* requestedFileName = token;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        resp->status = 404;
+        return;
+    }
+    resp->fd = fd;
+    resp->length = st.st_size;
+    resp->contentType = mime_type(requestedPath);
+    if (config->direct != NULL && st.st_size >= config->direct->threshold) {
+        //no readahead, and should the file go through the page cache after all, it does not stay there
+        resp->direct = config->direct;
+        resp->dropPages = true;
+        return;
+    }
+    resp->dropPages = filehint_before_send(fd, &st);
+    }
 
-    token = strtok(NULL, " ");
-    char* version = token;
+/**
+ * Request resolution function.
+ * @brief Maps a request onto a file of the document root, or an upstream, and fills in the response to send.
+ * @details Requests under a proxy route are forwarded whatever their method. Otherwise only GET is implemented.
+ * Files are looked up in the site named by the Host field, or the default site if it names none, and in the archive
+ * of the site if its document root is one. Paths ending in
+ * '/' are completed with the index file name of the site, the metrics path is answered with the metrics page.
+ * On success the response owns an open descriptor, a buffer or an upstream connection which has to be given back
+ * with release_response(). Clients over their rate limit get a 429 response instead.
+ * @param config The server configuration.
+ * @param req The request.
+ * @param resp The response to fill in.
+ */
+void resolve_request(const struct server_config *config, const struct request *req, struct response *resp) {
+    resp->status = 200;
+    resp->fd = -1;
+    resp->offset = 0;
+    resp->length = 0;
+    resp->data = NULL;
+    resp->upstream = NULL;
+    resp->cached = NULL;
+    resp->reason = NULL;
+    resp->headers = NULL;
+    resp->headersLength = 0;
+    resp->contentType = NULL;
+    resp->archive = NULL;
+    resp->dropPages = false;
+    resp->direct = NULL;
+    resp->paceRate = 0;
+    METRICS_ADD(requests, 1);
 
-    token = strtok(NULL, " ");
+    if (config->rateLimit != NULL && !ratelimit_admit(config->rateLimit, (const struct sockaddr *)&req->peer)) {
+        METRICS_ADD(requestsLimited, 1);
+        resp->status = 429;
+        resp->reason = status_reason(429);
+        resp->headers = LIMITED_HEADERS;
+        resp->headersLength = strlen(LIMITED_HEADERS);
+        return;
+    }
+    resolve_target(config, req, resp);
+    //the byte bucket is charged up front with what the response is going to send, if that is known
+    if (config->rateLimit != NULL && resp->length > 0) {
+        ratelimit_charge(config->rateLimit, (const struct sockaddr *)&req->peer, resp->length);
+    }
+    if (config->paceRate > 0 && resp->length >= config->paceThreshold) {
+        resp->paceRate = config->paceRate;
+    }
+    }
 
+void release_response(struct response *resp) {
+    if (resp->fd >= 0) {
+        if (resp->dropPages) {
+            filehint_after_send(resp->fd, resp->offset, resp->length);
+        }
+        close(resp->fd);
+        resp->fd = -1;
+    }
+    if (resp->cached != NULL) {
+        cache_release(resp->cached);
+        resp->cached = NULL;
+    }
+    else if (resp->archive == NULL) {
+        free(resp->data);
+    }
+    resp->data = NULL;
+    if (resp->upstream != NULL) {
+        upstream_finish(resp->upstream);
+        resp->upstream = NULL;
+    }
+    }
 
-    char requestedPath[strlen(docRoot) + strlen(requestedFileName) + strlen(defaultFileName) + 1];
-    char* bodyContent;
+bool response_has_body(const struct response *resp) {
+    return (resp->fd >= 0 || resp->data != NULL || resp->upstream != NULL) && resp->length != 0;
+    }
 
-    if (requestedFileName[strlen(requestedFileName) - 1] == '/') {
-        sprintf(requestedPath, "%s%s%s", docRoot, requestedFileName, defaultFileName);
+/**
+ * Body transmission function.
+ * @brief Sends 'count' bytes of the body of a response, starting 'from' bytes into it.
+ * @details File bodies go out with sendfile(), bodies in memory are written directly.
+ * @return Returns 0, or -1 if the connection failed.
+ */
+int send_response_body(struct connection *conn, const struct response *resp, off_t from, size_t count) {
+    if (resp->data != NULL) {
+        return conn_send_all(conn, resp->data + from, count, 0);
     }
-    else {
-        sprintf(requestedPath, "%s%s", docRoot, requestedFileName);
+    return conn_sendfile(conn, resp->fd, resp->offset + from, count);
     }
 
-    if (token != NULL || strcmp(version, "HTTP/1.1") != 0) {
-        strcpy(header, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n");
+/**
+ * Header lookup function.
+ * @brief Searches the header lines of a received request for the given field and copies its trimmed value.
+ * @return Returns true if the field was found and fits into 'value'.
+ */
+static bool find_header(const char *buffer, const char *name, char *value, size_t size) {
+    size_t nameLength = strlen(name);
+    const char *line = strstr(buffer, "\r\n");
 
-        if (send(connfd, header, strlen(header), 0) < 0) {
-        perror("send() failed");
-        close(connfd);
-        exit(EXIT_FAILURE);
-        }   
+    while (line != NULL && strncmp(line, "\r\n\r\n", 4) != 0) {
+        line += 2;
+        if (strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':') {
+            const char *start = line + nameLength + 1;
+            while (*start == ' ' || *start == '\t') {
+                start++;
+            }
+            const char *end = strstr(start, "\r\n");
+            if (end == NULL) {
+                return false;
+            }
+            while (end > start && (end[-1] == ' ' || end[-1] == '\t')) {
+                end--;
+            }
+            if ((size_t)(end - start) >= size) {
+                return false;
+            }
+            memcpy(value, start, end - start);
+            value[end - start] = '\0';
+            return true;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return false;
     }
-    else if (strcmp(function, "GET") != 0) {
 
-        strcpy(header, "HTTP/1.1 501 Not Implemented\r\nConnection: close\r\n");
+/**
+ * Response transmission function.
+ * @brief Sends the status line, the headers and, if there is one, the body of a response with HTTP/1.1.
+ * @details The body is handed to the kernel with sendfile(), so it is never copied into userspace, unless the
+ * connection is encrypted without kernel TLS. Huge files can be read with direct I/O instead. Large bodies already in
+ * memory are sent with MSG_ZEROCOPY; the call returns only once the kernel released them, so the cache entry cannot be
+ * evicted while it is in flight.
+ * @return Returns 0, -1 if the connection failed, or -2 if the kernel may still reference the body in memory, which
+ * then has to be kept.
+ */
+static int send_http1_response(struct connection *conn, const struct response *resp) {
+    char header[MAX_HEADERS_LENGTH + 256];
 
-        if (send(connfd, header, strlen(header), 0) < 0) {
-        perror("send() failed");
-        close(connfd);
-        exit(EXIT_FAILURE);
-        }   
+    if (resp->headers != NULL) {
+        //the header of the upstream already says how long the body is, or it ends when the connection is closed
+        char age[64] = "";
+        if (resp->cached != NULL) {
+            snprintf(age, sizeof(age), "Age: %ld\r\n", cache_entry_age(resp->cached));
+        }
+        else if (resp->archive != NULL) {
+            char timeString[48];
+            if (format_date(timeString, sizeof(timeString)) != 0) {
+                return -1;
+            }
+            snprintf(age, sizeof(age), "Date: %s\r\n", timeString);
+        }
+        snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\n%.*s%sConnection: close\r\n\r\n", resp->status,
+                 resp->reason, (int)resp->headersLength, resp->headers, age);
+    }
+    else if (resp->status == 200) {
+        char timeString[48];
+        if (format_date(timeString, sizeof(timeString)) != 0) {
+            return -1;
+        }
+        char contentType[128] = "";
+        if (resp->contentType != NULL) {
+            snprintf(contentType, sizeof(contentType), "Content-Type: %s\r\n", resp->contentType);
+        }
+        sprintf(header, "HTTP/1.1 200 OK\r\nDate: %s\r\n%sContent-Length: %lld\r\nConnection: Close\r\n\r\n", timeString,
+                    contentType, (long long)resp->length);
+    }
+    else {
+        sprintf(header, "HTTP/1.1 %d %s\r\nConnection: close\r\n\r\n", resp->status, status_reason(resp->status));
     }
-    else if (access(requestedPath, F_OK) != 0) {
-        strcpy(header, "HTTP/1.1 404 Not Found\r\nConnection: close\r\n");
 
-        if (send(connfd, header, strlen(header), 0) < 0) {
+    bool body = response_has_body(resp);
+    if (conn_send_all(conn, header, strlen(header), body ? MSG_MORE : 0) != 0) {
         perror("send() failed");
-        close(connfd);
-        exit(EXIT_FAILURE);
-        }   
+        return -1;
     }
-    else {
-        FILE* filePtr;
-        if ((filePtr = fopen(requestedPath,"r")) == NULL){
-        perror("fopen() failed");
-        close(connfd);
-        return EXIT_FAILURE;
-        }
-
-        char *line = NULL;
-        ssize_t read;
-        size_t size = 0;
-            
-        int count = 0;
-        while ((read = getline(&line, &size, filePtr)) != -1) {
-            count++;
-            if (count == 1) {
-                bodyContent = (char *)malloc(read);
-                strncpy(bodyContent, line, read);
-                bodyContent[read] = '\0';
-                continue;
-                }
-            char *tmp = realloc(bodyContent, strlen(bodyContent) + read + 1);
-            if(!tmp) exit(1);
-            bodyContent = tmp;
-
-            sprintf(bodyContent + strlen(bodyContent), "%s", line);
+
+    //bulk bodies are paced, so that they leave room on the uplink for the responses to interactive requests
+    if (body && resp->paceRate > 0) {
+        METRICS_ADD(pacedResponses, 1);
+        if (!conn_set_pacing(conn, resp->paceRate)) {
+            METRICS_ADD(pacedInUserspace, 1);
+        }
+    }
+    if (body && resp->upstream != NULL) {
+        return proxy_relay_body(conn, resp->upstream);
+    }
+    if (body && resp->direct != NULL) {
+        if (direct_send(resp->direct, conn, resp->fd, resp->offset, resp->length) != 0) {
+            perror("send() failed");
+            return -1;
+        }
+        return 0;
+    }
+    if (body && resp->data != NULL && resp->length >= ZEROCOPY_THRESHOLD) {
+        int res = conn_send_zerocopy(conn, resp->data, resp->length);
+        if (res != 0) {
+            perror("send() failed");
+            return res;
+        }
+        return 0;
+    }
+    if (body && send_response_body(conn, resp, 0, resp->length) != 0) {
+        perror("sendfile() failed");
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Request header parsing function.
+ * @brief Collects the header fields of an HTTP/1.1 request to be forwarded, and how long its body is.
+ * @details A body is only supported with Content-Length, Transfer-Encoding leaves 'bodyLength' at -1.
+ * @return Returns 0, or -1 if the header is malformed or too large.
+ */
+static int parse_request_headers(const char *buffer, struct request *req) {
+    const char *line = strstr(buffer, "\r\n") + 2;
+    while (strncmp(line, "\r\n", 2) != 0) {
+        const char *end = strstr(line, "\r\n");
+        const char *colon = memchr(line, ':', end - line);
+        if (colon == NULL || colon == line) {
+            return -1;
+        }
+        const char *value = colon + 1;
+        while (value < end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        const char *valueEnd = end;
+        while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+            valueEnd--;
+        }
+
+        size_t nameLength = colon - line;
+        if (nameLength == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+            char *numberEnd;
+            req->bodyLength = strtoll(value, &numberEnd, 10);
+            if (numberEnd == value || req->bodyLength < 0) {
+                return -1;
             }
-        free(line);
-        fclose(filePtr);
+        }
+        else if (nameLength == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+            req->bodyLength = -1;
+        }
+        if (add_request_header(req, line, nameLength, value, valueEnd - value) != 0) {
+            return -1;
+        }
+        line = end + 2;
+    }
+    return 0;
+    }
 
-        
-        //time
-        char timeString[48];
-        time_t t;
-        struct tm *tmp;
-
-        t = time(NULL);
-        tmp = localtime(&t);
-        if (tmp == NULL) {
-            perror("localtime");
-            free(bodyContent);
-            close(connfd);
-            exit(EXIT_FAILURE);
-           }
-        if (strftime(timeString, sizeof(timeString), "%a, %d %b %y %T %Z", tmp) == 0) {
-            free(bodyContent);
-            close(connfd);
-            fprintf(stderr, "strftime returned 0");
-            exit(EXIT_FAILURE);
-           }
+/**
+ * Connection handling function.
+ * @brief Reads a request from an accepted connection and answers it.
+ * @details A connection opening with the HTTP/2 preface, or an HTTP/1.1 GET asking for an 'h2c' upgrade, is handed
+ * over to the HTTP/2 code. Everything else is answered with HTTP/1.1 and closed afterwards.
+ * The upgrade is only offered on cleartext connections, TLS clients negotiate HTTP/2 with ALPN.
+ * @param conn The accepted connection.
+ * @param config The server configuration.
+ */
+static void handle_connection(struct connection *conn, const struct server_config *config) {
+    char buffer[REQUEST_BUFFER_SIZE];
+    size_t received = 0;
+    bool complete = false;
+
+    while (received < sizeof(buffer) - 1 && !complete) {
+        ssize_t n = conn_recv(conn, buffer + received, sizeof(buffer) - 1 - received);
+        if (n < 0) {
+            perror("recv() failed");
+            return;
+        }
+        if (n == 0) {
+            break;
+        }
+        received += n;
+        buffer[received] = '\0';
+
+        size_t compared = received < H2_PREFACE_LENGTH ? received : H2_PREFACE_LENGTH;
+        if (memcmp(buffer, H2_PREFACE, compared) == 0) {
+            if (received >= H2_PREFACE_LENGTH) {
+                h2_serve_connection(conn, config, buffer, received, NULL, NULL);
+                return;
+            }
+            continue;
+        }
+        complete = strstr(buffer, "\r\n\r\n") != NULL;
+    }
+    if (received == 0) {
+        return;
+    }
 
-        sprintf(header, "HTTP/1.1 200 OK\r\nDate: %s\r\nContent-Length: %d\r\nConnection: Close\r\n\r\n", timeString, 
-                    (int)strlen(bodyContent));
+    char buffer_backup[REQUEST_BUFFER_SIZE];
+    strcpy(buffer_backup, buffer);
+    char* checkLine = strtok(buffer_backup, "\r");
 
+    char* token = NULL;
+    char* function = NULL;
+    char* requestedFileName = NULL;
+    char* version = NULL;
 
-        if (send(connfd, header, strlen(header), 0) < 0) {
-        perror("send() failed");
-        free(bodyContent);
-        close(connfd);
-        exit(EXIT_FAILURE);
-        }   
+    if (checkLine != NULL) {
+        token = strtok(checkLine, " ");
+        function = token;
 
-        if (send(connfd, bodyContent, strlen(bodyContent), 0) < 0) {
-        perror("send() failed");
-        free(bodyContent);
-        close(connfd);
-        exit(EXIT_FAILURE);
+        token = strtok(NULL, " ");
+        requestedFileName = token;
+
+        token = strtok(NULL, " ");
+        version = token;
+
+        token = strtok(NULL, " ");
+    }
+
+    struct response resp = { 400, -1, 0, 0, NULL, NULL };
+    struct request req;
+    init_request(&req, conn);
+
+    if (version == NULL || token != NULL || strcmp(version, "HTTP/1.1") != 0 ||
+        strlen(function) >= sizeof(req.method) || strlen(requestedFileName) >= sizeof(req.path)) {
+        send_http1_response(conn, &resp);
+        return;
+    }
+    strcpy(req.method, function);
+    strcpy(req.path, requestedFileName);
+    if (complete) {
+        if (parse_request_headers(buffer, &req) != 0) {
+            send_http1_response(conn, &resp);
+            return;
         }
-        free(bodyContent);
+        size_t consumed = strstr(buffer, "\r\n\r\n") + 4 - buffer;
+        req.bodyStart = buffer + consumed;
+        req.bodyBuffered = received - consumed;
+        if (req.bodyLength >= 0 && (off_t)req.bodyBuffered > req.bodyLength) {
+            req.bodyBuffered = req.bodyLength;
         }
+    }
 
-    close(connfd);
-    } //outside of while-loop
-    close(sockfd);
+    char upgrade[64];
+    char settings[256];
+    if (complete && conn->ssl == NULL && strcmp(function, "GET") == 0 &&
+        find_header(buffer, "Upgrade", upgrade, sizeof(upgrade)) && strncasecmp(upgrade, "h2c", 3) == 0 &&
+        (upgrade[3] == '\0' || upgrade[3] == ',' || upgrade[3] == ' ') &&
+        find_header(buffer, "HTTP2-Settings", settings, sizeof(settings))) {
+
+        char* switching = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+        if (conn_send_all(conn, switching, strlen(switching), 0) != 0) {
+            perror("send() failed");
+            return;
+        }
+        size_t consumed = strstr(buffer, "\r\n\r\n") + 4 - buffer;
+        h2_serve_connection(conn, config, buffer + consumed, received - consumed, &req, settings);
+        return;
+    }
+
+    resolve_request(config, &req, &resp);
+    if (send_http1_response(conn, &resp) == -2) {
+        //the body is leaked rather than given back, so its memory is never reused under the kernel's feet
+        METRICS_ADD(zerocopyPinned, 1);
+        resp.cached = NULL;
+        resp.data = NULL;
+    }
+    release_response(&resp);
+    }
+
+/**
+ * Accepting function.
+ * @brief Waits for a connection on any of the listening sockets of the worker and accepts it.
+ * @details A single listener is accepted on directly. With several, the worker polls them all; they are
+ * nonblocking then, so a connection taken by another worker in the meantime only costs a retry. A worker with a
+ * single listener of its own among several polls it as well when it is nonblocking. In busy-poll mode the
+ * listeners are polled without sleeping for the spin budget first.
+ * @return Returns the connected socket, or -1 with errno set.
+ */
+static int accept_next(const struct worker *self, const struct listener **from) {
+    *from = &self->listeners[0];
+    struct pollfd fds[self->listenerCount];
+    for (size_t i = 0; i < self->listenerCount; i++) {
+        fds[i].fd = self->listeners[i].fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    int ready = 0;
+    if (self->config->spinMicroseconds > 0) {
+        ready = conn_busy_poll(fds, self->listenerCount, self->config->spinMicroseconds * 1000);
+    }
+    if (ready <= 0 && self->listenerCount == 1) {
+        int connfd = accept(self->listeners[0].fd, NULL, NULL);
+        if (connfd >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return connfd;
+        }
+    }
+
+    if (ready <= 0 && poll(fds, self->listenerCount, -1) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < self->listenerCount; i++) {
+        if (fds[i].revents != 0) {
+            *from = &self->listeners[i];
+            break;
+        }
+    }
+    int connfd = accept((*from)->fd, NULL, NULL);
+    if (connfd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        errno = EINTR;
+    }
+    return connfd;
+    }
+
+/**
+ * Admission function.
+ * @brief Decides whether a connection just accepted from a TCP listener is to be shed.
+ * @details The backlog of a listening socket is its number of unacknowledged segments in TCP_INFO. An accepted
+ * socket reports the milliseconds since it last received data, or since it was established if the request is
+ * still to come, which is how long it waited to be accepted.
+ * @return Returns true if the backlog or the wait exceeds the limits of the configuration.
+ */
+static bool over_capacity(const struct server_config *config, int listenFd, int connfd) {
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (config->admitQueued > 0 && getsockopt(listenFd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 &&
+        info.tcpi_unacked > (unsigned long)config->admitQueued) {
+        return true;
+    }
+    length = sizeof(info);
+    return config->admitDelayMs > 0 && getsockopt(connfd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 &&
+           info.tcpi_last_data_recv > (unsigned long)config->admitDelayMs;
+    }
+
+/**
+ * Shedding function.
+ * @brief Answers a connection with the precomputed 503 response and closes it, without reading the request.
+ * @details What already arrived of the request is discarded first, since closing a socket with unread data resets
+ * the connection, which could destroy the response before the client read it. TLS connections are closed without
+ * a response, as the handshake it would take is just what an overloaded server cannot afford.
+ */
+static void shed_connection(int connfd, bool tls) {
+    if (!tls) {
+        char discard[REQUEST_BUFFER_SIZE];
+        while (recv(connfd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+        }
+        send(connfd, SHED_RESPONSE, strlen(SHED_RESPONSE), MSG_DONTWAIT | MSG_NOSIGNAL);
+        shutdown(connfd, SHUT_WR);
+    }
+    close(connfd);
+    }
+
+/**
+ * Worker function.
+ * @brief Accepts connections on the shared listening sockets and serves them one after another until the
+ * program is told to stop.
+ * @param arg The worker state.
+ */
+static void *worker_main(void *arg) {
+    struct worker *self = arg;
+    if (self->cpu >= 0) {
+        topology_pin_cpu(self->cpu);
+    }
+    else if (self->node >= 0) {
+        topology_pin(self->node);
+    }
+
+    while (run == 1)
+    { //inside of while-loop
+
+    const struct listener *listener;
+    int connfd = accept_next(self, &listener);
+    if (connfd < 0) {
+        if (run == 0) {
+            break;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        perror("accept() failed");
+        continue;
+    }
+
+    METRICS_ADD(connections, 1);
+    if (!listener->local && (self->config->admitQueued > 0 || self->config->admitDelayMs > 0) &&
+        over_capacity(self->config, listener->fd, connfd)) {
+        METRICS_ADD(connectionsShed, 1);
+        shed_connection(connfd, self->config->tls != NULL);
+        continue;
+    }
+    struct connection conn;
+    conn_init(&conn, connfd);
+    if (self->config->spinMicroseconds > 0) {
+        //the kernel busy polls the device queue in blocking reads too, where the driver and privileges allow
+        int spin = self->config->spinMicroseconds;
+        setsockopt(connfd, SOL_SOCKET, SO_BUSY_POLL, &spin, sizeof(spin));
+        conn.spinBudget = self->config->spinMicroseconds * 1000;
+    }
+    if (self->config->tls != NULL && !listener->local) {
+        uint64_t cpuStart = thread_cpu_ns();
+        if (tls_accept(&conn, self->config->tls) != 0) {
+            METRICS_ADD(tlsFailedHandshakes, 1);
+            conn_close(&conn);
+            continue;
+        }
+        uint64_t cpu = thread_cpu_ns() - cpuStart;
+        if (tls_session_reused(&conn)) {
+            METRICS_ADD(tlsResumedHandshakes, 1);
+            METRICS_ADD(tlsResumedHandshakeCpuNs, cpu);
+        }
+        else {
+            METRICS_ADD(tlsFullHandshakes, 1);
+            METRICS_ADD(tlsFullHandshakeCpuNs, cpu);
+        }
+    }
+
+    if (tls_alpn_is_h2(&conn)) {
+        h2_serve_connection(&conn, self->config, NULL, 0, NULL, NULL);
+    }
+    else {
+        handle_connection(&conn, self->config);
+    }
+    conn_close(&conn);
+    } //outside of while-loop
+    return NULL;
+    }
+
+/**
+ * TCP listener function.
+ * @brief Binds a socket to 'port' on all IPv4 addresses and listens on it.
+ * @details Unless 'cpu' is -1, the socket is one of a SO_REUSEPORT group, and is given the connections whose
+ * packets the kernel processes on that CPU.
+ * @return Returns the listening socket, or -1 after printing why it failed.
+ */
+static int listen_tcp(const char *port, int cpu) {
+    //socket struct setup
+    struct addrinfo hints, *ai, *results;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int res = getaddrinfo(NULL, port, &hints, &results);
+    if (res != 0) {
+        fprintf(stderr, "getaddrinfo() failed");
+        return -1;
+    }
+
+    int sockfd;
+    for (ai = results; ai != NULL; ai = ai->ai_next) {
+        sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sockfd == -1) {
+            continue;
+        }
+
+        int enable = 1;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1) {
+            continue;
+        }
+        if (cpu >= 0 && (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1 ||
+                         setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == -1)) {
+            close(sockfd);
+            continue;
+        }
+        if (bind(sockfd, ai->ai_addr, ai->ai_addrlen) != -1) {
+            break;
+        }
+
+        close(sockfd);
+    }
+
+    if (ai == NULL) {
+        perror("socket() or bind() failed");
+        freeaddrinfo(results);
+        return -1;
+    }
+    freeaddrinfo(results);
+
+    if (listen(sockfd, SOMAXCONN) < 0) {
+        perror("listen() failed");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+    }
+
+/**
+ * Steering function.
+ * @brief Attaches a classic BPF program to the SO_REUSEPORT group of the TCP listeners, which hands a connection
+ * to the listener of the CPU that processed its SYN.
+ * @details The listeners of the group are numbered in the order they started listening. For a CPU without a
+ * listener the program returns no valid number, and the kernel falls back to hashing.
+ * @return Returns 0, or -1 after printing why it failed.
+ */
+static int attach_steering(const struct listener *listeners, size_t count) {
+    struct sock_filter code[2 * MAX_CPUS + 2];
+    unsigned short length = 0;
+    code[length++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (size_t i = 0; i < count && i < MAX_CPUS && listeners[i].cpu >= 0; i++) {
+        code[length++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, listeners[i].cpu, 0, 1);
+        code[length++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, i);
+    }
+    code[length++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+    struct sock_fprog program = { length, code };
+    if (setsockopt(listeners[0].fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0) {
+        perror("Attaching the steering program failed");
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Unix domain listener function.
+ * @brief Creates a stream socket at 'path' and listens on it.
+ * @details A socket file left behind by an earlier run is replaced, any other file at 'path' is not. Who may
+ * connect is decided by the permissions of the socket file and its directory.
+ * @return Returns the listening socket, or -1 after printing why it failed.
+ */
+static int listen_unix(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        perror("socket() failed");
+        return -1;
+    }
+    if (bind(sockfd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("bind() failed");
+        close(sockfd);
+        return -1;
+    }
+    if (listen(sockfd, SOMAXCONN) < 0) {
+        perror("listen() failed");
+        close(sockfd);
+        unlink(path);
+        return -1;
+    }
+    return sockfd;
+    }
+
+/** Applies a snapshot action to each cache shard of a site, the shards after the first with their node in the name. */
+static void site_snapshots(const struct site *site, const char *dir, const char *name,
+                           int (*action)(struct cache *, const char *)) {
+    char path[PATH_MAX];
+    for (size_t i = 0; i < site->cacheShards; i++) {
+        if (i == 0) {
+            snprintf(path, sizeof(path), "%s/%s.snapshot", dir, name);
+        }
+        else {
+            snprintf(path, sizeof(path), "%s/%s.node%zu.snapshot", dir, name, i);
+        }
+        action(&site->cache[i], path);
+    }
+    }
+
+/**
+ * Snapshot function.
+ * @brief Applies 'action', opening or saving, to the snapshot in 'dir' of every cache of the server: one for each
+ * site with a file cache, named after its host, and one for the proxy cache.
+ */
+static void for_each_snapshot(const struct server_config *config, struct cache *proxyCache, const char *dir,
+                              int (*action)(struct cache *, const char *)) {
+    char path[PATH_MAX];
+    site_snapshots(&config->site, dir, "default", action);
+    for (size_t i = 0; config->vhosts != NULL && i < config->vhosts->siteCount; i++) {
+        const struct site *site = &config->vhosts->sites[i];
+        //a host that is no file name gets no snapshot
+        if (site->host[0] != '.' && strchr(site->host, '/') == NULL) {
+            snprintf(path, sizeof(path), "site-%s", site->host);
+            site_snapshots(site, dir, path, action);
+        }
+    }
+    if (proxyCache != NULL) {
+        snprintf(path, sizeof(path), "%s/proxy.snapshot", dir);
+        action(proxyCache, path);
+    }
+    }
+
+/**
+ * Program entry point.
+ * @brief The program starts here, and takes a directory from the user to be shared through accepted connections.
+ * @details The program receives a directory from the user and waits for socket connections to transmit requested files
+ * from this server directory. Different headers are prepared and transitted by the program according to the received
+ * request message. Connections are served by a pool of worker threads, so that a long-lived HTTP/2 connection does not
+ * hold up other clients. Process of waiting for connections can be ended by SIGINT and SIGTERM signals, while -p option
+ * can be used to specify a port number, -i option specifies a file in the directory to be transmitted and -w sets the
+ * number of workers. With -c and -k, giving a PEM certificate chain and its private key, connections are served over
+ * TLS. -U also listens on a Unix domain socket, whose connections are served without TLS; with '-p none' it is the only
+ * listener. -m names a path at which the counters of the server are served instead of a file. -V reads virtual hosts
+ * from a file of "HOST DOC_ROOT [INDEX [CACHE_MB]]" lines; DOC_ROOT, with -i and -F, is the site of all other hosts. -F
+ * and CACHE_MB keep the files of a site in a memory cache of that many megabytes, which no other site can evict from.
+ * Files are sent with the Content-Type of their extension, -T reads a mime.types file whose types take precedence over
+ * the built-in ones. A DOC_ROOT that is an archive made by pack is mapped into memory and served from there. -W and -L
+ * prewarm the site caches in the background after startup, with the "[HOST] PATH" lines of a manifest or the TOP most
+ * requested paths of an access log in the Common Log Format. -S saves the caches to snapshots in a directory on
+ * shutdown, from which the next start adopts the entries that are still valid. -N pins the workers to the NUMA nodes in
+ * turn, splits the file caches into shards on the memory of each node and lets each CPU of a node listen on a socket of
+ * its own, so that a connection is served on the node that received it. -R pins each worker to a CPU of its own
+ * instead, and steers a connection with a BPF program to the worker of the CPU that processed its SYN. -B makes the
+ * workers busy poll for up to SPIN_US microseconds, for a new connection and for the next data of one, before they
+ * block, trading CPU time for latency. -A sheds load: a TCP connection accepted while more than MAX_QUEUED others wait
+ * in the backlog, or after waiting there for more than MAX_DELAY_MS, is answered with a 503 and a Retry-After right
+ * away, so that the connections behind it are served in time. -Q limits each client to REQUESTS_PER_S requests and
+ * KB_PER_S kilobytes of responses per second, where they are not 0, and answers the requests over the limit with a 429;
+ * with PREFIX, IPv4 clients share the limits of their subnet of that prefix length, IPv6 clients always share those of
+ * their /64. -P paces the bodies of HTTP/1.1 responses of at least THRESHOLD_KB kilobytes, by default 1024, at KB_PER_S
+ * kilobytes per second, so that bulk downloads do not crowd out other responses on the uplink. -O reads files of at
+ * least DIRECT_MB megabytes with O_DIRECT into a pool of buffers and sends them from there, keeping them out of the
+ * page cache. Each -u forwards the requests under a path prefix to the given upstream servers, which are balanced by
+ * least connections. -M keeps proxied responses in a cache of that many megabytes, and -D lets it spill to a directory,
+ * within the second size of -M.
+ * @param argc The argument counter.
+ * @param argv The argument vector.
+ * @return Returns EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int main(int argc, char *argv[]) {
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &handle_signal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    MYPROG = argv[0];
+    char port[7] = "8080";
+    struct server_config config;
+    strcpy(config.site.defaultFileName, "index.html");
+    config.site.host[0] = '\0';
+    config.site.cache = NULL;
+    config.site.cacheShards = 0;
+    config.vhosts = NULL;
+    static struct vhost_table vhosts;
+    char *vhostsFile = NULL;
+    long fileCacheMegabytes = 0;
+    char *mimeTypesFile = NULL;
+    static struct prewarm prewarm;
+    prewarm.config = &config;
+    prewarm.top = DEFAULT_PREWARM_TOP;
+    config.tls = NULL;
+    config.metricsPath = NULL;
+    config.spinMicroseconds = 0;
+    config.admitQueued = 0;
+    config.admitDelayMs = 0;
+    config.rateLimit = NULL;
+    config.paceRate = 0;
+    config.paceThreshold = (off_t)DEFAULT_PACE_THRESHOLD_KB << 10;
+    static struct rate_limit rateLimit;
+    long limitRequests = -1;
+    long limitKilobytes = 0;
+    long limitPrefix = 32;
+    config.direct = NULL;
+    static struct direct_pool direct;
+    long directMegabytes = 0;
+    config.proxy = NULL;
+    static struct proxy proxy;
+    int workerCount = DEFAULT_WORKERS;
+    char *certFile = NULL;
+    char *keyFile = NULL;
+    static struct cache cache;
+    long cacheMegabytes = 0;
+    long diskMegabytes = DEFAULT_DISK_CACHE_MB;
+    char *cacheDir = NULL;
+    char *unixPath = NULL;
+    char *snapshotDir = NULL;
+    bool numa = false;
+    bool steer = false;
+
+    int opt;
+    while((opt = getopt(argc, argv, "p:U:i:V:F:T:W:L:S:NRB:A:Q:P:O:w:c:k:m:u:M:D:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'p':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'p'\n");
+                }
+
+                char* endPointer;
+                strtol(optarg, &endPointer, 10);
+                if ((endPointer == optarg && strcmp(optarg, "none") != 0) || strlen(optarg) > 6) {
+                    usage("Invalid argument to the option 'p'\n");
+                }
+                strcpy(port, optarg);
+                break;
+            case 'U':
+                if (optarg == NULL || optarg[0] == '\0') {
+                    usage("Missing argument to the option 'U'\n");
+                }
+                unixPath = optarg;
+                break;
+            case 'i':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'i'\n");
+                }
+                if (strlen(optarg) > 31) {
+                    usage("Invalid argument to the option 'i'\n");
+                }
+                strcpy(config.site.defaultFileName, optarg);
+                break;
+            case 'V':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'V'\n");
+                }
+                vhostsFile = optarg;
+                break;
+            case 'F':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'F'\n");
+                }
+
+                char* fileCacheEnd;
+                fileCacheMegabytes = strtol(optarg, &fileCacheEnd, 10);
+                if (fileCacheEnd == optarg || *fileCacheEnd != '\0' || fileCacheMegabytes < 0) {
+                    usage("Invalid argument to the option 'F'\n");
+                }
+                break;
+            case 'T':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'T'\n");
+                }
+                mimeTypesFile = optarg;
+                break;
+            case 'W':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'W'\n");
+                }
+                prewarm.manifest = optarg;
+                break;
+            case 'L':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'L'\n");
+                }
+                prewarm.accessLog = optarg;
+                char *topStart = strrchr(optarg, ',');
+                if (topStart != NULL) {
+                    char *topEnd;
+                    long top = strtol(topStart + 1, &topEnd, 10);
+                    if (topEnd == topStart + 1 || *topEnd != '\0' || top < 1) {
+                        usage("Invalid argument to the option 'L'\n");
+                    }
+                    prewarm.top = top;
+                    *topStart = '\0';
+                }
+                break;
+            case 'S':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'S'\n");
+                }
+                snapshotDir = optarg;
+                break;
+            case 'N':
+                numa = true;
+                break;
+            case 'R':
+                steer = true;
+                break;
+            case 'B':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'B'\n");
+                }
+                char *spinEnd;
+                config.spinMicroseconds = strtol(optarg, &spinEnd, 10);
+                if (spinEnd == optarg || *spinEnd != '\0' || config.spinMicroseconds < 1 ||
+                    config.spinMicroseconds > MAX_SPIN_MICROSECONDS) {
+                    usage("Invalid argument to the option 'B'\n");
+                }
+                break;
+            case 'A':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'A'\n");
+                }
+                char *admitEnd;
+                config.admitQueued = strtol(optarg, &admitEnd, 10);
+                if (admitEnd == optarg) {
+                    usage("Invalid argument to the option 'A'\n");
+                }
+                if (*admitEnd == ',') {
+                    char *delayStart = admitEnd + 1;
+                    config.admitDelayMs = strtol(delayStart, &admitEnd, 10);
+                    if (admitEnd == delayStart || config.admitDelayMs < 1) {
+                        usage("Invalid argument to the option 'A'\n");
+                    }
+                }
+                if (*admitEnd != '\0' || config.admitQueued < 0 ||
+                    (config.admitQueued == 0 && config.admitDelayMs == 0)) {
+                    usage("Invalid argument to the option 'A'\n");
+                }
+                break;
+            case 'Q':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'Q'\n");
+                }
+                char *limitEnd;
+                limitRequests = strtol(optarg, &limitEnd, 10);
+                if (limitEnd != optarg && *limitEnd == ',') {
+                    char *kilobytesStart = limitEnd + 1;
+                    limitKilobytes = strtol(kilobytesStart, &limitEnd, 10);
+                    if (limitEnd == kilobytesStart) {
+                        usage("Invalid argument to the option 'Q'\n");
+                    }
+                }
+                if (limitEnd != optarg && *limitEnd == ',') {
+                    char *prefixStart = limitEnd + 1;
+                    limitPrefix = strtol(prefixStart, &limitEnd, 10);
+                    if (limitEnd == prefixStart) {
+                        usage("Invalid argument to the option 'Q'\n");
+                    }
+                }
+                if (limitEnd == optarg || *limitEnd != '\0' || limitRequests < 0 || limitRequests > 1000000 ||
+                    limitKilobytes < 0 || limitKilobytes > 2097151 || (limitRequests == 0 && limitKilobytes == 0) ||
+                    limitPrefix < 0 || limitPrefix > 32) {
+                    usage("Invalid argument to the option 'Q'\n");
+                }
+                break;
+            case 'P':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'P'\n");
+                }
+                char *paceEnd;
+                long paceKilobytes = strtol(optarg, &paceEnd, 10);
+                if (paceEnd != optarg && *paceEnd == ',') {
+                    char *thresholdStart = paceEnd + 1;
+                    long thresholdKilobytes = strtol(thresholdStart, &paceEnd, 10);
+                    if (paceEnd == thresholdStart || thresholdKilobytes < 0) {
+                        usage("Invalid argument to the option 'P'\n");
+                    }
+                    config.paceThreshold = (off_t)thresholdKilobytes << 10;
+                }
+                if (paceEnd == optarg || *paceEnd != '\0' || paceKilobytes < 1 || paceKilobytes > 4194303) {
+                    usage("Invalid argument to the option 'P'\n");
+                }
+                config.paceRate = paceKilobytes * 1024;
+                break;
+            case 'O':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'O'\n");
+                }
+                char *directEnd;
+                directMegabytes = strtol(optarg, &directEnd, 10);
+                if (directEnd == optarg || *directEnd != '\0' || directMegabytes < 1) {
+                    usage("Invalid argument to the option 'O'\n");
+                }
+                break;
+            case 'w':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'w'\n");
+                }
+
+                char* workerEnd;
+                workerCount = strtol(optarg, &workerEnd, 10);
+                if (workerEnd == optarg || *workerEnd != '\0' || workerCount < 1 || workerCount > MAX_WORKERS) {
+                    usage("Invalid argument to the option 'w'\n");
+                }
+                break;
+            case 'c':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'c'\n");
+                }
+                certFile = optarg;
+                break;
+            case 'k':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'k'\n");
+                }
+                keyFile = optarg;
+                break;
+            case 'm':
+                if (optarg == NULL || optarg[0] != '/') {
+                    usage("Invalid argument to the option 'm'\n");
+                }
+                config.metricsPath = optarg;
+                break;
+            case 'u':
+                if (optarg == NULL || proxy_add_route(&proxy, optarg) != 0) {
+                    usage("Invalid argument to the option 'u'\n");
+                }
+                config.proxy = &proxy;
+                break;
+            case 'M':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'M'\n");
+                }
+
+                char* cacheEnd;
+                cacheMegabytes = strtol(optarg, &cacheEnd, 10);
+                if (*cacheEnd == ',') {
+                    char *disk = cacheEnd + 1;
+                    diskMegabytes = strtol(disk, &cacheEnd, 10);
+                    if (cacheEnd == disk || diskMegabytes < 1) {
+                        usage("Invalid argument to the option 'M'\n");
+                    }
+                }
+                if (cacheEnd == optarg || *cacheEnd != '\0' || cacheMegabytes < 1) {
+                    usage("Invalid argument to the option 'M'\n");
+                }
+                break;
+            case 'D':
+                if (optarg == NULL) {
+                    usage("Missing argument to the option 'D'\n");
+                }
+                cacheDir = optarg;
+                break;
+            case '?':
+                usage("Unknown Option!");
+                break;
+            default:
+                assert(0);
+                break;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage("Too many or lacking input arguments");}
+    if (numa) {
+        topology_init();
+    }
+
+    config.site.docRoot = argv[optind];
+    if (site_open_root(&config.site, config.site.docRoot) != 0) {
+        usage("Invalid directory or archive");}
+    if (fileCacheMegabytes > 0 && site_init_cache(&config.site, fileCacheMegabytes) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (mimeTypesFile != NULL && mime_load(mimeTypesFile) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (vhostsFile != NULL) {
+        if (vhost_load(&vhosts, vhostsFile) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        config.vhosts = &vhosts;
+    }
+
+    if (strcmp(port, "none") == 0 && unixPath == NULL) {
+        usage("Without a TCP port the option 'U' is needed");}
+    if ((certFile == NULL) != (keyFile == NULL)) {
+        usage("The options 'c' and 'k' have to be given together");}
+    if ((cacheMegabytes > 0 || cacheDir != NULL) && config.proxy == NULL) {
+        usage("The options 'M' and 'D' need a proxy route");}
+    if (cacheDir != NULL && cacheMegabytes == 0) {
+        usage("The option 'D' needs the option 'M'");}
+    if (cacheMegabytes > 0) {
+        if (cache_init(&cache, (size_t)cacheMegabytes << 20, cacheDir, (size_t)diskMegabytes << 20) != 0) {
+            usage("Invalid cache directory");}
+        proxy.cache = &cache;
+    }
+    if (snapshotDir != NULL) {
+        struct stat st;
+        if (stat(snapshotDir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            usage("Invalid snapshot directory");}
+        for_each_snapshot(&config, proxy.cache, snapshotDir, cache_open_snapshot);
+    }
+    if (limitRequests >= 0) {
+        if (ratelimit_init(&rateLimit, limitRequests, limitKilobytes * 1024, limitPrefix) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        config.rateLimit = &rateLimit;
+    }
+    if (directMegabytes > 0) {
+        if (direct_pool_init(&direct, workerCount * DIRECT_BUFFERS_PER_WORKER, (off_t)directMegabytes << 20) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        config.direct = &direct;
+    }
+    if (certFile != NULL) {
+        config.tls = tls_server_context(certFile, keyFile);
+        if (config.tls == NULL) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //with -N every CPU of a node with workers gets a listener, which the kernel gives the connections it received
+    //on that CPU, so that they are served by the workers of the node whose NIC queue they came in on
+    int nodeCount = numa ? topology_node_count() : 1;
+    int workerNodes = workerCount < nodeCount ? workerCount : nodeCount;
+    //with -R the workers are pinned to a CPU each, whose listener a BPF program steers its connections to
+    int steerCpus[MAX_CPUS];
+    int steerCpuCount = steer && strcmp(port, "none") != 0 ? topology_allowed_cpus(steerCpus, MAX_CPUS) : 0;
+    if (steerCpuCount > workerCount) {
+        steerCpuCount = workerCount;
+    }
+    struct listener listeners[MAX_LISTENERS + MAX_CPUS];
+    size_t listenerCount = 0;
+    for (int i = 0; i < steerCpuCount; i++) {
+        listeners[listenerCount].fd = listen_tcp(port, steerCpus[i]);
+        listeners[listenerCount].node = -1;
+        listeners[listenerCount].cpu = steerCpus[i];
+        listeners[listenerCount++].local = false;
+    }
+    if (strcmp(port, "none") != 0 && !numa && steerCpuCount == 0) {
+        listeners[listenerCount].fd = listen_tcp(port, -1);
+        listeners[listenerCount].node = -1;
+        listeners[listenerCount].cpu = -1;
+        listeners[listenerCount++].local = false;
+    }
+    for (int node = 0; strcmp(port, "none") != 0 && numa && steerCpuCount == 0 && node < workerNodes; node++) {
+        int cpus[MAX_CPUS];
+        int cpuCount = topology_cpus(node, cpus, MAX_CPUS);
+        for (int i = 0; i < cpuCount; i++) {
+            listeners[listenerCount].fd = listen_tcp(port, cpus[i]);
+            listeners[listenerCount].node = node;
+            listeners[listenerCount].cpu = -1;
+            listeners[listenerCount++].local = false;
+        }
+    }
+    if (unixPath != NULL) {
+        listeners[listenerCount].fd = listen_unix(unixPath);
+        listeners[listenerCount].node = -1;
+        listeners[listenerCount].cpu = -1;
+        listeners[listenerCount++].local = true;
+    }
+    for (size_t i = 0; i < listenerCount; i++) {
+        if (listeners[i].fd < 0 || (listenerCount > 1 && fcntl(listeners[i].fd, F_SETFL, O_NONBLOCK) != 0)) {
+            for (size_t j = 0; j < listenerCount; j++) {
+                if (listeners[j].fd >= 0) {
+                    close(listeners[j].fd);
+                }
+            }
+            if (unixPath != NULL) {
+                unlink(unixPath);
+            }
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    //a steering program that cannot be attached leaves the connections to be hashed over the CPUs
+    if (steerCpuCount > 0) {
+        attach_steering(listeners, listenerCount);
+    }
+
+    fprintf(stdout, "Waiting for a connection...\n\n");
+    fflush(stdout);
+
+    //workers inherit a mask with the termination signals blocked, so that only the main thread handles them
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    if (config.proxy != NULL && proxy_start(config.proxy) != 0) {
+        run = 0;
+    }
+
+    //each worker accepts from the listeners of its node or CPU, and from those of all workers
+    struct worker workers[workerCount];
+    struct listener *workerListeners = malloc(workerCount * listenerCount * sizeof(struct listener));
+    if (workerListeners == NULL) {
+        perror("malloc() failed");
+        run = 0;
+    }
+    int started = 0;
+    for (; started < workerCount && run == 1; started++) {
+        struct worker *worker = &workers[started];
+        worker->node = numa && steerCpuCount == 0 ? started % workerNodes : -1;
+        worker->cpu = steerCpuCount > 0 ? steerCpus[started % steerCpuCount] : -1;
+        worker->listeners = &workerListeners[started * listenerCount];
+        worker->listenerCount = 0;
+        for (size_t i = 0; i < listenerCount; i++) {
+            if ((listeners[i].node == -1 || listeners[i].node == worker->node) &&
+                (listeners[i].cpu == -1 || listeners[i].cpu == worker->cpu)) {
+                workerListeners[started * listenerCount + worker->listenerCount++] = listeners[i];
+            }
+        }
+        worker->config = &config;
+        if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+            perror("pthread_create() failed");
+            run = 0;
+            break;
+        }
+    }
+
+    //workers are accepting meanwhile
+    if (run == 1 && (prewarm.manifest != NULL || prewarm.accessLog != NULL)) {
+        prewarm_start(&prewarm);
+    }
+
+    while (run == 1) {
+        sigsuspend(&previous);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    //wakes up the workers blocked in accept() or poll()
+    for (size_t i = 0; i < listenerCount; i++) {
+        shutdown(listeners[i].fd, SHUT_RDWR);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    free(workerListeners);
+    prewarm_stop(&prewarm);
+
+    for (size_t i = 0; i < listenerCount; i++) {
+        close(listeners[i].fd);
+    }
+    if (unixPath != NULL) {
+        unlink(unixPath);
+    }
+    if (config.proxy != NULL) {
+        proxy_stop(config.proxy);
+    }
+    if (snapshotDir != NULL) {
+        for_each_snapshot(&config, proxy.cache, snapshotDir, cache_save_snapshot);
+    }
+    if (proxy.cache != NULL) {
+        cache_destroy(proxy.cache);
+    }
+    if (config.vhosts != NULL) {
+        vhost_free(config.vhosts);
+    }
+    if (config.direct != NULL) {
+        direct_pool_destroy(config.direct);
+    }
+    if (config.rateLimit != NULL) {
+        ratelimit_destroy(config.rateLimit);
+    }
+    site_free_cache(&config.site);
+    site_close_root(&config.site);
+    if (config.tls != NULL) {
+        SSL_CTX_free(config.tls);
+    }
+    mime_free();
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
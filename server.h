@@ -0,0 +1,123 @@
+/**
+*@file server.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Shared declarations of the server modules.
+*
+* Requests are resolved independently of the protocol that carried them, so that the HTTP/1.1 path in server.c
+* and the HTTP/2 path in h2server.c answer with the same files and status codes.
+**/
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "conn.h"
+#include "vhost.h"
+
+#define MAX_METHOD_LENGTH 16
+#define MAX_TARGET_LENGTH 1024
+#define MAX_HEADERS_LENGTH 8192
+
+struct proxy;
+struct direct_pool;
+struct rate_limit;
+struct upstream_response;
+struct cache_entry;
+struct archive;
+
+/**
+ * Settings given on the command line, read-only once the workers are running. Requests for hosts without a site in
+ * 'vhosts', or all requests if it is NULL, are served by 'site'. Workers busy poll for up to 'spinMicroseconds' before
+ * they block, unless it is 0. TCP connections are shed with a 503 response once more than 'admitQueued' connections
+ * wait to be accepted, or once one waited for longer than 'admitDelayMs', where either is not 0. Clients over the
+ * limits of 'rateLimit', if it is set, are answered with a 429 response. Bodies of at least 'paceThreshold' bytes are
+ * paced at 'paceRate' bytes per second, unless it is 0. Files from the threshold of 'direct' on are sent with direct
+ * I/O, if it is set.
+ */
+struct server_config {
+    struct site site;
+    struct vhost_table *vhosts;
+    SSL_CTX *tls;
+    char *metricsPath;
+    struct proxy *proxy;
+    long spinMicroseconds;
+    long admitQueued;
+    long admitDelayMs;
+    struct rate_limit *rateLimit;
+    long paceRate;
+    off_t paceThreshold;
+    struct direct_pool *direct;
+};
+
+/**
+ * The parts of a request the resolver looks at. 'headers' holds the end-to-end header lines that are forwarded to
+ * upstreams. Of a body of 'bodyLength' bytes (-1 if its framing is not supported), the first 'bodyBuffered' were
+ * received with the head, the rest is still to be read from 'conn'. 'peer' is the address of the client, of family
+ * AF_UNSPEC if it is not known.
+ */
+struct request {
+    char method[MAX_METHOD_LENGTH];
+    char path[MAX_TARGET_LENGTH];
+    char headers[MAX_HEADERS_LENGTH];
+    size_t headersLength;
+    char clientAddress[64];
+    struct sockaddr_storage peer;
+    off_t bodyLength;
+    const char *bodyStart;
+    size_t bodyBuffered;
+    struct connection *conn;
+};
+
+/**
+ * A resolved response, the body is 'length' bytes of 'fd' starting at 'offset' (fd is -1 without body), or
+ * 'length' bytes of 'data' for bodies generated in memory, which the response owns. Proxied responses relay the
+ * body of 'upstream' instead, 'length' is -1 if it is only known once the upstream has sent all of it. Responses
+ * served from the proxy cache hold a reference to 'cached', whose body 'data' then points into.
+ * Proxied and cached responses bring their reason phrase and 'headers', the header lines sent as they are. The
+ * responses of the server itself have the 'contentType' of their body, or NULL. Responses from an 'archive' have
+ * their header lines and body in its mapping, only the Date is still to be added. With 'dropPages' the pages of
+ * the file are dropped from the page cache when the response is released. A 'direct' pool is given for files to be
+ * sent with direct I/O over HTTP/1.1. A 'paceRate' other than 0 is the rate in bytes per second an HTTP/1.1
+ * connection is limited to for the body.
+ */
+struct response {
+    int status;
+    int fd;
+    off_t offset;
+    off_t length;
+    char *data;
+    struct upstream_response *upstream;
+    struct cache_entry *cached;
+    const char *reason;
+    const char *headers;
+    size_t headersLength;
+    const char *contentType;
+    const struct archive *archive;
+    bool dropPages;
+    struct direct_pool *direct;
+    long paceRate;
+};
+
+extern volatile sig_atomic_t run;
+
+const char *status_reason(int status);
+int format_date(char *out, size_t size);
+void resolve_request(const struct server_config *config, const struct request *req, struct response *resp);
+void init_request(struct request *req, struct connection *conn);
+int add_request_header(struct request *req, const char *name, size_t nameLength, const char *value, size_t valueLength);
+bool is_hop_by_hop(const char *name, size_t nameLength);
+void release_response(struct response *resp);
+bool response_has_body(const struct response *resp);
+int send_response_body(struct connection *conn, const struct response *resp, off_t from, size_t count);
+
+int h2_serve_connection(struct connection *conn, const struct server_config *config, const char *initial, size_t initialLength,
+                        const struct request *upgraded, const char *upgradeSettings);
+
+#endif
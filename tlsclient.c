@@ -0,0 +1,248 @@
+/**
+*@file tlsclient.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief TLS handling of the client.
+*
+* Connects to 'https://' hosts with certificate and host name verification. Sessions handed out by a server are kept
+* per host and port, so that every further connection to it resumes with an abbreviated handshake. With a session
+* file they also outlive the program and are resumed by the next run.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509v3.h>
+
+#include "client.h"
+
+#define MAX_SESSIONS 64
+#define MAX_SESSION_KEY_LENGTH (MAX_HOST_LENGTH + 8)
+#define MAX_SESSION_LENGTH 8192
+
+/** A resumable session of a server, named "host:port". */
+struct cached_session {
+    char key[MAX_SESSION_KEY_LENGTH];
+    SSL_SESSION *session;
+};
+
+static struct cached_session sessions[MAX_SESSIONS];
+static size_t sessionCount;
+static int keyIndex = -1;
+
+/** TLS 1.3 tickets are used once, OpenSSL marks a session as no longer resumable after resuming it. */
+static bool session_expired(const SSL_SESSION *session) {
+    return !SSL_SESSION_is_resumable(session) ||
+           SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) <= time(NULL);
+    }
+
+/**
+ * Session storing function.
+ * @brief Keeps 'session' as the one to resume for 'key', replacing an older one. Once the table is full the oldest
+ * entry gives way. The table takes over the reference of the caller.
+ */
+static void store_session(const char *key, SSL_SESSION *session) {
+    size_t i = 0;
+    while (i < sessionCount && strcmp(sessions[i].key, key) != 0) {
+        i++;
+    }
+    if (i == MAX_SESSIONS) {
+        SSL_SESSION_free(sessions[0].session);
+        memmove(&sessions[0], &sessions[1], (MAX_SESSIONS - 1) * sizeof(struct cached_session));
+        i = MAX_SESSIONS - 1;
+        sessionCount--;
+    }
+    if (i == sessionCount) {
+        snprintf(sessions[i].key, sizeof(sessions[i].key), "%s", key);
+        sessionCount++;
+    }
+    else {
+        SSL_SESSION_free(sessions[i].session);
+    }
+    sessions[i].session = session;
+    }
+
+/**
+ * New session function.
+ * @brief Called by OpenSSL whenever the server hands out a session, which with TLS 1.3 happens after the
+ * handshake, while the response is already being read.
+ * @return Returns 1 if the session is kept, 0 if OpenSSL may free it.
+ */
+static int new_session(SSL *ssl, SSL_SESSION *session) {
+    const char *key = SSL_get_ex_data(ssl, keyIndex);
+    if (key == NULL || session_expired(session)) {
+        return 0;
+    }
+    store_session(key, session);
+    return 1;
+    }
+
+/**
+ * Client context function.
+ * @brief Creates the TLS context all connections of the client are made with.
+ * @details Servers are verified against 'caFile', or the default trust store if it is NULL. The protocol offered
+ * with ALPN is h2 or http/1.1, the client does not fall back from one to the other.
+ * @return Returns the context, or NULL after printing the OpenSSL errors.
+ */
+SSL_CTX *tls_client_context(const char *caFile, bool http2) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        ERR_print_errors_fp(stderr);
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+    int res = caFile != NULL ? SSL_CTX_load_verify_locations(ctx, caFile, NULL) : SSL_CTX_set_default_verify_paths(ctx);
+    static const unsigned char h2[] = "\x02h2";
+    static const unsigned char http1[] = "\x08http/1.1";
+    if (res != 1 || (http2 ? SSL_CTX_set_alpn_protos(ctx, h2, sizeof(h2) - 1) :
+                             SSL_CTX_set_alpn_protos(ctx, http1, sizeof(http1) - 1)) != 0) {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+
+    if (keyIndex < 0) {
+        keyIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+    }
+    //sessions are kept in the table above, OpenSSL's own client cache would not be consulted anyway
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, new_session);
+    return ctx;
+    }
+
+/**
+ * Handshake function.
+ * @brief Performs the client side of the TLS handshake on a connected socket, resuming the last session of the
+ * server if there is one.
+ * @return Returns 0, or -1 after printing why the handshake failed.
+ */
+int tls_connect(struct connection *conn, SSL_CTX *ctx, const char *host, const char *port) {
+    static char key[MAX_SESSION_KEY_LENGTH];
+    snprintf(key, sizeof(key), "%s:%s", host, port);
+
+    conn->ssl = SSL_new(ctx);
+    if (conn->ssl == NULL || SSL_set_fd(conn->ssl, conn->fd) != 1 ||
+        SSL_set_tlsext_host_name(conn->ssl, host) != 1 || SSL_set1_host(conn->ssl, host) != 1) {
+        ERR_print_errors_fp(stderr);
+        return -1;
+    }
+    SSL_set_ex_data(conn->ssl, keyIndex, key);
+
+    for (size_t i = 0; i < sessionCount; i++) {
+        if (strcmp(sessions[i].key, key) == 0 && !session_expired(sessions[i].session)) {
+            SSL_set_session(conn->ssl, sessions[i].session);
+            break;
+        }
+    }
+
+    if (SSL_connect(conn->ssl) != 1) {
+        long verified = SSL_get_verify_result(conn->ssl);
+        if (verified != X509_V_OK) {
+            fprintf(stderr, "Certificate verification failed: %s\n", X509_verify_cert_error_string(verified));
+        }
+        else {
+            ERR_print_errors_fp(stderr);
+        }
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Session loading function.
+ * @brief Reads the sessions saved by an earlier run, one "host:port base64" line each. Expired sessions and
+ * lines that cannot be decoded are skipped, a missing file is no error.
+ */
+void tls_load_sessions(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        return;
+    }
+
+    char line[MAX_SESSION_KEY_LENGTH + 4 * MAX_SESSION_LENGTH / 3 + 8];
+    unsigned char der[MAX_SESSION_LENGTH];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char *encoded = strchr(line, ' ');
+        if (encoded == NULL || encoded - line >= MAX_SESSION_KEY_LENGTH) {
+            continue;
+        }
+        *encoded++ = '\0';
+        encoded[strcspn(encoded, "\r\n")] = '\0';
+
+        size_t encodedLength = strlen(encoded);
+        if (encodedLength == 0 || encodedLength % 4 != 0 || encodedLength / 4 * 3 > sizeof(der)) {
+            continue;
+        }
+        int length = EVP_DecodeBlock(der, (unsigned char *)encoded, encodedLength);
+        if (length < 0) {
+            continue;
+        }
+        //EVP_DecodeBlock() counts the padding as data, DER does not mind the trailing zeros
+        const unsigned char *pos = der;
+        SSL_SESSION *session = d2i_SSL_SESSION(NULL, &pos, length);
+        if (session == NULL) {
+            continue;
+        }
+        if (session_expired(session)) {
+            SSL_SESSION_free(session);
+            continue;
+        }
+        store_session(line, session);
+    }
+    ERR_clear_error();
+    fclose(in);
+    }
+
+/**
+ * Session saving function.
+ * @brief Writes the sessions that are still valid to 'path', replacing its previous contents.
+ * @details The sessions hold their master secrets, so a new file is only readable by its owner.
+ * @return Returns 0, or -1 on failure.
+ */
+int tls_save_sessions(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out == NULL) {
+        perror("open() failed");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    unsigned char der[MAX_SESSION_LENGTH];
+    unsigned char encoded[4 * MAX_SESSION_LENGTH / 3 + 4];
+    for (size_t i = 0; i < sessionCount; i++) {
+        if (session_expired(sessions[i].session) || i2d_SSL_SESSION(sessions[i].session, NULL) > (int)sizeof(der)) {
+            continue;
+        }
+        unsigned char *pos = der;
+        int length = i2d_SSL_SESSION(sessions[i].session, &pos);
+        if (length <= 0) {
+            continue;
+        }
+        EVP_EncodeBlock(encoded, der, length);
+        fprintf(out, "%s %s\n", sessions[i].key, encoded);
+    }
+    if (fclose(out) != 0) {
+        perror("fclose() failed");
+        return -1;
+    }
+    return 0;
+    }
+
+void tls_free_sessions(void) {
+    for (size_t i = 0; i < sessionCount; i++) {
+        SSL_SESSION_free(sessions[i].session);
+    }
+    sessionCount = 0;
+    }
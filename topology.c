@@ -0,0 +1,211 @@
+/**
+*@file topology.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief NUMA topology.
+*
+* Nodes are numbered in the order of their system numbers, leaving out nodes without CPUs, which only hold memory.
+* Memory is bound with mbind() directly, so no NUMA library is needed.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "topology.h"
+
+static int nodeCount = 1;
+static int nodeIds[MAX_NODES];
+static int cpuNodes[MAX_CPUS];
+
+static int compare_ids(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+    }
+
+/**
+ * CPU list function.
+ * @brief Assigns the CPUs of a list in the format of sysfs, like "0-3,8-11", to 'node'.
+ * @return Returns how many CPUs it named.
+ */
+static int read_cpulist(const char *list, int node) {
+    int count = 0;
+    const char *pos = list;
+    while (*pos >= '0' && *pos <= '9') {
+        char *end;
+        long first = strtol(pos, &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < MAX_CPUS; cpu++) {
+            cpuNodes[cpu] = node;
+            count++;
+        }
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return count;
+    }
+
+/**
+ * Initialisation function.
+ * @brief Reads the nodes of the machine and their CPUs. Without NUMA information all CPUs are on node 0.
+ * @return Returns the number of nodes.
+ */
+int topology_init(void) {
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        cpuNodes[cpu] = -1;
+    }
+    int ids[MAX_NODES];
+    int idCount = 0;
+    DIR *dir = opendir("/sys/devices/system/node");
+    struct dirent *file;
+    while (dir != NULL && (file = readdir(dir)) != NULL && idCount < MAX_NODES) {
+        char *end;
+        if (strncmp(file->d_name, "node", 4) == 0 && file->d_name[4] != '\0') {
+            long id = strtol(file->d_name + 4, &end, 10);
+            if (*end == '\0') {
+                ids[idCount++] = id;
+            }
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    qsort(ids, idCount, sizeof(int), compare_ids);
+
+    nodeCount = 0;
+    for (int i = 0; i < idCount; i++) {
+        char path[64];
+        char list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", ids[i]);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        bool found = fgets(list, sizeof(list), file) != NULL && read_cpulist(list, nodeCount) > 0;
+        fclose(file);
+        if (found) {
+            nodeIds[nodeCount++] = ids[i];
+        }
+    }
+    if (nodeCount == 0) {
+        for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+            cpuNodes[cpu] = 0;
+        }
+        nodeIds[0] = 0;
+        nodeCount = 1;
+    }
+    return nodeCount;
+    }
+
+int topology_node_count(void) {
+    return nodeCount;
+    }
+
+/** Returns the node of the CPU the calling thread runs on, which for a pinned thread is its own. */
+int topology_node(void) {
+    int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < MAX_CPUS && cpuNodes[cpu] >= 0 ? cpuNodes[cpu] : 0;
+    }
+
+/**
+ * CPU listing function.
+ * @brief Writes up to 'max' CPUs of 'node' to 'cpus'.
+ * @return Returns how many it wrote.
+ */
+int topology_cpus(int node, int *cpus, int max) {
+    long configured = sysconf(_SC_NPROCESSORS_CONF);
+    int count = 0;
+    for (int cpu = 0; cpu < MAX_CPUS && cpu < configured && count < max; cpu++) {
+        if (cpuNodes[cpu] == node) {
+            cpus[count++] = cpu;
+        }
+    }
+    return count;
+    }
+
+/**
+ * Pinning function.
+ * @brief Lets the calling thread run on the CPUs of 'node' only.
+ * @return Returns 0, or -1 after printing why it failed.
+ */
+int topology_pin(int node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int cpus[MAX_CPUS];
+    int count = topology_cpus(node, cpus, MAX_CPUS);
+    for (int i = 0; i < count; i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (res != 0) {
+        fprintf(stderr, "pthread_setaffinity_np() failed: %s\n", strerror(res));
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Allowed CPU function.
+ * @brief Writes up to 'max' of the CPUs the process may run on to 'cpus', in ascending order.
+ * @return Returns how many it wrote.
+ */
+int topology_allowed_cpus(int *cpus, int max) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+    int count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && cpu < MAX_CPUS && count < max; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus[count++] = cpu;
+        }
+    }
+    return count;
+    }
+
+/**
+ * CPU pinning function.
+ * @brief Lets the calling thread run on 'cpu' only.
+ * @return Returns 0, or -1 after printing why it failed.
+ */
+int topology_pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (res != 0) {
+        fprintf(stderr, "pthread_setaffinity_np() failed: %s\n", strerror(res));
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Memory binding function.
+ * @brief Asks for the pages of a mapping that are not touched yet to be placed on 'node'.
+ * @details The node is preferred rather than required, so that a full node spills over instead of failing.
+ */
+void topology_bind(void *memory, size_t length, int node) {
+    if (memory == NULL || nodeCount < 2) {
+        return;
+    }
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    if (nodeIds[node] >= 1024) {
+        return;
+    }
+    mask[nodeIds[node] / (8 * sizeof(unsigned long))] |= 1ul << (nodeIds[node] % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, memory, length, MPOL_PREFERRED, mask, 8 * sizeof(mask), 0) != 0) {
+        perror("mbind() failed");
+    }
+    }
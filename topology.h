@@ -0,0 +1,30 @@
+/**
+*@file topology.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief NUMA topology.
+*
+* Knows which CPUs belong to which NUMA node, read once from sysfs, so that threads can be pinned to a node and
+* memory placed on it. Until it is initialised, or on machines without nodes, everything is on node 0.
+**/
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define MAX_NODES 16
+#define MAX_CPUS 1024
+
+int topology_init(void);
+int topology_node_count(void);
+int topology_node(void);
+int topology_cpus(int node, int *cpus, int max);
+int topology_pin(int node);
+int topology_allowed_cpus(int *cpus, int max);
+int topology_pin_cpu(int cpu);
+void topology_bind(void *memory, size_t length, int node);
+
+#endif
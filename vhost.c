@@ -0,0 +1,350 @@
+/**
+*@file vhost.c
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Name-based virtual hosts.
+*
+* The sites are read from a vhosts file at startup, one "HOST DOC_ROOT [INDEX [CACHE_MB]]" line each, and put into
+* a perfect hash table built with hash and displace: hosts are spread over buckets by one hash, and each bucket gets
+* a seed under which a second hash sends all of its hosts to free slots. Finding the site of a request then takes
+* two hashes and one comparison, however many sites there are.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <string.h>
+
+#include "vhost.h"
+
+#define MAX_SEED 1000000
+#define MAX_LINE_LENGTH 1024
+
+/** A bucket of the first hash, with the number of hosts in it. */
+struct bucket {
+    uint32_t index;
+    uint32_t count;
+};
+
+static uint32_t hash_host(const char *host, size_t length, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)host[i]) * 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+    }
+
+/**
+ * Host normalisation function.
+ * @brief Copies a host as given in a Host field into 'out' in lower case, without a port and a trailing dot.
+ * @return Returns the length of the host, or -1 if it is empty or too long.
+ */
+static int normalize_host(const char *host, size_t length, char *out) {
+    const char *end = host + length;
+    if (length > 0 && host[0] == '[') {
+        const char *bracket = memchr(host, ']', length);
+        if (bracket != NULL) {
+            end = bracket + 1;
+        }
+    }
+    else {
+        const char *colon = memchr(host, ':', length);
+        if (colon != NULL) {
+            end = colon;
+        }
+    }
+    if (end > host && end[-1] == '.') {
+        end--;
+    }
+    if (end == host || end - host >= MAX_SITE_HOST) {
+        return -1;
+    }
+    for (const char *c = host; c < end; c++) {
+        out[c - host] = (char)tolower((unsigned char)*c);
+    }
+    out[end - host] = '\0';
+    return end - host;
+    }
+
+static int compare_buckets(const void *a, const void *b) {
+    const struct bucket *first = a;
+    const struct bucket *second = b;
+    if (first->count != second->count) {
+        return first->count > second->count ? -1 : 1;
+    }
+    return first->index < second->index ? -1 : first->index > second->index;
+    }
+
+/**
+ * Table building function.
+ * @brief Places all sites into the slots of the table, filling the largest buckets first, while they still have
+ * the most freedom.
+ * @return Returns 0, or -1 if memory is short, a host is given twice or no seeds could be found.
+ */
+static int build_table(struct vhost_table *table) {
+    size_t count = table->siteCount;
+    table->bucketCount = count / 2 + 1;
+    table->slotCount = 2 * count + 1;
+    table->seeds = calloc(table->bucketCount, sizeof(uint32_t));
+    table->slots = calloc(table->slotCount, sizeof(struct site *));
+    struct bucket *buckets = calloc(table->bucketCount, sizeof(struct bucket));
+    uint32_t *firstHashes = calloc(count, sizeof(uint32_t));
+    size_t *members = calloc(count, sizeof(size_t));
+    size_t *chosen = calloc(count, sizeof(size_t));
+    int res = table->seeds != NULL && table->slots != NULL && buckets != NULL && firstHashes != NULL &&
+              members != NULL && chosen != NULL ? 0 : -1;
+
+    for (size_t i = 0; res == 0 && i < table->bucketCount; i++) {
+        buckets[i].index = i;
+    }
+    for (size_t i = 0; res == 0 && i < count; i++) {
+        firstHashes[i] = hash_host(table->sites[i].host, strlen(table->sites[i].host), 0) % table->bucketCount;
+        buckets[firstHashes[i]].count++;
+    }
+    if (res == 0) {
+        qsort(buckets, table->bucketCount, sizeof(struct bucket), compare_buckets);
+    }
+
+    for (size_t b = 0; res == 0 && b < table->bucketCount && buckets[b].count > 0; b++) {
+        size_t memberCount = 0;
+        for (size_t i = 0; i < count && res == 0; i++) {
+            if (firstHashes[i] == buckets[b].index) {
+                //a host given twice would never get a slot of its own
+                for (size_t j = 0; j < memberCount && res == 0; j++) {
+                    res = strcmp(table->sites[members[j]].host, table->sites[i].host) == 0 ? -1 : 0;
+                }
+                members[memberCount++] = i;
+            }
+        }
+        if (res != 0) {
+            break;
+        }
+
+        uint32_t seed = 1;
+        for (; seed < MAX_SEED; seed++) {
+            size_t placed = 0;
+            for (; placed < memberCount; placed++) {
+                const char *host = table->sites[members[placed]].host;
+                size_t slot = hash_host(host, strlen(host), seed) % table->slotCount;
+                bool taken = table->slots[slot] != NULL;
+                for (size_t j = 0; j < placed && !taken; j++) {
+                    taken = chosen[j] == slot;
+                }
+                if (taken) {
+                    break;
+                }
+                chosen[placed] = slot;
+            }
+            if (placed == memberCount) {
+                break;
+            }
+        }
+        if (seed == MAX_SEED) {
+            res = -1;
+            break;
+        }
+        table->seeds[buckets[b].index] = seed;
+        for (size_t j = 0; j < memberCount; j++) {
+            table->slots[chosen[j]] = &table->sites[members[j]];
+        }
+    }
+
+    free(buckets);
+    free(firstHashes);
+    free(members);
+    free(chosen);
+    return res;
+    }
+
+/**
+ * Site cache function.
+ * @brief Gives a site a file cache of its own of 'megabytes' megabytes.
+ * @details With more than one NUMA node known, the budget is split into a shard per node, whose bodies are placed
+ * on the memory of that node.
+ * @return Returns 0, or -1 if memory is short.
+ */
+int site_init_cache(struct site *site, long megabytes) {
+    size_t shards = topology_node_count();
+    site->cache = calloc(shards, sizeof(struct cache));
+    site->cacheShards = 0;
+    if (site->cache == NULL) {
+        return -1;
+    }
+    for (; site->cacheShards < shards; site->cacheShards++) {
+        struct cache *shard = &site->cache[site->cacheShards];
+        if (cache_init(shard, ((size_t)megabytes << 20) / shards, NULL, 0) != 0) {
+            site_free_cache(site);
+            return -1;
+        }
+        topology_bind(shard->arena.base, shard->arena.size, site->cacheShards);
+    }
+    return 0;
+    }
+
+void site_free_cache(struct site *site) {
+    for (size_t i = 0; i < site->cacheShards; i++) {
+        cache_destroy(&site->cache[i]);
+    }
+    free(site->cache);
+    site->cache = NULL;
+    site->cacheShards = 0;
+    }
+
+/**
+ * Document root function.
+ * @brief Checks the document root of a site, which is either a directory or an archive made by pack. Archives are
+ * mapped into memory here.
+ * @return Returns 0, or -1 if it is neither.
+ */
+int site_open_root(struct site *site, const char *docRoot) {
+    site->archive = NULL;
+    DIR *dir = opendir(docRoot);
+    if (dir != NULL) {
+        closedir(dir);
+        return 0;
+    }
+    struct archive *archive = malloc(sizeof(struct archive));
+    if (archive == NULL || archive_open(archive, docRoot) != 0) {
+        free(archive);
+        return -1;
+    }
+    site->archive = archive;
+    return 0;
+    }
+
+void site_close_root(struct site *site) {
+    if (site->archive != NULL) {
+        archive_close(site->archive);
+        free(site->archive);
+        site->archive = NULL;
+    }
+    }
+
+/**
+ * Site line function.
+ * @brief Parses one "HOST DOC_ROOT [INDEX [CACHE_MB]]" line of a vhosts file into 'site'.
+ * @return Returns 0, or -1 after printing what is wrong with the line.
+ */
+static int parse_site(char *line, size_t lineNumber, struct site *site) {
+    char *host = strtok(line, " \t");
+    char *docRoot = strtok(NULL, " \t");
+    char *index = strtok(NULL, " \t");
+    char *megabytes = index != NULL ? strtok(NULL, " \t") : NULL;
+    if (host == NULL || docRoot == NULL || strtok(NULL, " \t") != NULL ||
+        normalize_host(host, strlen(host), site->host) < 0 || (index != NULL && strlen(index) >= sizeof(site->defaultFileName))) {
+        fprintf(stderr, "Invalid site in line %zu of the vhosts file\n", lineNumber);
+        return -1;
+    }
+
+    long cacheMegabytes = 0;
+    if (megabytes != NULL) {
+        char *end;
+        cacheMegabytes = strtol(megabytes, &end, 10);
+        if (end == megabytes || *end != '\0' || cacheMegabytes < 0) {
+            fprintf(stderr, "Invalid cache size in line %zu of the vhosts file\n", lineNumber);
+            return -1;
+        }
+    }
+
+    if (site_open_root(site, docRoot) != 0) {
+        fprintf(stderr, "Invalid document root in line %zu of the vhosts file: %s\n", lineNumber, docRoot);
+        return -1;
+    }
+
+    site->docRoot = strdup(docRoot);
+    strcpy(site->defaultFileName, index != NULL ? index : "index.html");
+    site->cache = NULL;
+    site->cacheShards = 0;
+    if (site->docRoot == NULL || (cacheMegabytes > 0 && site_init_cache(site, cacheMegabytes) != 0)) {
+        free(site->docRoot);
+        site->docRoot = NULL;
+        site_close_root(site);
+        return -1;
+    }
+    return 0;
+    }
+
+/**
+ * Loading function.
+ * @brief Reads the sites of a vhosts file and builds the table to find them by host.
+ * @details Empty lines and lines starting with '#' are skipped.
+ * @return Returns 0, or -1 after printing why the file could not be loaded.
+ */
+int vhost_load(struct vhost_table *table, const char *path) {
+    memset(table, 0, sizeof(struct vhost_table));
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        perror("fopen() failed");
+        return -1;
+    }
+    table->sites = calloc(MAX_SITES, sizeof(struct site));
+    if (table->sites == NULL) {
+        fclose(in);
+        return -1;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    size_t lineNumber = 0;
+    int res = 0;
+    while (res == 0 && fgets(line, sizeof(line), in) != NULL) {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *start = line + strspn(line, " \t");
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+        if (table->siteCount == MAX_SITES) {
+            fprintf(stderr, "Too many sites in the vhosts file\n");
+            res = -1;
+            break;
+        }
+        res = parse_site(start, lineNumber, &table->sites[table->siteCount]);
+        if (res == 0) {
+            table->siteCount++;
+        }
+    }
+    fclose(in);
+
+    if (res == 0 && build_table(table) != 0) {
+        fprintf(stderr, "The vhosts file names a host twice\n");
+        res = -1;
+    }
+    if (res != 0) {
+        vhost_free(table);
+    }
+    return res;
+    }
+
+/**
+ * Lookup function.
+ * @brief Finds the site of the host named by a Host field, ignoring case, the port and a trailing dot.
+ * @return Returns the site, or NULL if the host has none.
+ */
+const struct site *vhost_find(const struct vhost_table *table, const char *host, size_t hostLength) {
+    char name[MAX_SITE_HOST];
+    int length = normalize_host(host, hostLength, name);
+    if (length < 0 || table->siteCount == 0) {
+        return NULL;
+    }
+    uint32_t seed = table->seeds[hash_host(name, length, 0) % table->bucketCount];
+    const struct site *site = table->slots[hash_host(name, length, seed) % table->slotCount];
+    return site != NULL && strcmp(site->host, name) == 0 ? site : NULL;
+    }
+
+void vhost_free(struct vhost_table *table) {
+    for (size_t i = 0; i < table->siteCount; i++) {
+        site_free_cache(&table->sites[i]);
+        free(table->sites[i].docRoot);
+        site_close_root(&table->sites[i]);
+    }
+    free(table->sites);
+    free(table->seeds);
+    free(table->slots);
+    memset(table, 0, sizeof(struct vhost_table));
+    }
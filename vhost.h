@@ -0,0 +1,66 @@
+/**
+*@file vhost.h
+*@author Fidel Cem Sarikaya <fcemsarikaya@gmail.com>
+*@date 17.10.2026
+*
+*@brief Name-based virtual hosts.
+*
+* Maps the host a request names onto the site serving it, each with its own document root, index file and cache.
+**/
+
+#ifndef VHOST_H
+#define VHOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "archive.h"
+#include "topology.h"
+
+#define MAX_SITE_HOST 256
+#define MAX_SITES 4096
+
+/**
+ * A site. Its files are kept in memory in 'cache', which no other site shares, unless it is NULL. On NUMA machines
+ * 'cache' holds one shard per node, 'cacheShards' in all, each on the memory of its node. A site whose document
+ * root is an archive made by pack is served from the mapped 'archive' instead.
+ */
+struct site {
+    char host[MAX_SITE_HOST];
+    char *docRoot;
+    char defaultFileName[32];
+    struct cache *cache;
+    size_t cacheShards;
+    struct archive *archive;
+};
+
+/**
+ * The sites of a vhosts file in a perfect hash table. A host is hashed once into 'seeds', which holds the seed
+ * that sends every host of its bucket to a slot of its own; the second hash then names the only slot the host can
+ * be in.
+ */
+struct vhost_table {
+    struct site *sites;
+    size_t siteCount;
+    uint32_t *seeds;
+    size_t bucketCount;
+    struct site **slots;
+    size_t slotCount;
+};
+
+int vhost_load(struct vhost_table *table, const char *path);
+const struct site *vhost_find(const struct vhost_table *table, const char *host, size_t hostLength);
+void vhost_free(struct vhost_table *table);
+
+int site_init_cache(struct site *site, long megabytes);
+void site_free_cache(struct site *site);
+int site_open_root(struct site *site, const char *docRoot);
+void site_close_root(struct site *site);
+
+/** Returns the cache shard of a site for the node the calling thread runs on, or NULL if the site has no cache. */
+static inline struct cache *site_cache(const struct site *site) {
+    return site->cacheShards > 1 ? &site->cache[topology_node() % site->cacheShards] : site->cache;
+    }
+
+#endif